@@ -7,10 +7,27 @@
 #include <string.h>
 #include <sys/mman.h> /* for munmap(2) */
 #include <fcntl.h>    /* for O_* flags */
+#include <sys/stat.h> /* for stat(2) */
+#include <glob.h>     /* for glob(3) */
+#include <libgen.h>   /* for basename(3) */
+#include <pthread.h>
 
 #include "tiffio.h"
 
 #include "utils/nvme_nmc.h"
+#include "utils/nvme_nmc_uring.h"
+#include "utils/nvme_nmc_pipe.h"
+#include "utils/nvme_nmc_backend.h"
+#include "utils/nvme_nmc_verify.h"
+#include "utils/nvme_nmc_manifest.h"
+#include "utils/nvme_nmc_bufpool.h"
+#include "utils/nvme_nmc_stats.h"
+#include "utils/nvme_nmc_serve.h"
+#include "utils/nvme_nmc_batch.h"
+#include "utils/nvme_nmc_result.h"
+#include "utils/nvme_nmc_cache.h"
+#include "utils/crc32c.h"
+#include "utils/spsc_ring.h"
 #include "utils/onnx/model_parser.h"
 #include "utils/placement/img_policy_contig.h"
 #include "utils/placement/model_policy_rr.h"
@@ -21,44 +38,110 @@
 /*                          user defined flush logics                         */
 /* -------------------------------------------------------------------------- */
 
+// set by the build, USER_FLUSH_IMAGE_PACKET follows USER_FLUSH_IMAGE unless set (img_policy_contig.h)
 // #define USER_FLUSH_IMAGE         true
+// #define USER_FLUSH_IMAGE_PACKET  true
 // #define USER_MODEL_DATA_APPENDER true
 
 static nmc_config_t cfgNMCWrite;
 
 static size_t numPackets   = 0; // for debugging
 static uint8_t *bufPacket  = NULL;
+static uint32_t *crcPacket = NULL; // per-page crcs of bufPacket, NULL if disabled
+static nmc_hash_t *hashFile = NULL; // content hash of the placed pages, NULL if no cache
 static uint8_t idxTargetFC = 0;
 
+// submitter stage of the upload pipeline, owns all packet buffers
+static nmc_pipe_t *pipePackets = NULL;
+
+// the submitter failed, the remaining packets would be dropped
+static bool upload_failed(void) { return pipePackets && nmc_pipe_error(pipePackets); }
+
+static uint8_t *get_packet(void)
+{
+    if (!bufPacket)
+    {
+        bufPacket = nmc_pipe_get(pipePackets);
+        crcPacket = nmc_pipe_crcs(pipePackets);
+    }
+    return bufPacket;
+}
+
+// the page is still hot in cache, checksum it now rather than in a second pass
+static inline void seal_page(uint8_t iFC)
+{
+    if (crcPacket)
+        crcPacket[iFC] = crc32c(&bufPacket[iFC * BYTES_PER_PAGE], BYTES_PAGE_SIZE);
+    if (hashFile)
+        nmc_hash_update(hashFile, &bufPacket[iFC * BYTES_PER_PAGE], BYTES_PAGE_SIZE);
+}
+
+static void put_packet(void)
+{
+    // dump data to files (in binary format) for verification
+#if (NMC_FLUSH_VERIFY == true)
+    for (uint8_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
+        _flush_page_to_file_bin(iFC, &bufPacket[BYTES_PER_PAGE * iFC], "logs/buffer-data");
+#endif
+
+    // hand over to the submitter (slba will be updated), keep filling the next one
+    nmc_pipe_put(pipePackets, bufPacket);
+    bufPacket = NULL;
+
+    pr_debug("Packet[%lu] flushed!", numPackets);
+    ++numPackets; // do not merge into pr_debug, or assert will failed
+}
+
 static void flush_page_to_nand(uint8_t iFC, uint8_t *data)
 {
-    uint8_t *bufTargetPacket = &bufPacket[iFC * BYTES_PER_PAGE];
+    uint8_t *bufTargetPacket = &get_packet()[iFC * BYTES_PER_PAGE];
     assert_exit((idxTargetFC == iFC), "The expected target FC is %u, not %u", idxTargetFC, iFC);
     memcpy(bufTargetPacket, data, BYTES_PAGE_SIZE);
+    seal_page(iFC);
 
     idxTargetFC += 1;
     if (idxTargetFC == NUM_FLASH_CHANNELS)
     {
         idxTargetFC = 0;
+        put_packet();
+    }
+}
 
-        // dump data to files (in binary format) for verification
-#if (NMC_FLUSH_VERIFY == true)
-        for (uint8_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
-            _flush_page_to_file_bin(iFC, &bufPacket[BYTES_PER_PAGE * iFC], "logs/buffer-data");
-#endif
-
-        // flush to flash memory (slba will be updated)
-        nmc_flush_packet(&cfgNMCWrite, bufPacket, BYTES_PACKET);
+static uint32_t packets_per_cmd(uint32_t coalesce)
+{
+    if (coalesce <= 1)
+        return 1;
 
-        pr_debug("Packet[%lu] flushed!", numPackets);
-        ++numPackets; // do not merge into pr_debug, or assert will failed
+    uint32_t maxPackets = nmc_max_packets_per_cmd(cfgNMCWrite);
+    if (coalesce > maxPackets)
+    {
+        pr_info("Coalesce %u packets exceeds the max transfer size, use %u", coalesce, maxPackets);
+        coalesce = maxPackets;
     }
+    return coalesce;
 }
 
 #if (USER_FLUSH_IMAGE == true)
 void flush_page_image(uint8_t iFC, uint8_t *data) { flush_page_to_nand(iFC, data); }
 #endif /* USER_FLUSH_IMAGE */
 
+#if (USER_FLUSH_IMAGE_PACKET == true)
+// image placement scatters straight into the packet buffer of the submitter
+uint8_t *acquire_packet_image(void)
+{
+    assert_exit(idxTargetFC == 0, "Packet acquired with %u pages pending", idxTargetFC);
+    return get_packet();
+}
+
+void flush_packet_image(uint8_t *packet)
+{
+    assert_exit(packet == bufPacket, "Flush a packet not acquired from the submitter");
+    for (uint8_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
+        seal_page(iFC);
+    put_packet();
+}
+#endif /* USER_FLUSH_IMAGE_PACKET */
+
 #if (USER_FLUSH_MODEL == true)
 void flush_page_model(uint8_t iFC, uint8_t *data)
 {
@@ -79,166 +162,557 @@ void flush_all_model_data() { model_data_force_flush_all(); }
 /* -------------------------------------------------------------------------- */
 /*                              plugin functions                              */
 /* -------------------------------------------------------------------------- */
-static int inference_read(int argc, char **argv, struct command *cmd, struct plugin * )
+/**
+ * @brief Ask the device to run inference on the uploaded file `name` (C3)
+ */
+static int send_inference(nmc_config_t config, const char *name)
 {
-    pr_info("inference read start");
-    // write the data buffer
-    int err;
-    nmc_config_t config = {.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
-
-    OPT_ARGS(opts) = {
-        OPT_STR("file", 'f', &config.data_file, "path to file"),
-        OPT_FLAG("dry-run", 'd', &config.dry, "execute without writing data to device"), OPT_END()};
-
-    err = parse_and_open(&config.dev, config.argc, config.argv, "nmc-flush-buffer", opts);
-    assert_return(!err, err, "`parse_and_open()` failed...");
-
     // create sample buffer
-    config.data_len = BYTES_INF_RESULT*4;
-    config.data     = aligned_alloc(getpagesize(), config.data_len);
-    assert_return(config.data, errno, "failed to allocate data buffer...");
+    config.data_len = BYTES_NVME_BLOCK;
+    config.data     = nmc_buf_alloc(config.data_len);
+    assert_return(config.data, -ENOMEM, "failed to allocate data buffer...");
 
     // check filename length
-    //assert_return((strlen(config.data_file) <= config.data_len), -EINVAL, "filename too long...");
+    int err = -EINVAL;
+    assert_goto((strlen(name) <= config.data_len), out, "filename too long...");
 
     // fill the filename into data buffer
-    //pr("fill the filename \"%s\" into data buffer", config.data_file);
-    //memcpy(config.data, config.data_file, strlen(config.data_file));
+    pr("fill the filename \"%s\" into data buffer", name);
+    memset(config.data, 0, config.data_len);
+    memcpy(config.data, name, strlen(name));
 
     // send request
-    config.OPCODE    = IO_NVM_NMC_INFERENCE_READ;
+    config.OPCODE    = IO_NVM_NMC_INFERENCE;
     config.PSDT      = 0; /* use PRP */
     config.meta_addr = (uintptr_t)NULL;
     config.PRP1      = (uintptr_t)config.data;
 
-    if (config.dry)
-    {
-        pr("opcode       : 0x%02x", config.OPCODE);
-        pr("nsid         : 0x%02x", config.NSID);
-        pr("cdw2         : 0x%08x", config.cdw02);
-        pr("cdw3         : 0x%08x", config.cdw02);
-        pr("data_addr    : %p", config.data);
-        pr("madata_addr  : %p", config.metadata);
-        pr("data_len     : 0x%08x", config.data_len);
-        pr("mdata_len    : 0x%08x", config.metadata_len);
-        pr("slba         : 0x%08lx", config.slba);
-        pr("nlb          : 0x%08x", config.nlb);
-        pr("cdw10        : 0x%08x", config.cdw10);
-        pr("cdw11        : 0x%08x", config.cdw11);
-        pr("cdw12        : 0x%08x", config.cdw12);
-        pr("cdw13        : 0x%08x", config.cdw13);
-        pr("cdw14        : 0x%08x", config.cdw14);
-        pr("cdw15        : 0x%08x", config.cdw15);
-    }
-
-    if (config.dry)
-        return err;
+    err = nmc_send_passthru(true, config);
 
-    err =
-        nvme_io_passthru(dev_fd(config.dev), config.OPCODE, config.flags, config.rsvd, config.NSID,
-                         config.cdw02, config.cdw03, config.cdw10, config.cdw11, config.cdw12,
-                         config.cdw13, config.cdw14, config.cdw15, config.data_len, config.data,
-                         config.metadata_len, config.metadata, config.timeout_ms, &config.result);
-    if (err)
-        pr_error("nvme_io_passthru returned: %d (%s)", err, nvme_strerror(err));
+out:
+    nmc_buf_free(config.data);
+    return err;
+}
+
+/**
+ * @brief Read the whole result of the last inference (C8) into `<out>.bin`
+ */
+static int read_inference(nmc_config_t config, const char *out, uint64_t chunk)
+{
+    char *path;
+    assert_return(asprintf(&path, "%s.bin", out ? out : "inference") != -1, -ENOMEM,
+                  "asprintf failed");
+
+    uint64_t total = 0;
+    int err        = nmc_result_read(&config, NMC_INFERENCE_TICKET_LATEST, path, chunk, &total);
+    if (!err && !config.dry)
+        pr_info("inference result: %lu bytes -> '%s'", total, path);
+
+    free(path);
+    return err;
+}
+
+/**
+ * @brief Get the cache key of `name` through `model`: its recorded stream hash
+ *
+ * @return false if `name` was not recorded, or `model` is not the last model uploaded
+ */
+static bool cache_key(nmc_cache_t *cache, const char *name, bool sameSource, uint64_t model,
+                      uint64_t *image)
+{
+    return nmc_cache_model(cache, model) && nmc_cache_stream(cache, name, sameSource, image);
+}
+
+/**
+ * @brief Open the result cache of an inference, keyed on the content of `modelPath`
+ */
+static nmc_cache_t *cache_open_model(const char *dir, uint64_t max, const char *modelPath,
+                                     uint64_t *model)
+{
+    if (!dir)
+        return NULL;
+
+    // the device does not tell which model it runs, the user has to
+    assert_return(modelPath, NULL, "The result cache needs the model on the device (--cache-model)");
+    assert_return(!nmc_cache_hash_file(modelPath, model), NULL, "Failed to hash model '%s'",
+                  modelPath);
+    return nmc_cache_open(dir, max);
+}
+
+static int inference_read(int argc, char **argv, struct command *cmd, struct plugin * )
+{
+    pr_info("inference read start");
+    int err;
+    nmc_config_t config = {.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
+
+    uint64_t chunk  = 0;
+    uint32_t qdepth = NMC_URING_QDEPTH_DEFAULT;
+    char *backend   = NULL;
+    char *statsJson = NULL;
+    OPT_ARGS(opts)  = {
+        OPT_STR("file", 'f', &config.data_file, "path to file"),
+        OPT_FLAG("dry-run", 'd', &config.dry, "execute without writing data to device"),
+        NMC_RESULT_OPT_CHUNK(&chunk),
+        OPT_UINT("qdepth", 'q', &qdepth, "number of in-flight result reads (1: synchronous)"),
+        NMC_STATS_OPT(&statsJson), NMC_BACKEND_OPT(&backend), OPT_END()};
+
+    err = parse_and_open(&config.dev, config.argc, config.argv, "nmc-flush-buffer", opts);
+    assert_return(!err, err, "`parse_and_open()` failed...");
+
+    err = nmc_backend_open(&config, backend);
+    assert_return(!err, err, "Failed to open backend...");
+
+    err = nmc_async_open(&config, qdepth, false);
+    if (!err)
+        err = read_inference(config, config.data_file, chunk);
 
-    if (config.data){
-        if (!err && config.data_file)
-            _flush_page_to_file_bin_noC(config.data, config.data_file);
-        free(config.data);
-    }
     // free resources
-    
+    nmc_async_close(&config);
+    nmc_backend_close(&config);
+    nmc_stats_report(statsJson);
     return err;
 }
 
 
 static int inference(int argc, char **argv, struct command *cmd, struct plugin *plugin)
 {
-    // write the data buffer
     int err;
     nmc_config_t config = {.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
 
-    OPT_ARGS(opts) = {
+    uint64_t chunk    = 0;
+    uint32_t qdepth   = NMC_URING_QDEPTH_DEFAULT;
+    char *cacheDir    = NULL;
+    uint64_t cacheMax = 0;
+    char *cacheModel  = NULL;
+    char *backend     = NULL;
+    char *statsJson   = NULL;
+    OPT_ARGS(opts)    = {
         OPT_STR("file", 'f', &config.data_file, "the filename of the image to inference"),
-        OPT_FLAG("dry-run", 'd', &config.dry, "execute without writing data to device"), OPT_END()};
+        OPT_FLAG("dry-run", 'd', &config.dry, "execute without writing data to device"),
+        NMC_RESULT_OPT_CHUNK(&chunk),
+        OPT_UINT("qdepth", 'q', &qdepth, "number of in-flight result reads (1: synchronous)"),
+        NMC_CACHE_OPT(&cacheDir, &cacheMax), NMC_CACHE_MODEL_OPT(&cacheModel),
+        NMC_STATS_OPT(&statsJson), NMC_BACKEND_OPT(&backend), OPT_END()};
 
     err = parse_and_open(&config.dev, config.argc, config.argv, "nmc-flush-buffer", opts);
     assert_return(!err, err, "`parse_and_open()` failed...");
+    assert_return(config.data_file != NULL, -EINVAL, "Target file not specified...");
 
-    // create sample buffer
-    config.data_len = BYTES_NVME_BLOCK;
-    config.data     = aligned_alloc(getpagesize(), config.data_len);
-    assert_return(config.data, errno, "failed to allocate data buffer...");
+    uint64_t image, model = 0;
+    nmc_cache_t *cache = cache_open_model(cacheDir, cacheMax, cacheModel, &model);
+    assert_return(cache || !cacheDir, -EINVAL, "Failed to open result cache...");
 
-    
+    // a hit is served without any command to the device
+    char *path;
+    bool keyed = cache_key(cache, config.data_file, false, model, &image);
+    assert_return(asprintf(&path, "%s.bin", config.data_file) != -1, -ENOMEM, "asprintf failed");
+    if (keyed && !config.dry && !nmc_cache_get(cache, image, model, path))
+    {
+        pr_info("inference result: cache hit -> '%s'", path);
+        goto out;
+    }
 
-    // check filename length
-    assert_return((strlen(config.data_file) <= config.data_len), -EINVAL, "filename too long...");
+    err = nmc_backend_open(&config, backend);
+    assert_goto(!err, out, "Failed to open backend...");
 
-    // fill the filename into data buffer
-    pr("fill the filename \"%s\" into data buffer", config.data_file);
-    memcpy(config.data, config.data_file, strlen(config.data_file));
+    err = send_inference(config, config.data_file);
+    if (err)
+        pr_error("nmc_send_passthru returned: %d (%s)", err, nvme_strerror(err));
+    else if (!config.dry)
+    {
+        // read back on the same device and backend, the result is named after the file
+        err = nmc_async_open(&config, qdepth, false);
+        if (!err)
+            err = read_inference(config, config.data_file, chunk);
+        nmc_async_close(&config);
+
+        if (!err && keyed)
+            nmc_cache_put(cache, image, model, path);
+    }
 
-    // send request
-    config.OPCODE    = IO_NVM_NMC_INFERENCE;
-    config.PSDT      = 0; /* use PRP */
-    config.meta_addr = (uintptr_t)NULL;
-    config.PRP1      = (uintptr_t)config.data;
+    nmc_backend_close(&config);
+    nmc_stats_report(statsJson);
 
-    if (config.dry)
-    {
-        pr("opcode       : 0x%02x", config.OPCODE);
-        pr("nsid         : 0x%02x", config.NSID);
-        pr("cdw2         : 0x%08x", config.cdw02);
-        pr("cdw3         : 0x%08x", config.cdw02);
-        pr("data_addr    : %p", config.data);
-        pr("madata_addr  : %p", config.metadata);
-        pr("data_len     : 0x%08x", config.data_len);
-        pr("mdata_len    : 0x%08x", config.metadata_len);
-        pr("slba         : 0x%08lx", config.slba);
-        pr("nlb          : 0x%08x", config.nlb);
-        pr("cdw10        : 0x%08x", config.cdw10);
-        pr("cdw11        : 0x%08x", config.cdw11);
-        pr("cdw12        : 0x%08x", config.cdw12);
-        pr("cdw13        : 0x%08x", config.cdw13);
-        pr("cdw14        : 0x%08x", config.cdw14);
-        pr("cdw15        : 0x%08x", config.cdw15);
-    }
-
-    if (config.dry)
-        return err;
+out:
+    free(path);
+    nmc_cache_close(cache);
+    return err;
+}
 
-    err =
-        nvme_io_passthru(dev_fd(config.dev), config.OPCODE, config.flags, config.rsvd, config.NSID,
-                         config.cdw02, config.cdw03, config.cdw10, config.cdw11, config.cdw12,
-                         config.cdw13, config.cdw14, config.cdw15, config.data_len, config.data,
-                         config.metadata_len, config.metadata, config.timeout_ms, &config.result);
-    printf("%x",err);
-    if (err==0){
-        inference_read(argc,argv,cmd,plugin);
+static int batch_add_name(char ***names, size_t *nnames, const char *name)
+{
+    char **grown = realloc(*names, (*nnames + 1) * sizeof(char *));
+    assert_return(grown, -ENOMEM, "Failed to allocate file list");
+    *names = grown;
+
+    (*names)[*nnames] = strdup(name);
+    assert_return((*names)[*nnames], -ENOMEM, "Failed to allocate file list");
+    *nnames += 1;
+    return 0;
+}
+
+/**
+ * @brief Collect the batch from a comma separated list, a glob and manifests of uploads
+ */
+static int batch_collect_names(char *files, char *pattern, char *manifests, char ***names,
+                               size_t *nnames)
+{
+    int err = 0;
+    char *save;
+
+    for (char *tok = files ? strtok_r(files, ",", &save) : NULL; tok && !err;
+         tok       = strtok_r(NULL, ",", &save))
+        err = batch_add_name(names, nnames, tok);
+
+    if (pattern && !err)
+    {
+        glob_t g;
+        int ret = glob(pattern, 0, NULL, &g);
+        assert_return(ret == 0 || ret == GLOB_NOMATCH, -EINVAL, "Failed to expand '%s'", pattern);
+        for (size_t iPath = 0; iPath < g.gl_pathc && !err; ++iPath)
+            err = batch_add_name(names, nnames, g.gl_pathv[iPath]);
+        globfree(&g);
     }
-    else{
-        pr_error("nvme_io_passthru returned: %d (%s)", err, nvme_strerror(err));
+
+    // the manifest of an upload records the name the file was written with
+    for (char *tok = manifests ? strtok_r(manifests, ",", &save) : NULL; tok && !err;
+         tok       = strtok_r(NULL, ",", &save))
+    {
+        char *name = nmc_manifest_data_file(tok);
+        assert_return(name, -EINVAL, "No data file recorded in manifest '%s'", tok);
+        err = batch_add_name(names, nnames, name);
+        free(name);
     }
-        
+    return err;
+}
 
-    // free resources
-    free(config.data);
+static int inference_batch(int argc, char **argv, struct command *cmd, struct plugin *plugin)
+{
+    nmc_config_t config = {.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
+
+    char *files     = NULL;
+    char *pattern   = NULL;
+    char *manifests = NULL;
+    char *outDir    = ".";
+    uint32_t window = NMC_BATCH_WINDOW_DEFAULT;
+    bool tickets    = false;
+    char *backend   = NULL;
+    char *statsJson = NULL;
+    OPT_ARGS(opts)  = {
+        OPT_LIST("files", 'f', &files, "comma separated filenames to inference"),
+        OPT_STR("glob", 'g', &pattern, "inference every file matching the pattern"),
+        OPT_LIST("manifest", 'm', &manifests, "inference the files of these upload manifests"),
+        OPT_FILE("output-dir", 'o', &outDir, "write the result of each file to DIR/<name>.inf"),
+        OPT_UINT("window", 'w', &window, "number of outstanding inferences (with --tickets)"),
+        NMC_BATCH_TICKETS_OPT(&tickets),
+        OPT_FLAG("dry-run", 'd', &config.dry, "execute without writing data to device"),
+        NMC_STATS_OPT(&statsJson), NMC_BACKEND_OPT(&backend), OPT_END()};
+
+    int err = parse_and_open(&config.dev, argc, argv, "inference-batch", opts);
+    assert_return(!err, err, "`parse_and_open()` failed...");
+    assert_return(window > 0 && window <= NMC_BATCH_WINDOW_MAX, -EINVAL, "Invalid window %u", window);
+
+    char **names  = NULL;
+    size_t nnames = 0;
+    err           = batch_collect_names(files, pattern, manifests, &names, &nnames);
+    assert_goto(!err, out, "Failed to collect the files to inference");
+    err = -ENOENT;
+    assert_goto(nnames, out, "No file to inference...");
+
+    err = nmc_backend_open(&config, backend);
+    assert_goto(!err, out, "Failed to open backend...");
+
+    // one command per outstanding inference is in flight at most (C3, then C8)
+    err = nmc_async_open(&config, window, false);
+    assert_goto(!err, close, "Failed to setup async submission");
+
+    err = nmc_batch_inference(&config, names, nnames, window, tickets, outDir);
+    nmc_async_close(&config);
+
+close:
+    nmc_backend_close(&config);
+out:
+    for (size_t iName = 0; iName < nnames; ++iName)
+        free(names[iName]);
+    free(names);
+    nmc_stats_report(statsJson);
     return err;
 }
 
+/* -------------------------------------------------------------------------- */
+/*                               upload session                               */
+/* -------------------------------------------------------------------------- */
+
+// options shared by write-tiff, write-model and serve
+typedef struct
+{
+    uint32_t qdepth;
+    uint32_t coalesce;
+    uint32_t verify;
+    bool verifyRandom;
+    char *manifest;
+    bool metadata;
+    bool fixedBufs;
+    char *statsJson;
+    char *backend;
+    char *cacheDir;
+    uint64_t cacheMax;
+    uint32_t placementThreads;
+    uint32_t decodeThreads;
+    bool placementStream;
+    uint64_t slba;      // of every upload, the device starts each mapping at the same LBA
+    nmc_cache_t *cache; // records the content hash of each upload, NULL if off
+} upload_opts_t;
+
+#define UPLOAD_OPTS_DEFAULT {.qdepth = NMC_URING_QDEPTH_DEFAULT, .coalesce = 1}
+
+#define UPLOAD_OPTS(o)                                                                           \
+    OPT_FLAG("dry-run", 'd', &cfgNMCWrite.dry, "execute without writing data to device"),        \
+        OPT_UINT("qdepth", 'q', &(o)->qdepth, "number of in-flight commands (1: synchronous)"),  \
+        OPT_UINT("coalesce", 'c', &(o)->coalesce, "number of packets per command (bounded by MDTS)"), \
+        NMC_VERIFY_OPT(&(o)->verify, &(o)->verifyRandom),                                        \
+        NMC_MANIFEST_OPT(&(o)->manifest, &(o)->metadata),                                        \
+        OPT_FLAG("fixed-buffers", 'F', &(o)->fixedBufs, "register the buffer pool as io_uring fixed buffers"), \
+        NMC_CACHE_OPT(&(o)->cacheDir, &(o)->cacheMax), NMC_STATS_OPT(&(o)->statsJson),        \
+        OPT_UINT("placement-threads", 'j', &(o)->placementThreads, "number of threads placing image patches (0, 1: serial)"), \
+        OPT_UINT("decode-threads", 'D', &(o)->decodeThreads, "number of threads decoding TIFF strips or tiles"), \
+        OPT_FLAG("stream-placement", 'P', &(o)->placementStream, "place TIFF rows as they are decoded (bounded memory)"), \
+        NMC_BACKEND_OPT(&(o)->backend)
+
+/**
+ * @brief Attach backend, buffer pool and async engine to the opened device (cfgNMCWrite)
+ */
+static int upload_session_open(upload_opts_t *o)
+{
+    assert_return(o->qdepth > 0 && o->qdepth <= NMC_URING_QDEPTH_MAX, -EINVAL, "Invalid qdepth %u",
+                  o->qdepth);
+
+    int err = nmc_backend_open(&cfgNMCWrite, o->backend);
+    assert_return(!err, err, "Failed to open backend...");
+    o->slba = cfgNMCWrite.slba;
+
+    // all in-flight and filling packet buffers come from one pinned hugepage pool
+    o->coalesce = packets_per_cmd(o->coalesce);
+    err = nmc_bufpool_init((size_t)(o->qdepth + NMC_PIPE_SLACK_CMDS) * o->coalesce * BYTES_PACKET +
+                           NMC_BUFPOOL_HUGEPAGE);
+    assert_return(!err, err, "Failed to setup buffer pool");
+
+    err = nmc_async_open(&cfgNMCWrite, o->qdepth, o->fixedBufs);
+    assert_return(!err, err, "Failed to setup async submission");
+
+    o->cache = nmc_cache_open(o->cacheDir, o->cacheMax);
+    assert_return(o->cache || !o->cacheDir, -EINVAL, "Failed to open result cache");
+
+    dispatch_set_threads(o->placementThreads);
+    dispatch_set_streaming(o->placementStream);
+    dispatch_set_decoders(o->decodeThreads);
+    dispatch_set_cancel(upload_failed);
+    return 0;
+}
+
+static void upload_session_close(upload_opts_t *o)
+{
+    nmc_cache_close(o->cache);
+    o->cache = NULL;
+    nmc_async_close(&cfgNMCWrite);
+    nmc_backend_close(&cfgNMCWrite);
+    nmc_stats_report(o->statsJson);
+}
+
+/**
+ * @brief Open the mapping of `path` and start the submitter, placement can flush pages after it
+ */
+static int upload_begin(const upload_opts_t *o, const char *path, uint32_t filetype,
+                        uint32_t nblks, FILE **fManifest)
+{
+    static nmc_hash_t hash;
+
+    numPackets       = 0;
+    bufPacket        = NULL;
+    crcPacket        = NULL;
+    idxTargetFC      = 0;
+    cfgNMCWrite.slba = o->slba;
+
+    // hashed by placement while each page is in cache, no second pass over the file
+    hashFile = o->cache ? &hash : NULL;
+    if (hashFile)
+        nmc_hash_init(hashFile);
+
+    // the model on the device is unknown until the upload completes, no result matches it
+    if (filetype == NMC_FILE_TYPE_MODEL_UNET)
+        nmc_cache_record(o->cache, filetype, path, 0);
+
+    cfgNMCWrite.data_file = (char *)path;
+    cfgNMCWrite.verify    = nmc_verify_open(&cfgNMCWrite, o->verify, o->verifyRandom);
+
+    int err    = -EIO;
+    *fManifest = o->manifest ? nmc_manifest_create(o->manifest, path) : NULL;
+    assert_goto(*fManifest || !o->manifest, failed, "Failed to create manifest");
+
+    err = nmc_new_mapping(cfgNMCWrite, filetype, nblks);
+    assert_goto(err == 0, failed, "Failed to allocate NMC mapping table");
+
+    pipePackets = nmc_pipe_open(&cfgNMCWrite, o->qdepth + NMC_PIPE_SLACK_CMDS, o->coalesce);
+    err         = -ENOMEM;
+    assert_goto(pipePackets, unmap, "Failed to start the submitter");
+    nmc_pipe_checksum(pipePackets, *fManifest, o->metadata);
+    return 0;
+
+unmap:
+    nmc_close_mapping(cfgNMCWrite);
+failed:
+    nmc_manifest_close(*fManifest);
+    nmc_verify_close(cfgNMCWrite.verify);
+    cfgNMCWrite.verify = NULL;
+    return err;
+}
+
+/**
+ * @brief Stop an upload that cannot be placed or written, nothing is recorded for it
+ *
+ * The packets already flushed are written and the mapping is closed, so the device is ready
+ * for the next upload. The manifest is removed.
+ *
+ * @return `err`
+ */
+static int upload_abort(const upload_opts_t *o, FILE *fManifest, int err)
+{
+    if (pipePackets)
+        nmc_pipe_close(pipePackets);
+    pipePackets = NULL;
+
+    nmc_verify_close(cfgNMCWrite.verify);
+    cfgNMCWrite.verify = NULL;
+
+    if (fManifest)
+    {
+        nmc_manifest_close(fManifest);
+        unlink(o->manifest);
+    }
+
+    nmc_close_mapping(cfgNMCWrite);
+    hashFile = NULL;
+    return err;
+}
+
+/**
+ * @brief Wait for all packets to be written and close the mapping
+ *
+ * @param verifyFailed Set if the upload completed but sampled packets mismatched or failed to read
+ *                     back, the returned error is then the one of verify (may be NULL)
+ * @return The first error, sampled verify mismatches are reported but do not abort the upload
+ */
+static int upload_end(const upload_opts_t *o, const char *path, uint32_t filetype, FILE *fManifest,
+                      bool *verifyFailed)
+{
+    if (verifyFailed)
+        *verifyFailed = false;
+
+    int err = nmc_pipe_close(pipePackets);
+    pipePackets = NULL;
+    if (err)
+    {
+        pr_error("Failed to write packets (%d)", err);
+        return upload_abort(o, fManifest, err);
+    }
+
+    int errVerify      = nmc_verify_close(cfgNMCWrite.verify);
+    cfgNMCWrite.verify = NULL;
+
+    err = nmc_manifest_close(fManifest);
+    assert_return(err == 0, err, "Failed to write manifest '%s'", o->manifest);
+
+    err = nmc_close_mapping(cfgNMCWrite);
+    assert_return(err == 0, err, "Failed to close NMC mapping table");
+
+    // a model is known by its file, the identity lookups are given (--cache-model)
+    uint64_t hash = hashFile ? nmc_hash_final(hashFile) : 0;
+    if (hashFile && filetype == NMC_FILE_TYPE_MODEL_UNET && !access(path, R_OK))
+        nmc_cache_hash_file(path, &hash);
+    if (hashFile)
+        nmc_cache_record(o->cache, filetype, path, hash);
+    hashFile = NULL;
+
+    if (verifyFailed)
+        *verifyFailed = (errVerify != 0);
+    return errVerify;
+}
+
 extern int parse_onnx_unet(const Onnx__ModelProto *model, const ONNX_LAYER_t *layers, size_t n);
-static int write_model(int argc, char **argv, struct command *cmd, struct plugin *plugin)
+static int upload_model(const upload_opts_t *o, const char *path, const Onnx__ModelProto *model,
+                        bool *verifyFailed)
 {
-    cfgNMCWrite = (nmc_config_t){.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
+    // FIXME: not able to expect model size without parsing
+    uint32_t nPacketsExpected = 255;
 
-    // the buffer used by NVMe comand should be aligned to dram page size
-    bufPacket = aligned_alloc(getpagesize(), BYTES_PACKET);
+    assert_return(model, -EINVAL, "Failed to unpack onnx file '%s'", path);
+
+    FILE *fManifest;
+    int err = upload_begin(o, path, NMC_FILE_TYPE_MODEL_UNET, nPacketsExpected, &fManifest);
+    if (err)
+        return err;
+
+    parse_onnx_unet(model, NULL, 0);
+    if (numPackets > nPacketsExpected)
+    {
+        pr_error("Expect < %u, but flush %lu packets", nPacketsExpected, numPackets);
+        return upload_abort(o, fManifest, -EFBIG);
+    }
+
+    return upload_end(o, path, NMC_FILE_TYPE_MODEL_UNET, fManifest, verifyFailed);
+}
+
+static int upload_tiff(const upload_opts_t *o, const char *path, bool *verifyFailed)
+{
+    // try to open tiff file and get image size for calc nblks
+    uint32_t pxHeight, pxWidth;
+
+    TIFF *tif = TIFFOpen(path, "r");
+    assert_return(tif != NULL, -ENOENT, "Failed to open TIFF file '%s'", path);
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &pxWidth);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &pxHeight);
+    TIFFClose(tif);
+
+    // calc number of blocks needed by this image, a large one overflows 32 bits of bytes
+    uint64_t npixels  = (uint64_t)pxHeight * pxWidth;
+    uint64_t nbytes   = npixels * BYTES_PER_PIXEL;
+    uint64_t npages   = (nbytes + (BYTES_PER_PAGE - 1)) / BYTES_PER_PAGE;
+    uint64_t npackets = (npages + (NUM_FLASH_CHANNELS - 1)) / NUM_FLASH_CHANNELS;
+    uint64_t nblks    = (npackets + (NUM_PAGES_PER_BLOCK - 1)) / NUM_PAGES_PER_BLOCK;
+
+    // the block count of C1 (nmc_new_mapping_nblks) is 32 bits
+    assert_return(npixels <= UINT64_MAX / BYTES_PER_PIXEL && nblks <= UINT32_MAX, -EFBIG,
+                  "Image (%u x %u) needs more blocks than a mapping holds", pxWidth, pxHeight);
+
+    FILE *fManifest;
+    int err = upload_begin(o, path, NMC_FILE_TYPE_IMAGE_TIFF, nblks, &fManifest);
+    if (err)
+        return err;
+
+    // decoder -> placement -> submitter, each stage runs on its own thread
+    err = dispatch_tiff(path);
+    if (err == -ECANCELED)
+        err = nmc_pipe_error(pipePackets);
+    if (err)
+        return upload_abort(o, fManifest, err);
+
+    if (npackets != numPackets)
+    {
+        pr_error("Expect %lu, but flush %lu packets", npackets, numPackets);
+        return upload_abort(o, fManifest, -EIO);
+    }
+
+    return upload_end(o, path, NMC_FILE_TYPE_IMAGE_TIFF, fManifest, verifyFailed);
+}
+
+static int write_model(int argc, char **argv, struct command *cmd, struct plugin *plugin)
+{
+    upload_opts_t o = UPLOAD_OPTS_DEFAULT;
+    cfgNMCWrite     = (nmc_config_t){.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
 
     OPT_ARGS(opts) = {
         OPT_FILE("data-file", 'f', &cfgNMCWrite.data_file, "the path to the model file"),
-        OPT_FLAG("dry-run", 'd', &cfgNMCWrite.dry, "execute without writing data to device"),
+        UPLOAD_OPTS(&o),
         OPT_END()};
 
     // try to open target nvme dev
@@ -246,43 +720,29 @@ static int write_model(int argc, char **argv, struct command *cmd, struct plugin
     assert_return(!err, err, "`parse_and_open()` failed...");
     assert_return(cfgNMCWrite.data_file != NULL, -1, "Target model file not specified...");
 
-    // FIXME: not able to expect model size without parsing
-    uint32_t nPacketsExpected = 255;
-
-    // try to allocate new mapping table
-    err = nmc_new_mapping(cfgNMCWrite, NMC_FILE_TYPE_MODEL_UNET, nPacketsExpected);
-    assert_exit(err == 0, "Failed to allocate NMC mapping table");
+    err = upload_session_open(&o);
+    if (err)
+        return err;
 
     // parse model file
     Onnx__ModelProto *model = try_unpack_onnx(cfgNMCWrite.data_file);
+    err                     = upload_model(&o, cfgNMCWrite.data_file, model, NULL);
     if (model)
-    {
-        parse_onnx_unet(model, NULL, 0);
-        assert_exit(numPackets <= nPacketsExpected, "Expect < %u, but flush %lu packets",
-                    nPacketsExpected, numPackets);
         onnx__model_proto__free_unpacked(model, NULL);
-    }
-    else
-        pr("Failed to unpack onnx file...");
 
-    // release resources
-    err = nmc_close_mapping(cfgNMCWrite);
-    assert_exit(err == 0, "Failed to close NMC mapping table");
-    free(bufPacket);
-    return 0;
+    upload_session_close(&o);
+    return err;
 }
 
 static int write_tiff(int argc, char **argv, struct command *cmd, struct plugin *plugin)
 {
-    cfgNMCWrite = (nmc_config_t){.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
-
-    // the buffer used by NVMe comand should be aligned to dram page size
-    bufPacket = aligned_alloc(getpagesize(), BYTES_PACKET);
+    upload_opts_t o = UPLOAD_OPTS_DEFAULT;
+    cfgNMCWrite     = (nmc_config_t){.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
 
     OPT_ARGS(opts) = {
         OPT_SUFFIX("slba", 's', &cfgNMCWrite.slba, "starting lba"),
         OPT_FILE("data-file", 'f', &cfgNMCWrite.data_file, "the path of tiff file"),
-        OPT_FLAG("dry-run", 'd', &cfgNMCWrite.dry, "execute without writing data to device"),
+        UPLOAD_OPTS(&o),
         OPT_END()};
 
     // try to open target nvme dev
@@ -290,32 +750,771 @@ static int write_tiff(int argc, char **argv, struct command *cmd, struct plugin
     assert_return(!err, err, "`parse_and_open()` failed...");
     assert_return(cfgNMCWrite.data_file != NULL, -1, "Target tiff image not specified...");
 
-    // try to open tiff file and get image size for calc nblks
-    uint32_t pxHeight, pxWidth;
+    err = upload_session_open(&o);
+    if (err)
+        return err;
 
-    TIFF *tif = TIFFOpen(cfgNMCWrite.data_file, "r");
-    assert_exit(tif != NULL, "Failed to open TIFF file '%s'", cfgNMCWrite.data_file);
-    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &pxWidth);
-    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &pxHeight);
+    err = upload_tiff(&o, cfgNMCWrite.data_file, NULL);
+
+    upload_session_close(&o);
+    return err;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               write and infer                              */
+/* -------------------------------------------------------------------------- */
+
+// inference stage, runs slide N while the main thread uploads slide N+1
+typedef struct
+{
+    nmc_config_t config; // synchronous, shares the device and backend with the upload
+    spsc_ring_t slides;  // names of closed mappings, in upload order
+    const char *outDir;
+    uint64_t chunk;
+    nmc_cache_t *cache; // thread-safe, shared with the upload thread
+    uint64_t model;     // hash of the model on the device
+    size_t nfailed;
+    size_t nhits;
+    uint64_t nsBusy;
+} infer_stage_t;
+
+static void infer_ticket_done(void *data, int err, uint32_t result, void *arg)
+{
+    *(uint32_t *)arg = result;
+}
+
+// the result is named after the last component of the slide
+static char *infer_result_path(const char *outDir, const char *name)
+{
+    char *base = strdup(name), *path;
+    assert_return(base, NULL, "Failed to allocate output name");
+    int n = asprintf(&path, "%s/%s.inf", outDir, basename(base));
+    free(base);
+    return (n != -1) ? path : NULL;
+}
+
+static int infer_slide(infer_stage_t *st, uint8_t *buf, const char *name)
+{
+    char *path = infer_result_path(st->outDir, name);
+    assert_return(path, -ENOMEM, "asprintf failed");
+
+    // keyed by the stream hash placement just recorded for this upload
+    uint64_t image;
+    bool keyed = cache_key(st->cache, name, false, st->model, &image);
+    if (keyed && !nmc_cache_get(st->cache, image, st->model, path))
+    {
+        pr_info("%s: cache hit -> '%s'", name, path);
+        st->nhits += 1;
+        free(path);
+        return 0;
+    }
+
+    uint32_t ticket = NMC_INFERENCE_TICKET_LATEST;
+    int err         = nmc_inference_async(&st->config, buf, name, infer_ticket_done, &ticket);
+    assert_goto(!err, out, "Failed to inference '%s'", name);
+
+    uint64_t total = 0;
+    err            = nmc_result_read(&st->config, ticket, path, st->chunk, &total);
+    if (!err)
+        pr_info("%s: %lu bytes -> '%s'", name, total, path);
+    if (!err && keyed)
+        nmc_cache_put(st->cache, image, st->model, path);
+
+out:
+    free(path);
+    return err;
+}
+
+static void *infer_stage_main(void *arg)
+{
+    infer_stage_t *st = arg;
+    uint8_t *buf      = nmc_buf_alloc(BYTES_NVME_BLOCK);
+    assert_exit(buf, "Failed to allocate inference buffer");
+
+    for (char *name; (name = spsc_ring_pop(&st->slides)); free(name))
+    {
+        uint64_t t0 = nmc_stats_now();
+        if (infer_slide(st, buf, name))
+            st->nfailed += 1;
+        st->nsBusy += nmc_stats_now() - t0;
+    }
+
+    nmc_buf_free(buf);
+    return NULL;
+}
+
+static int write_and_infer(int argc, char **argv, struct command *cmd, struct plugin *plugin)
+{
+    upload_opts_t o = UPLOAD_OPTS_DEFAULT;
+    cfgNMCWrite     = (nmc_config_t){.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
+
+    char *files    = NULL;
+    char *pattern  = NULL;
+    char *outDir     = ".";
+    uint64_t chunk   = 0;
+    char *cacheModel = NULL;
+    OPT_ARGS(opts)   = {
+        OPT_LIST("files", 'f', &files, "comma separated tiff images, uploaded in order"),
+        OPT_STR("glob", 'g', &pattern, "upload every tiff image matching the pattern"),
+        OPT_FILE("output-dir", 'o', &outDir, "write the result of each image to DIR/<name>.inf"),
+        OPT_SUFFIX("chunk", 'C', &chunk, "bytes per result read (0: max transfer size)"),
+        NMC_CACHE_MODEL_OPT(&cacheModel),
+        UPLOAD_OPTS(&o),
+        OPT_END()};
+
+    int err = parse_and_open(&cfgNMCWrite.dev, argc, argv, "write-and-infer", opts);
+    assert_return(!err, err, "`parse_and_open()` failed...");
+    assert_return(o.manifest == NULL, -EINVAL, "Manifests are not supported for a queue of slides");
+
+    char **names  = NULL;
+    size_t nnames = 0;
+    err           = batch_collect_names(files, pattern, NULL, &names, &nnames);
+    assert_goto(!err && nnames, out, "No tiff image to upload...");
+
+    uint64_t model = 0;
+    err            = -EINVAL;
+    assert_goto(!o.cacheDir || cacheModel, out,
+                "The result cache needs the model on the device (--cache-model)");
+    assert_goto(!o.cacheDir || !nmc_cache_hash_file(cacheModel, &model), out,
+                "Failed to hash model '%s'", cacheModel);
+
+    err = upload_session_open(&o);
+    assert_goto(!err, out, "Failed to open upload session");
+
+    // the io_uring engine belongs to the upload thread, inferences go synchronously
+    infer_stage_t st = {.outDir = outDir, .chunk = chunk, .cache = o.cache, .model = model};
+    st.config        = cfgNMCWrite;
+    st.config.uring  = NULL;
+    st.config.verify = NULL;
+
+    pthread_t thread;
+    assert_exit(spsc_ring_init(&st.slides, nnames), "Failed to allocate slide queue");
+    assert_exit(!pthread_create(&thread, NULL, infer_stage_main, &st), "Failed to start inference");
+
+    size_t nfailed = 0, nskipped = 0;
+    uint64_t tStart = nmc_stats_now(), nsUpload = 0;
+    for (size_t iName = 0; iName < nnames; ++iName)
+    {
+        // an unchanged source with a cached result needs neither upload nor inference
+        uint64_t image;
+        char *path = o.cache ? infer_result_path(outDir, names[iName]) : NULL;
+        bool hit   = path && cache_key(o.cache, names[iName], true, model, &image) &&
+                   !nmc_cache_get(o.cache, image, model, path);
+        if (hit)
+            pr_info("%s: cache hit -> '%s', upload skipped", names[iName], path);
+        free(path);
+        if (hit)
+        {
+            nskipped += 1;
+            continue;
+        }
+
+        bool verifyFailed;
+        uint64_t t0 = nmc_stats_now();
+        int errUp   = upload_tiff(&o, names[iName], &verifyFailed);
+        nsUpload += nmc_stats_now() - t0;
+
+        // sampled verify mismatches are reported, the slide is still inferred
+        if (errUp && !verifyFailed)
+        {
+            pr_error("%s: upload failed (%d), skip its inference", names[iName], errUp);
+            nfailed += 1;
+            continue;
+        }
+
+        // the mapping is closed, the device can start on it while the next slide uploads
+        spsc_ring_push(&st.slides, names[iName]);
+        names[iName] = NULL;
+    }
+
+    spsc_ring_close(&st.slides);
+    pthread_join(thread, NULL);
+    spsc_ring_free(&st.slides);
+
+    double sec = (nmc_stats_now() - tStart) / 1e9;
+    nfailed += st.nfailed;
+    pr_info("write-and-infer: %zu slides, %zu failed, %.3f s (upload %.3f s, inference %.3f s)",
+            nnames, nfailed, sec, nsUpload / 1e9, st.nsBusy / 1e9);
+    if (o.cache)
+        pr_info("write-and-infer: %zu cache hits (%zu without upload)", nskipped + st.nhits,
+                nskipped);
+
+    upload_session_close(&o);
+    err = nfailed ? -EIO : 0;
+
+out:
+    for (size_t iName = 0; iName < nnames; ++iName)
+        free(names[iName]);
+    free(names);
+    return err ? err : (nnames ? 0 : -EINVAL);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  benchmark                                 */
+/* -------------------------------------------------------------------------- */
+
+#define BENCH_MAX_POINTS 16
+
+enum
+{
+    BENCH_MODEL,
+    BENCH_IMAGE,
+    BENCH_INFER,
+    BENCH_READ,
+    BENCH_NPHASES,
+};
+
+static const char *const benchPhaseNames[BENCH_NPHASES] = {"model", "image", "infer", "read"};
+
+// latencies of the operations of one phase at one sweep point
+typedef struct
+{
+    uint64_t *ns;
+    size_t n;
+    uint64_t bytes;
+    uint64_t nsTotal;
+} bench_phase_t;
+
+typedef struct
+{
+    uint32_t nimages;
+    uint32_t pxSide;
+    uint64_t modelBytes;
+    uint32_t rounds;
+    char dir[32]; // synthetic inputs and the read back results
+    char **images;
+    bench_phase_t phases[BENCH_NPHASES];
+} bench_t;
+
+// xorshift64*, synthetic data only has to defeat compression and deduplication
+static inline uint64_t bench_rand(uint64_t *s)
+{
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1DULL;
+}
+
+static void bench_record(bench_phase_t *ph, uint64_t t0, uint64_t bytes)
+{
+    uint64_t ns = nmc_stats_now() - t0;
+    ph->ns[ph->n++] = ns;
+    ph->nsTotal += ns;
+    ph->bytes += bytes;
+}
+
+static int bench_cmp_ns(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int bench_parse_list(char *list, uint32_t dflt, uint32_t vals[BENCH_MAX_POINTS], uint32_t *n)
+{
+    *n = 0;
+    if (!list)
+    {
+        vals[(*n)++] = dflt;
+        return 0;
+    }
+
+    for (char *save, *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+        char *end;
+        unsigned long val = strtoul(tok, &end, 0);
+        assert_return(*n < BENCH_MAX_POINTS, -EINVAL, "At most %u sweep values", BENCH_MAX_POINTS);
+        assert_return(!*end && val && val <= UINT32_MAX, -EINVAL, "Invalid sweep value '%s'", tok);
+        vals[(*n)++] = val;
+    }
+    return *n ? 0 : -EINVAL;
+}
+
+/**
+ * @brief Write a pxSide x pxSide RGB tiff of random pixels, uncompressed and striped
+ */
+static int bench_gen_tiff(const char *path, uint32_t pxSide, uint64_t seed)
+{
+    TIFF *tif = TIFFOpen(path, "w");
+    assert_return(tif, -EIO, "Failed to create '%s'", path);
+
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, pxSide);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, pxSide);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, NUM_CHANNELS_PER_PIXEL);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+
+    size_t nwords = ((size_t)pxSide * BYTES_PER_PIXEL + 7) / 8;
+    uint64_t *row = malloc(nwords * sizeof(uint64_t));
+    int err       = row ? 0 : -ENOMEM;
+
+    for (uint32_t iRow = 0; iRow < pxSide && !err; ++iRow)
+    {
+        for (size_t iWord = 0; iWord < nwords; ++iWord)
+            row[iWord] = bench_rand(&seed);
+        if (TIFFWriteScanline(tif, row, iRow, 0) < 0)
+            err = -EIO;
+    }
+
+    free(row);
     TIFFClose(tif);
+    return err;
+}
+
+/**
+ * @brief Upload `bytes` of random weights through the model placement, as write-model does
+ */
+static int bench_upload_model(const upload_opts_t *o, const char *name, uint64_t bytes)
+{
+    // the final force flush pads every channel, one more packet at most
+    uint64_t npackets = (bytes + BYTES_PACKET - 1) / BYTES_PACKET + 1;
+    uint32_t nblks    = (npackets + NUM_PAGES_PER_BLOCK - 1) / NUM_PAGES_PER_BLOCK;
+
+    FILE *fManifest;
+    int err = upload_begin(o, name, NMC_FILE_TYPE_MODEL_UNET, nblks, &fManifest);
+    if (err)
+        return err;
 
-    // calc number of blocks needed by this image
-    uint32_t nbytes   = pxHeight * pxWidth * BYTES_PER_PIXEL;
-    uint32_t npages   = (nbytes + (BYTES_PER_PAGE - 1)) / BYTES_PER_PAGE;
-    uint32_t npackets = (npages + (NUM_FLASH_CHANNELS - 1)) / NUM_FLASH_CHANNELS;
-    uint32_t nblks    = (npackets + (NUM_PAGES_PER_BLOCK - 1)) / NUM_PAGES_PER_BLOCK;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL, word = 0;
+    for (uint64_t iByte = 0; iByte < bytes; ++iByte)
+    {
+        if (iByte % 8 == 0)
+            word = bench_rand(&seed);
+        append_model_data((uint8_t)(word >> (iByte % 8 * 8)), iByte == bytes - 1);
+    }
+    flush_all_model_data();
 
-    err = nmc_new_mapping(cfgNMCWrite, NMC_FILE_TYPE_IMAGE_TIFF, nblks);
-    assert_exit(err == 0, "Failed to allocate NMC mapping table");
+    return upload_end(o, name, NMC_FILE_TYPE_MODEL_UNET, fManifest, NULL);
+}
 
-    dispatch_tiff(cfgNMCWrite.data_file);
-    assert_exit(npackets == numPackets, "Expect %u, but flush %lu packets", npackets, numPackets);
+/**
+ * @brief Run all rounds of one sweep point on the backend of `o`
+ */
+static int bench_point(bench_t *b, upload_opts_t *o)
+{
+    for (int iPhase = 0; iPhase < BENCH_NPHASES; ++iPhase)
+        b->phases[iPhase].n = b->phases[iPhase].bytes = b->phases[iPhase].nsTotal = 0;
 
-    err = nmc_close_mapping(cfgNMCWrite);
-    assert_exit(err == 0, "Failed to close NMC mapping table");
+    nmc_stats_reset();
+    int err = upload_session_open(o);
+    if (err)
+        return err;
 
-    free(bufPacket);
-    return 0;
+    // C3 goes synchronously like the inference stage, the result is read on the engine
+    nmc_config_t sync = cfgNMCWrite;
+    sync.uring        = NULL;
+    sync.verify       = NULL;
+
+    char model[64], out[64];
+    snprintf(model, sizeof(model), "%s/model", b->dir);
+    snprintf(out, sizeof(out), "%s/result.bin", b->dir);
+
+    uint8_t *buf        = nmc_buf_alloc(BYTES_NVME_BLOCK);
+    uint64_t bytesImage = (uint64_t)b->pxSide * b->pxSide * BYTES_PER_PIXEL;
+    assert_goto(buf, close, "Failed to allocate inference buffer");
+
+    for (uint32_t iRound = 0; iRound < b->rounds && !err; ++iRound)
+    {
+        uint64_t t0 = nmc_stats_now();
+        if (b->modelBytes)
+        {
+            err = bench_upload_model(o, model, b->modelBytes);
+            bench_record(&b->phases[BENCH_MODEL], t0, b->modelBytes);
+        }
+
+        for (uint32_t iImage = 0; iImage < b->nimages && !err; ++iImage)
+        {
+            t0  = nmc_stats_now();
+            err = upload_tiff(o, b->images[iImage], NULL);
+            bench_record(&b->phases[BENCH_IMAGE], t0, bytesImage);
+        }
+
+        for (uint32_t iImage = 0; iImage < b->nimages && !err; ++iImage)
+        {
+            uint32_t ticket = NMC_INFERENCE_TICKET_LATEST;
+            t0              = nmc_stats_now();
+            err = nmc_inference_async(&sync, buf, b->images[iImage], infer_ticket_done, &ticket);
+            bench_record(&b->phases[BENCH_INFER], t0, 0);
+            if (err)
+                break;
+
+            uint64_t total = 0;
+            t0             = nmc_stats_now();
+            err            = nmc_result_read(&cfgNMCWrite, ticket, out, 0, &total);
+            bench_record(&b->phases[BENCH_READ], t0, total);
+        }
+    }
+    nmc_buf_free(buf);
+
+close:
+    upload_session_close(o);
+    return err;
+}
+
+static void bench_report(bench_t *b, const char *label, const upload_opts_t *o,
+                         const bench_phase_t *ref)
+{
+    for (int iPhase = 0; iPhase < BENCH_NPHASES; ++iPhase)
+    {
+        bench_phase_t *ph = &b->phases[iPhase];
+        if (!ph->n)
+            continue;
+
+        qsort(ph->ns, ph->n, sizeof(uint64_t), bench_cmp_ns);
+        double sec = ph->nsTotal / 1e9;
+
+        pr_info("bench: %-6s qd=%-3u co=%-3u %-5s n=%-5zu %9.1f MB/s %9.2f op/s p50=%9.1fus "
+                "p90=%9.1fus p99=%9.1fus max=%9.1fus",
+                label, o->qdepth, o->coalesce, benchPhaseNames[iPhase], ph->n,
+                ph->bytes / 1e6 / sec, ph->n / sec, ph->ns[(ph->n - 1) / 2] / 1e3,
+                ph->ns[(size_t)((ph->n - 1) * 0.90)] / 1e3,
+                ph->ns[(size_t)((ph->n - 1) * 0.99)] / 1e3, ph->ns[ph->n - 1] / 1e3);
+
+        // the stubbed run is the host cost, the rest of the real run is the device
+        if (ref && ref[iPhase].nsTotal)
+            pr_info("bench: %-6s qd=%-3u co=%-3u %-5s device share %.1f%%", label, o->qdepth,
+                    o->coalesce, benchPhaseNames[iPhase],
+                    100.0 * (1.0 - (double)ph->nsTotal / ref[iPhase].nsTotal));
+    }
+}
+
+static int bench(int argc, char **argv, struct command *cmd, struct plugin *plugin)
+{
+    upload_opts_t o = UPLOAD_OPTS_DEFAULT;
+    cfgNMCWrite     = (nmc_config_t){.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
+
+    bench_t b       = {.nimages = 4, .pxSide = 2048, .modelBytes = 16 << 20, .rounds = 1};
+    char *qdepths   = NULL;
+    char *coalesces = NULL;
+    bool stub       = false;
+    OPT_ARGS(opts)  = {
+        OPT_UINT("images", 'n', &b.nimages, "synthetic images per round (0: model only)"),
+        OPT_UINT("size", 'x', &b.pxSide, "width and height of the synthetic images in pixels"),
+        OPT_SUFFIX("model-size", 'M', &b.modelBytes, "bytes of the synthetic model (0: skip)"),
+        OPT_UINT("rounds", 'r', &b.rounds, "model, image and inference passes per sweep point"),
+        OPT_LIST("qdepth", 'q', &qdepths, "comma separated queue depths to sweep"),
+        OPT_LIST("coalesce", 'c', &coalesces, "comma separated packets per command to sweep"),
+        OPT_FLAG("stub", 's', &stub, "repeat each point with device I/O stubbed out (null backend)"),
+        OPT_FLAG("fixed-buffers", 'F', &o.fixedBufs, "register the buffer pool as io_uring fixed buffers"),
+        NMC_BACKEND_OPT(&o.backend),
+        OPT_END()};
+
+    int err = parse_and_open(&cfgNMCWrite.dev, argc, argv, "bench", opts);
+    assert_return(!err, err, "`parse_and_open()` failed...");
+    assert_return(b.rounds > 0 && b.pxSide > 0, -EINVAL, "Invalid rounds or image size");
+
+    uint32_t qds[BENCH_MAX_POINTS], cos[BENCH_MAX_POINTS], nqds, ncos;
+    err = bench_parse_list(qdepths, NMC_URING_QDEPTH_DEFAULT, qds, &nqds);
+    err = err ? err : bench_parse_list(coalesces, 1, cos, &ncos);
+    assert_return(!err, err, "Invalid sweep");
+
+    // the pool is mapped once per process, size it for the largest point
+    uint32_t maxQd = 0, maxCo = 0;
+    for (uint32_t i = 0; i < nqds; ++i)
+        maxQd = (qds[i] > maxQd) ? qds[i] : maxQd;
+    for (uint32_t i = 0; i < ncos; ++i)
+        maxCo = (cos[i] > maxCo) ? cos[i] : maxCo;
+    err = nmc_bufpool_init((size_t)(maxQd + NMC_PIPE_SLACK_CMDS) * maxCo * BYTES_PACKET +
+                           NMC_BUFPOOL_HUGEPAGE);
+    assert_return(!err, err, "Failed to setup buffer pool");
+
+    size_t nops = (size_t)b.rounds * (b.nimages ? b.nimages : 1);
+    for (int iPhase = 0; iPhase < BENCH_NPHASES; ++iPhase)
+    {
+        b.phases[iPhase].ns = calloc(nops, sizeof(uint64_t));
+        assert_exit(b.phases[iPhase].ns, "Failed to allocate latency samples");
+    }
+
+    // generate the inputs once, outside of every measurement
+    strcpy(b.dir, "/tmp/nmc-bench-XXXXXX");
+    assert_goto(mkdtemp(b.dir), free, "Failed to create '%s' (%s)", b.dir, strerror(errno));
+    b.images = calloc(b.nimages + 1, sizeof(char *));
+    assert_exit(b.images, "Failed to allocate image names");
+    for (uint32_t iImage = 0; iImage < b.nimages && !err; ++iImage)
+    {
+        assert_exit(asprintf(&b.images[iImage], "%s/image%u.tiff", b.dir, iImage) != -1,
+                    "asprintf failed");
+        err = bench_gen_tiff(b.images[iImage], b.pxSide, (iImage + 1) * 0x9E3779B97F4A7C15ULL);
+    }
+    assert_goto(!err, cleanup, "Failed to generate the synthetic images");
+
+    pr_info("bench: %u x %u px images x %u, %lu bytes model, %u rounds, backend '%s'", b.pxSide,
+            b.pxSide, b.nimages, b.modelBytes, b.rounds, o.backend ? o.backend : "nvme");
+
+    for (uint32_t iQd = 0; iQd < nqds && !err; ++iQd)
+        for (uint32_t iCo = 0; iCo < ncos && !err; ++iCo)
+        {
+            bench_phase_t ref[BENCH_NPHASES];
+            o.qdepth   = qds[iQd];
+            o.coalesce = cos[iCo];
+
+            err = bench_point(&b, &o);
+            assert_goto(!err, cleanup, "Sweep point qd=%u co=%u failed (%d)", o.qdepth,
+                        o.coalesce, err);
+            bench_report(&b, o.backend ? o.backend : "nvme", &o, NULL);
+            if (!stub)
+                continue;
+
+            // same point with the device removed, only the host side is left
+            char *backend = o.backend;
+            memcpy(ref, b.phases, sizeof(ref));
+            o.backend  = "null";
+            o.coalesce = cos[iCo];
+            err        = bench_point(&b, &o);
+            o.backend  = backend;
+            assert_goto(!err, cleanup, "Stubbed point qd=%u co=%u failed (%d)", o.qdepth,
+                        o.coalesce, err);
+            bench_report(&b, "host", &o, ref);
+        }
+
+cleanup:
+    for (uint32_t iImage = 0; iImage < b.nimages; ++iImage)
+        if (b.images[iImage])
+        {
+            unlink(b.images[iImage]);
+            free(b.images[iImage]);
+        }
+    free(b.images);
+
+    char out[64];
+    snprintf(out, sizeof(out), "%s/result.bin", b.dir);
+    unlink(out);
+    rmdir(b.dir);
+
+free:
+    for (int iPhase = 0; iPhase < BENCH_NPHASES; ++iPhase)
+        free(b.phases[iPhase].ns);
+    return err;
+}
+
+static int audit(int argc, char **argv, struct command *cmd, struct plugin *plugin)
+{
+    uint32_t every      = 1;
+    char *manifest      = NULL;
+    char *backend       = NULL;
+    char *statsJson     = NULL;
+    nmc_config_t config = {.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
+
+    OPT_ARGS(opts) = {
+        OPT_FILE("manifest", 'm', &manifest, "manifest written by write-tiff/write-model"),
+        OPT_UINT("every", 'n', &every, "audit 1-in-N packets"),
+        NMC_STATS_OPT(&statsJson),
+        NMC_BACKEND_OPT(&backend),
+        OPT_END()};
+
+    int err = parse_and_open(&config.dev, argc, argv, "audit", opts);
+    assert_return(!err, err, "`parse_and_open()` failed...");
+    assert_return(manifest != NULL, -EINVAL, "Manifest not specified...");
+    assert_return(every > 0, -EINVAL, "Invalid sampling interval");
+
+    size_t nentries;
+    nmc_manifest_entry_t *entries = nmc_manifest_load(manifest, &nentries);
+    assert_return(entries, -EINVAL, "Failed to load manifest '%s'", manifest);
+
+    err = nmc_backend_open(&config, backend);
+    assert_goto(!err, free_entries, "Failed to open backend...");
+
+    config.data = nmc_buf_alloc(BYTES_PACKET);
+    err         = -ENOMEM;
+    assert_goto(config.data, close_backend, "failed to allocate data buffer...");
+
+    config.OPCODE   = IO_NVM_READ;
+    config.data_len = BYTES_PACKET;
+    config.nlb      = BYTES_PACKET / BYTES_NVME_BLOCK - 1;
+
+    // read back the sampled packets and compare the crc of each page
+    uint64_t nsampled = 0, npackets = 0, nmismatched = 0, nfailed = 0;
+    for (size_t iEntry = 0; iEntry < nentries; iEntry += every)
+    {
+        nsampled += 1;
+        config.slba = entries[iEntry].slba;
+        if (nmc_send_passthru(true, config))
+        {
+            nfailed += 1;
+            continue;
+        }
+
+        npackets += 1;
+        for (uint32_t iCh = 0; iCh < NUM_CHANNELS; ++iCh)
+        {
+            uint32_t crc = crc32c(&config.data[iCh * BYTES_PER_PAGE], BYTES_PER_PAGE);
+            if (crc == entries[iEntry].crcs[iCh])
+                continue;
+
+            pr_error("audit: slba 0x%lx channel %u crc %08x != %08x", config.slba, iCh, crc,
+                     entries[iEntry].crcs[iCh]);
+            nmismatched += 1;
+        }
+    }
+
+    pr_info("audit: %lu/%lu sampled packets read (1 in %u), %lu pages mismatched, %lu read errors",
+            npackets, nsampled, every, nmismatched, nfailed);
+
+    nmc_buf_free(config.data);
+    err = (nmismatched || nfailed) ? -EIO : 0;
+    nmc_stats_report(statsJson);
+
+close_backend:
+    nmc_backend_close(&config);
+free_entries:
+    free(entries);
+    return err;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                session daemon                              */
+/* -------------------------------------------------------------------------- */
+
+#define SERVE_MODEL_CACHE 8
+
+// parsed models stay resident, a file changed on disk (mtime/size) is parsed again
+typedef struct
+{
+    char *path;
+    struct timespec mtime;
+    off_t size;
+    uint64_t lastUse;
+    Onnx__ModelProto *model;
+} serve_model_t;
+
+typedef struct
+{
+    upload_opts_t *opts;
+    uint64_t tick;
+    serve_model_t models[SERVE_MODEL_CACHE];
+} serve_ctx_t;
+
+static void serve_model_evict(serve_model_t *m)
+{
+    if (m->model)
+        onnx__model_proto__free_unpacked(m->model, NULL);
+    free(m->path);
+    *m = (serve_model_t){0};
+}
+
+static Onnx__ModelProto *serve_model_get(serve_ctx_t *ctx, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st))
+        return NULL;
+
+    serve_model_t *victim = &ctx->models[0];
+    for (uint32_t i = 0; i < SERVE_MODEL_CACHE; ++i)
+    {
+        serve_model_t *m = &ctx->models[i];
+        if (m->path && !strcmp(m->path, path))
+        {
+            if (m->size == st.st_size && m->mtime.tv_sec == st.st_mtim.tv_sec &&
+                m->mtime.tv_nsec == st.st_mtim.tv_nsec)
+            {
+                m->lastUse = ++ctx->tick;
+                return m->model;
+            }
+            victim = m; // stale, parse again into the same slot
+            break;
+        }
+        if (m->lastUse < victim->lastUse)
+            victim = m;
+    }
+
+    serve_model_evict(victim);
+    Onnx__ModelProto *model = try_unpack_onnx(path);
+    if (!model)
+        return NULL;
+
+    *victim = (serve_model_t){.path    = strdup(path),
+                              .mtime   = st.st_mtim,
+                              .size    = st.st_size,
+                              .lastUse = ++ctx->tick,
+                              .model   = model};
+    return model;
+}
+
+static int serve_handle(int argc, char **argv, FILE *out, void *arg)
+{
+    serve_ctx_t *ctx = arg;
+    upload_opts_t o  = *ctx->opts;
+
+    if (!strcmp(argv[0], "write-tiff") || !strcmp(argv[0], "write-model"))
+    {
+        assert_return(argc >= 2 && argc <= 3, -EINVAL, "usage: %s PATH [MANIFEST]", argv[0]);
+        o.manifest = argc == 3 ? argv[2] : NULL;
+
+        int err;
+        if (!strcmp(argv[0], "write-tiff"))
+            err = upload_tiff(&o, argv[1], NULL);
+        else
+        {
+            Onnx__ModelProto *model = serve_model_get(ctx, argv[1]);
+            assert_return(model, -ENOENT, "Failed to load model '%s'", argv[1]);
+            err = upload_model(&o, argv[1], model, NULL);
+        }
+
+        fprintf(out, "packets %lu\n", numPackets);
+        return err;
+    }
+
+    if (!strcmp(argv[0], "infer"))
+    {
+        assert_return(argc >= 2 && argc <= 3, -EINVAL, "usage: infer NAME [OUT]");
+        int err = send_inference(cfgNMCWrite, argv[1]);
+        if (err || argc == 2)
+            return err;
+        return read_inference(cfgNMCWrite, argv[2], 0);
+    }
+
+    if (!strcmp(argv[0], "read"))
+    {
+        assert_return(argc == 2, -EINVAL, "usage: read OUT");
+        return read_inference(cfgNMCWrite, argv[1], 0);
+    }
+
+    if (!strcmp(argv[0], "stats"))
+    {
+        assert_return(argc <= 2, -EINVAL, "usage: stats [JSON]");
+        // the text report goes to the daemon's log, the JSON to the given path
+        nmc_stats_report(argc == 2 ? argv[1] : NULL);
+        return 0;
+    }
+
+    if (!strcmp(argv[0], "reset"))
+    {
+        nmc_stats_reset();
+        return 0;
+    }
+
+    return -EOPNOTSUPP;
+}
+
+static int serve(int argc, char **argv, struct command *cmd, struct plugin *plugin)
+{
+    upload_opts_t o = UPLOAD_OPTS_DEFAULT;
+    char *sockPath  = NMC_SERVE_SOCKET_DEFAULT;
+    cfgNMCWrite     = (nmc_config_t){.argc = argc, .argv = argv, .NSID = OPENSSD_NSID};
+
+    OPT_ARGS(opts) = {
+        NMC_SERVE_OPT(&sockPath),
+        UPLOAD_OPTS(&o),
+        OPT_END()};
+
+    int err = parse_and_open(&cfgNMCWrite.dev, argc, argv, "serve", opts);
+    assert_return(!err, err, "`parse_and_open()` failed...");
+    assert_return(o.manifest == NULL, -EINVAL, "Manifests are given per request, not to the daemon");
+
+    // device, backend, buffer pool and io_uring stay open for every request
+    err = upload_session_open(&o);
+    if (err)
+        return err;
+
+    serve_ctx_t ctx = {.opts = &o};
+    err             = nmc_serve_run(sockPath, serve_handle, &ctx);
+
+    for (uint32_t i = 0; i < SERVE_MODEL_CACHE; ++i)
+        serve_model_evict(&ctx.models[i]);
+
+    upload_session_close(&o);
+    return err;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -487,7 +1686,7 @@ static int monitor_nmc_mapping(int argc, char **argv, struct command *cmd, struc
         {
             config.OPCODE   = IO_NVM_NMC_ALLOC;
             config.data_len = NMC_FILENAME_MAX_BYTES;
-            config.data     = aligned_alloc(getpagesize(), config.data_len);
+            config.data     = nmc_buf_alloc(config.data_len);
 
             config.monitor_mode = 0;
             config.slba         = 0;
@@ -504,8 +1703,9 @@ static int monitor_nmc_mapping(int argc, char **argv, struct command *cmd, struc
     err = nmc_send_passthru(io_cmd, config);
 
     if (config.monitor_mode == MODE_FILE_ALLOC.mode_code)
-        free(config.data);
+        nmc_buf_free(config.data);
 
+    nmc_stats_report(NULL);
     return err;
 }
 
@@ -606,6 +1806,7 @@ static int monitor_buffer(int argc, char **argv, struct command *cmd, struct plu
     assert_return(!err, err, "Failed to parse the options or open the target dev '%s'...", argv[1]);
 
     err = nmc_send_passthru(io_cmd, config);
+    nmc_stats_report(NULL);
     return err;
 }
 
@@ -721,7 +1922,7 @@ static int monitor_flash(int argc, char **argv, struct command *cmd, struct plug
         config.NSID     = OPENSSD_NSID;
         config.OPCODE   = 0x92; // IO_NVM_READ_PHY
         config.data_len = BYTES_PER_PAGE;
-        config.data     = aligned_alloc(getpagesize(), BYTES_PER_PAGE);
+        config.data     = nmc_buf_alloc(BYTES_PER_PAGE);
 
         pr_info("Target flash page info:");
         pr_info("\t iCh = %u", config.iCh);
@@ -745,9 +1946,10 @@ static int monitor_flash(int argc, char **argv, struct command *cmd, struct plug
     {
         if (!err && config.data_file)
             _flush_page_to_file_bin(config.iCh, config.data, config.data_file);
-        free(config.data);
+        nmc_buf_free(config.data);
     }
 
+    nmc_stats_report(NULL);
     return err;
 }
 
@@ -826,6 +2028,7 @@ static int monitor_mapping(int argc, char **argv, struct command *cmd, struct pl
     assert_return(!err, err, "Failed to parse the options or open the target dev '%s'...", argv[1]);
 
     err = nmc_send_passthru(io_cmd, config);
+    nmc_stats_report(NULL);
     return err;
 }
 
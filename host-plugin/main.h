@@ -11,8 +11,13 @@
 PLUGIN(NAME("nmc", "Near Memory Computing Command Set", NVME_VERSION),
        COMMAND_LIST(
 		ENTRY("inference", "Inference the specified TIFF image.", inference)
+		ENTRY("inference-batch", "Inference many files with pipelined inference and result reads.", inference_batch)
 		ENTRY("write-model", "Write an onnx model with the predefined placement strategy.", write_model)
 		ENTRY("write-tiff", "Write a TIFF image with a predefined placement policy. (w/ libtiff)", write_tiff)
+		ENTRY("write-and-infer", "Upload a queue of TIFF images, inferring each one while the next uploads.", write_and_infer)
+		ENTRY("bench", "Sweep upload and inference throughput/latency on synthetic images and model.", bench)
+		ENTRY("audit", "Audit an upload against the per-page CRC-32C of its manifest.", audit)
+		ENTRY("serve", "Keep the device open and run upload/inference jobs from a unix socket.", serve)
 
 		ENTRY("inference-read", "", inference_read)
 		ENTRY("monitor-nmc-mapping", "", monitor_nmc_mapping)
@@ -0,0 +1,74 @@
+#include "./crc32c.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+#define CRC32C_POLY 0x82F63B78 // reflected
+
+static uint32_t crc32cTable[256];
+static bool crc32cHw;
+
+__attribute__((constructor)) static void crc32c_init(void)
+{
+    for (uint32_t iByte = 0; iByte < 256; ++iByte)
+    {
+        uint32_t crc = iByte;
+        for (int iBit = 0; iBit < 8; ++iBit)
+            crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+        crc32cTable[iByte] = crc;
+    }
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    crc32cHw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len--)
+        crc = (crc >> 8) ^ crc32cTable[(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint64_t crc64 = crc;
+    for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t), p += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    crc = (uint32_t)crc64;
+    while (len--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Continue a CRC-32C over `buf` (no pre/post inversion, see crc32c())
+ */
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t len)
+{
+#if defined(__x86_64__)
+    if (crc32cHw)
+        return crc32c_hw(crc, buf, len);
+#endif
+    return crc32c_sw(crc, buf, len);
+}
@@ -0,0 +1,17 @@
+#ifndef __NMC_HOST_PLUGIN_CRC32C_H__
+#define __NMC_HOST_PLUGIN_CRC32C_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-32C (Castagnoli), the SSE4.2 crc32 instruction is used when the CPU
+// supports it, otherwise a table-driven fallback. crc32c("123456789") = 0xE3069283.
+
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t len);
+
+static inline uint32_t crc32c(const void *buf, size_t len)
+{
+    return ~crc32c_update(~0U, buf, len);
+}
+
+#endif /* __NMC_HOST_PLUGIN_CRC32C_H__ */
@@ -1,6 +1,11 @@
 #include "nvme.h"
 
 #include "./nvme_nmc.h"
+#include "./nvme_nmc_uring.h"
+#include "./nvme_nmc_backend.h"
+#include "./nvme_nmc_verify.h"
+#include "./nvme_nmc_bufpool.h"
+#include "./nvme_nmc_stats.h"
 #include "./debug.h"
 
 // #define NMC_SHORT_FILENAME true
@@ -13,12 +18,117 @@ static inline int nmc_send_io_passthru(nmc_config_t config)
 {
     return nmc_send_passthru(true, config);
 }
-static void nmc_verify(nmc_config_t config);
+static int nmc_packet_config(nmc_config_t *config, nmc_config_t *cfg, const uint8_t *buf,
+                             uint32_t sz, const uint32_t *crcs);
+
+typedef struct
+{
+    nmc_done_fn done;
+    void *arg;
+    struct nmc_verify *verify;
+    uint64_t slba;
+    uint32_t npackets;
+} nmc_verify_ctx_t;
+
+static void nmc_verify_done(void *data, int err, uint32_t result, void *arg)
+{
+    nmc_verify_ctx_t ctx = *(nmc_verify_ctx_t *)arg;
+    free(arg);
+
+    if (!err)
+        nmc_verify_packets(ctx.verify, ctx.slba, data, ctx.npackets);
+    if (ctx.done)
+        ctx.done(data, err, result, ctx.arg);
+}
 
 /* -------------------------------------------------------------------------- */
 /*                              public interfaces                             */
 /* -------------------------------------------------------------------------- */
 
+/**
+ * @brief Attach an io_uring submission engine to the config if qdepth > 1
+ *
+ * The engine works on the NVMe generic char device (/dev/ngXnY) of the opened
+ * namespace, since the block device does not support IORING_OP_URING_CMD.
+ * With `fixedBufs`, the buffer pool (initialized beforehand) is registered.
+ */
+int nmc_async_open(nmc_config_t *config, uint32_t qdepth, bool fixedBufs)
+{
+    config->uring = NULL;
+    if (qdepth <= 1 || config->dry)
+        return 0;
+
+    // the emulated backends complete synchronously
+    if (config->backend && !config->backend->is_device)
+        return 0;
+
+    // nvme0n1 -> /dev/ng0n1, ng0n1 -> /dev/ng0n1
+    char ngdev[64];
+    const char *name = config->dev->name;
+    if (!strncmp(name, "nvme", 4))
+        snprintf(ngdev, sizeof(ngdev), "/dev/ng%s", name + 4);
+    else
+        snprintf(ngdev, sizeof(ngdev), "/dev/%s", name);
+
+    config->uring = nmc_uring_open(ngdev, qdepth);
+    assert_return(config->uring, -ENODEV, "Failed to setup io_uring on '%s'", ngdev);
+
+    // optional, the commands still work on unregistered buffers
+    if (fixedBufs && nmc_uring_register_buffers(config->uring))
+        pr_info("io_uring: continue without fixed buffers");
+    return 0;
+}
+
+int nmc_async_close(nmc_config_t *config)
+{
+    int err = 0;
+    if (config->uring)
+    {
+        err = nmc_uring_drain(config->uring);
+        nmc_uring_close(config->uring);
+        config->uring = NULL;
+    }
+    return err;
+}
+
+/**
+ * @brief Get the max number of packets that can be carried by a single command
+ *
+ * The bound comes from MDTS of Identify Controller (assume CAP.MPSMIN = 4 KiB),
+ * the max_hw_sectors of the namespace block queue, and the 16-bit NLB field.
+ */
+uint32_t nmc_max_packets_per_cmd(nmc_config_t config)
+{
+    uint64_t maxBytes = (uint64_t)NMC_MAX_BLKS_PER_CMD * BYTES_NVME_BLOCK;
+
+    if (config.dry || (config.backend && !config.backend->is_device))
+        return maxBytes / BYTES_PACKET;
+
+    struct nvme_id_ctrl ctrl;
+    int err = nvme_identify_ctrl(dev_fd(config.dev), &ctrl);
+    assert_return(!err, 1, "Identify Controller failed (%d), fallback to 1 packet/cmd", err);
+
+    if (ctrl.mdts && ((uint64_t)BYTES_NVME_BLOCK << ctrl.mdts) < maxBytes) // 0 means no limit
+        maxBytes = (uint64_t)BYTES_NVME_BLOCK << ctrl.mdts;
+
+    // passthru requests are not split by the kernel, they should fit the queue limit
+    char path[128];
+    unsigned long kbHwSectors = 0;
+    snprintf(path, sizeof(path), "/sys/block/%s/queue/max_hw_sectors_kb", config.dev->name);
+
+    FILE *f = fopen(path, "r");
+    if (f)
+    {
+        if (fscanf(f, "%lu", &kbHwSectors) == 1 && kbHwSectors && kbHwSectors * 1024 < maxBytes)
+            maxBytes = (uint64_t)kbHwSectors * 1024;
+        fclose(f);
+    }
+
+    pr_info("Max transfer size: %lu bytes (MDTS=%u, max_hw_sectors_kb=%lu)", maxBytes, ctrl.mdts,
+            kbHwSectors);
+    return (maxBytes < BYTES_PACKET) ? 1 : maxBytes / BYTES_PACKET;
+}
+
 int nmc_new_mapping(nmc_config_t config, uint32_t filetype, uint32_t nblks)
 {
     int err;
@@ -32,7 +142,7 @@ int nmc_new_mapping(nmc_config_t config, uint32_t filetype, uint32_t nblks)
 #else
     // #pragma GCC error "The option for long filename needs to be fixed"
     dsize = NMC_FILENAME_MAX_BYTES;
-    dptr  = aligned_alloc(getpagesize(), dsize);
+    dptr  = nmc_buf_alloc(dsize);
     strncpy(dptr, config.data_file, dsize);
     pr_info("NMC_LONG_FILENAME: '%s' -> '%s'", config.data_file, (char *)dptr);
 #endif
@@ -47,47 +157,165 @@ int nmc_new_mapping(nmc_config_t config, uint32_t filetype, uint32_t nblks)
     err = nmc_send_io_passthru(config);
 
 #if (NMC_SHORT_FILENAME == false)
-    free(dptr);
+    nmc_buf_free(dptr);
 #endif
     return err;
 }
 
 int nmc_close_mapping(nmc_config_t config)
 {
+    // all in-flight packets must be completed before closing the mapping table
+    if (config.uring)
+    {
+        int err = nmc_uring_drain(config.uring);
+        assert_return(!err, err, "Some packets failed before closing the mapping table");
+    }
+
     // implicitly flush the buffered data to ensure all data are persisted
     config.OPCODE = IO_NVM_NMC_FLUSH;
     return nmc_send_io_passthru(config);
 }
 
-int nmc_flush_packet(nmc_config_t *config, const uint8_t *buf, uint32_t sz)
+/**
+ * @brief Send packets synchronously
+ *
+ * @param crcs Per-page CRC-32C sent as metadata (sz / BYTES_PER_PAGE entries), NULL for none
+ */
+int nmc_flush_packet(nmc_config_t *config, const uint8_t *buf, uint32_t sz, const uint32_t *crcs)
 {
-    // create new config and inherit from global config
-    nmc_config_t cfg = *config;
+    nmc_config_t cfg;
+    int res = nmc_packet_config(config, &cfg, buf, sz, crcs);
+    assert_return(!res, res, "Invalid packet command (%u bytes)", sz);
 
-    // set data address, number
-    cfg.OPCODE   = IO_NVM_NMC_WRITE;
-    cfg.data     = buf;
-    cfg.data_len = sz;
-    cfg.nlb      = (sz + (BYTES_NVME_BLOCK - 1)) / BYTES_NVME_BLOCK;
+    res = nmc_send_io_passthru(cfg);
 
-    config->slba += cfg.nlb;
-    --cfg.nlb; /* nlb is zero-based */
+    if (!res && config->verify)
+        nmc_verify_packets(config->verify, cfg.slba, buf, sz / BYTES_PACKET);
 
-    // TODO: may need some additional info for physical placement
+    return res;
+}
+
+/**
+ * @brief Send a packet without waiting for its completion (if async engine attached)
+ *
+ * The buffer is owned by the engine until `done` is called, the caller should
+ * not reuse it before that. Without engine, the packet is sent synchronously
+ * and `done` is called before returning, as it is on any error.
+ */
+int nmc_flush_packet_async(nmc_config_t *config, uint8_t *buf, uint32_t sz, const uint32_t *crcs,
+                           nmc_done_fn done, void *arg)
+{
+    if (!config->uring)
+    {
+        int res = nmc_flush_packet(config, buf, sz, crcs);
+        if (done)
+            done(buf, res, 0, arg);
+        return res;
+    }
 
-    int res = nmc_send_io_passthru(cfg);
+    nmc_config_t cfg;
+    int err = nmc_packet_config(config, &cfg, buf, sz, crcs);
+    assert_goto(!err, failed, "Invalid packet command (%u bytes)", sz);
 
-#if (NMC_FLUSH_VERIFY == true)
-    if (!config->dry)
-        nmc_verify(cfg);
-#endif
+    if (!config->verify)
+        return nmc_uring_submit(config->uring, true, &cfg, done, arg);
 
-    return res;
+    // sample the packets on completion, before the buffer is handed back
+    nmc_verify_ctx_t *ctx = malloc(sizeof(nmc_verify_ctx_t));
+    err                   = -ENOMEM;
+    assert_goto(ctx, failed, "Failed to allocate verify context");
+
+    *ctx = (nmc_verify_ctx_t){
+        .done     = done,
+        .arg      = arg,
+        .verify   = config->verify,
+        .slba     = cfg.slba,
+        .npackets = sz / BYTES_PACKET,
+    };
+    return nmc_uring_submit(config->uring, true, &cfg, nmc_verify_done, ctx);
+
+failed:
+    if (done)
+        done(buf, err, 0, arg);
+    return err;
 }
 
-int nmc_send_passthru(bool io_cmd, nmc_config_t config)
+/**
+ * @brief Submit an IO command, or send it synchronously and call `done` without engine
+ */
+static int nmc_submit(nmc_config_t *config, nmc_config_t *cfg, nmc_done_fn done, void *arg)
 {
-    int err = 0;
+    if (config->uring)
+        return nmc_uring_submit(config->uring, true, cfg, done, arg);
+
+    int err = nmc_passthru(true, cfg);
+    if (done)
+        done(cfg->data, err, cfg->result, arg);
+    return err;
+}
+
+/**
+ * @brief Start the inference of the uploaded file `name` (C3)
+ *
+ * `buf` (BYTES_NVME_BLOCK) carries the filename and is owned by the engine until
+ * `done`, whose result is the ticket of the inference (0 if not supported).
+ */
+int nmc_inference_async(nmc_config_t *config, uint8_t *buf, const char *name, nmc_done_fn done,
+                        void *arg)
+{
+    size_t len = strlen(name);
+    assert_goto(len < BYTES_NVME_BLOCK, failed, "filename too long...");
+
+    memset(buf, 0, BYTES_NVME_BLOCK);
+    memcpy(buf, name, len);
+
+    nmc_config_t cfg = *config;
+    cfg.OPCODE       = IO_NVM_NMC_INFERENCE;
+    cfg.PSDT         = 0; /* use PRP */
+    cfg.meta_addr    = (uintptr_t)NULL;
+    cfg.data         = (char *)buf;
+    cfg.data_len     = BYTES_NVME_BLOCK;
+    cfg.PRP1         = (uintptr_t)buf;
+    return nmc_submit(config, &cfg, done, arg);
+
+failed:
+    if (done)
+        done(buf, -EINVAL, 0, arg);
+    return -EINVAL;
+}
+
+/**
+ * @brief Read `sz` bytes at `offset` of the result of inference `ticket` (C8) into `buf`
+ *
+ * The result of `done` is the total length of the result (0 if not reported).
+ *
+ * @param ticket Returned by the C3 completion, NMC_INFERENCE_TICKET_LATEST for the last one
+ */
+int nmc_inference_read_async(nmc_config_t *config, uint8_t *buf, uint32_t sz, uint32_t ticket,
+                             uint64_t offset, nmc_done_fn done, void *arg)
+{
+    nmc_config_t cfg         = *config;
+    cfg.OPCODE               = IO_NVM_NMC_INFERENCE_READ;
+    cfg.PSDT                 = 0; /* use PRP */
+    cfg.meta_addr            = (uintptr_t)NULL;
+    cfg.data                 = (char *)buf;
+    cfg.data_len             = sz;
+    cfg.PRP1                 = (uintptr_t)buf;
+    cfg.nmc_inference_ticket = ticket;
+    cfg.nmc_result_offset    = offset;
+    cfg.nmc_result_len       = sz;
+    return nmc_submit(config, &cfg, done, arg);
+}
+
+int nmc_send_passthru(bool io_cmd, nmc_config_t config) { return nmc_passthru(io_cmd, &config); }
+
+/**
+ * @brief Send a command synchronously, `config->result` is updated with DW0 of the completion
+ */
+int nmc_passthru(bool io_cmd, nmc_config_t *cfg)
+{
+    int err             = 0;
+    nmc_config_t config = *cfg;
 
     if (config.dry)
     {
@@ -114,84 +342,87 @@ int nmc_send_passthru(bool io_cmd, nmc_config_t config)
     if (config.dry)
         return err;
 
-    if (io_cmd)
+    // the monitor commands do not open a backend, they always talk to the device
+    nmc_backend_t *be = config.backend ? config.backend : &nmc_backend_nvme;
+
+    // the verifier thread shares the backend with the writer
+    __atomic_fetch_add(&be->ncmds, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&be->nbytes, config.data_len, __ATOMIC_RELAXED);
+    uint64_t t0 = nmc_stats_now();
+    err         = be->passthru(be, io_cmd, &config);
+    nmc_stats_record(io_cmd, config.OPCODE, err, nmc_stats_now() - t0);
+
+    nmc_report_status(io_cmd, err, config.result);
+    cfg->result = config.result;
+    return err;
+}
+
+void nmc_report_status(bool io_cmd, int err, uint32_t result)
+{
+    if (!io_cmd)
     {
-        err = nvme_io_passthru(dev_fd(config.dev), config.OPCODE, config.flags, config.rsvd,
-                               config.NSID, config.cdw02, config.cdw03, config.cdw10, config.cdw11,
-                               config.cdw12, config.cdw13, config.cdw14, config.cdw15,
-                               config.data_len, config.data, config.metadata_len, config.metadata,
-                               config.timeout_ms, &config.result);
-        switch (err)
-        {
-        case NMC_SC_SUCCESS:
-        case 0: // success
-            break;
-        case NMC_SC_MAPPING_REOPENED:
-            pr_error("NMC Mapping Reopened");
-            break;
-        case NMC_SC_MAPPING_RECLOSED:
-            pr_error("NMC Mapping Reclosed");
-            break;
-        case NMC_SC_MAPPING_FILENAME_TOO_LONG:
-            pr_error("NMC Mapping Filename Too Long");
-            break;
-        case NMC_SC_MAPPING_FILENAME_UNSUPPORTED:
-            pr_error("NMC Mapping Filename Contains Unsupported Characters");
-            break;
-        case SC_VENDOR_NMC_MAPPING_REGISTER_INIT_FAILED:
-            pr_error("NMC Mapping Register Initialization Failed");
-            break;
-        case NMC_SC_MAPPING_DISABLED:
-            pr_error("NMC Mapping is Disabled");
-            break;
-        default:
-            pr_error("Request failed (err,res=%d,%u): %s", err, config.result, nvme_strerror(err));
-            break;
-        }
+        if (err)
+            pr_error("Request failed (err,res=%d,%u): %s", err, result, nvme_strerror(err));
+        return;
     }
-    else
+
+    switch (err)
     {
-        err = nvme_admin_passthru(dev_fd(config.dev), config.OPCODE, config.flags, config.rsvd,
-                                  config.NSID, config.cdw02, config.cdw03, config.cdw10,
-                                  config.cdw11, config.cdw12, config.cdw13, config.cdw14,
-                                  config.cdw15, config.data_len, config.data, config.metadata_len,
-                                  config.metadata, config.timeout_ms, &config.result);
-
-        switch (err)
-        {
-        case 0: // success
-            break;
-        default:
-            pr_error("Request failed (err,res=%d,%u): %s", err, config.result, nvme_strerror(err));
-            break;
-        }
+    case NMC_SC_SUCCESS:
+    case 0: // success
+        break;
+    case NMC_SC_MAPPING_REOPENED:
+        pr_error("NMC Mapping Reopened");
+        break;
+    case NMC_SC_MAPPING_RECLOSED:
+        pr_error("NMC Mapping Reclosed");
+        break;
+    case NMC_SC_MAPPING_FILENAME_TOO_LONG:
+        pr_error("NMC Mapping Filename Too Long");
+        break;
+    case NMC_SC_MAPPING_FILENAME_UNSUPPORTED:
+        pr_error("NMC Mapping Filename Contains Unsupported Characters");
+        break;
+    case SC_VENDOR_NMC_MAPPING_REGISTER_INIT_FAILED:
+        pr_error("NMC Mapping Register Initialization Failed");
+        break;
+    case NMC_SC_MAPPING_DISABLED:
+        pr_error("NMC Mapping is Disabled");
+        break;
+    default:
+        pr_error("Request failed (err,res=%d,%u): %s", err, result, nvme_strerror(err));
+        break;
     }
-
-    return err;
 }
 
 /* -------------------------------------------------------------------------- */
 /*                             internal utilities                             */
 /* -------------------------------------------------------------------------- */
 
-static void nmc_verify(nmc_config_t config)
+static int nmc_packet_config(nmc_config_t *config, nmc_config_t *cfg, const uint8_t *buf,
+                             uint32_t sz, const uint32_t *crcs)
 {
-    const char *origin = config.data;
+    // count the blocks before narrowing, 65536 blocks would truncate to nlb 0
+    uint32_t nblks = (sz + (BYTES_NVME_BLOCK - 1)) / BYTES_NVME_BLOCK;
+    assert_return(nblks && nblks <= NMC_MAX_BLKS_PER_CMD, -EINVAL,
+                  "%u blocks do not fit a command (1 to %u)", nblks, NMC_MAX_BLKS_PER_CMD);
+
+    // create new config and inherit from global config
+    *cfg = *config;
 
-    // alloc space for read command
-    config.OPCODE = 0x02;
-    config.data   = aligned_alloc(getpagesize(), BYTES_PACKET);
-    memset(config.data, 0, BYTES_PACKET);
+    // set data address, number
+    cfg->OPCODE   = IO_NVM_NMC_WRITE;
+    cfg->data     = (char *)buf;
+    cfg->data_len = sz;
+    cfg->nlb      = nblks - 1; /* nlb is zero-based */
 
-    // read the written data into new buffer
-    int err = nmc_send_io_passthru(config);
+    config->slba += nblks;
 
-    // compare with original data if the read operations succeeded
-    if (err)
-        pr("%s failed (%d): %s\n", __func__, err, nvme_strerror(err));
-    else
-        for (size_t iByte = 0; iByte < BYTES_PACKET; ++iByte)
-            assert_exit(origin[iByte] == config.data[iByte], "failed at %lu byte", iByte);
+    // one CRC-32C per flash page, checked by the device or audited later
+    cfg->metadata     = (char *)crcs;
+    cfg->metadata_len = crcs ? (sz / BYTES_PER_PAGE) * sizeof(uint32_t) : 0;
 
-    free(config.data);
-}
\ No newline at end of file
+    // TODO: may need some additional info for physical placement
+
+    return 0;
+}
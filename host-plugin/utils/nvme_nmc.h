@@ -5,6 +5,10 @@
 #include <stdbool.h>
 #include "flash_config.h"
 
+struct nmc_uring;
+struct nmc_backend;
+struct nmc_verify;
+
 typedef struct
 {
     // host info
@@ -16,6 +20,9 @@ typedef struct
         bool dry;
         char *data_file;
         struct nvme_dev *dev;
+        struct nmc_uring *uring;     // async submission engine, NULL for synchronous passthru
+        struct nmc_backend *backend; // transport backend, NULL for the opened nvme device
+        struct nmc_verify *verify;   // background read-back of written packets, NULL if off
 
         uint8_t flags;
         uint16_t rsvd;
@@ -93,7 +100,8 @@ typedef struct
                 };
                 uint32_t cdw11; // command specific
             };
-            uint64_t slba; // the starting LBA
+            uint64_t slba;              // the starting LBA
+            uint64_t nmc_result_offset; // byte offset into the inference result (C8)
         };
 
         union
@@ -104,12 +112,14 @@ typedef struct
                 uint16_t nlb; // number of logical blocks
                 uint16_t unused;
             };
+            uint32_t nmc_result_len; // bytes to read from the inference result (C8)
         };
 
         uint32_t cdw13; // command specific
         union
         {
             uint32_t nmc_new_mapping_filetype;
+            uint32_t nmc_inference_ticket;
             uint32_t cdw14; // command specific
         };
         union
@@ -144,6 +154,9 @@ typedef enum _NMC_STATUS_CODES
 
 #define NMC_FILENAME_MAX_BYTES 256
 
+// NLB (CDW12) is a zero-based 16-bit field, a command moves at most 65536 blocks
+#define NMC_MAX_BLKS_PER_CMD ((uint32_t)UINT16_MAX + 1)
+
 //       NMC  X X Packet X
 //         \   \ \   \  /   Wr Rd
 // bit: 7 | 6  5  4  3  2 | 1  0 |  hex  | description
@@ -158,14 +171,47 @@ typedef enum _NMC_STATUS_CODES
 #define IO_NVM_NMC_INFERENCE_READ 0xC8
 #define IO_NVM_NMC_WRITE     0xC9 // write packet (distribute to all FCs)
 
+#define IO_NVM_READ 0x02 // standard NVM read, used to read back written packets
+
+// Several inferences may be outstanding: the completion (DW0) of C3 returns a
+// ticket, and C8 selects the result of that ticket by CDW14. Firmware without
+// tickets keeps only the latest result and ignores CDW14, DW0 of its C3 is not
+// defined: a ticket is only trusted if the user says the firmware has them.
+//
+// A result larger than one transfer is read in chunks: C8 takes the byte offset
+// in CDW10-11 and the chunk length in CDW12, its completion (DW0) returns the
+// total length of the result. Firmware without chunking completes with 0 and
+// always returns the first NMC_RESULT_BYTES_LEGACY bytes.
+#define NMC_INFERENCE_TICKET_LATEST 0
+#define NMC_RESULT_BYTES_LEGACY     (BYTES_INF_RESULT * 4)
+
 /* -------------------------------------------------------------------------- */
 /*                              public interfaces                             */
 /* -------------------------------------------------------------------------- */
 
+// Completion of an asynchronous command (the *_async functions below): `done`
+// is called exactly once per call, also when the command fails before being
+// submitted (then synchronously, with the same error as the return value), so
+// the caller gets its buffer back on the callback only and never on the return.
+typedef void (*nmc_done_fn)(void *data, int err, uint32_t result, void *arg);
+
+int nmc_async_open(nmc_config_t *config, uint32_t qdepth, bool fixedBufs);
+int nmc_async_close(nmc_config_t *config);
+uint32_t nmc_max_packets_per_cmd(nmc_config_t config);
+
 int nmc_new_mapping(nmc_config_t config, uint32_t filetype, uint32_t nblks);
 int nmc_close_mapping(nmc_config_t config);
-int nmc_flush_packet(nmc_config_t *config, const uint8_t *buf, uint32_t sz);
+int nmc_flush_packet(nmc_config_t *config, const uint8_t *buf, uint32_t sz, const uint32_t *crcs);
+int nmc_flush_packet_async(nmc_config_t *config, uint8_t *buf, uint32_t sz, const uint32_t *crcs,
+                           nmc_done_fn done, void *arg);
+
+int nmc_inference_async(nmc_config_t *config, uint8_t *buf, const char *name, nmc_done_fn done,
+                        void *arg);
+int nmc_inference_read_async(nmc_config_t *config, uint8_t *buf, uint32_t sz, uint32_t ticket,
+                             uint64_t offset, nmc_done_fn done, void *arg);
 
 int nmc_send_passthru(bool io_cmd, nmc_config_t config);
+int nmc_passthru(bool io_cmd, nmc_config_t *config);
+void nmc_report_status(bool io_cmd, int err, uint32_t result);
 
 #endif /* __NMC_HOST_PLUGIN_NVME_NMC_H__ */
\ No newline at end of file
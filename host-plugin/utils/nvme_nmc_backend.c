@@ -0,0 +1,152 @@
+#include "nvme.h"
+
+#include <fcntl.h>
+
+#include "./nvme_nmc_backend.h"
+#include "./nvme_nmc_emu.h"
+#include "./nvme_nmc_sim.h"
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                nvme backend                                */
+/* -------------------------------------------------------------------------- */
+
+static int nmc_backend_nvme_passthru(nmc_backend_t *be, bool io_cmd, nmc_config_t *config)
+{
+    if (io_cmd)
+        return nvme_io_passthru(dev_fd(config->dev), config->OPCODE, config->flags, config->rsvd,
+                                config->NSID, config->cdw02, config->cdw03, config->cdw10,
+                                config->cdw11, config->cdw12, config->cdw13, config->cdw14,
+                                config->cdw15, config->data_len, config->data,
+                                config->metadata_len, config->metadata, config->timeout_ms,
+                                &config->result);
+    else
+        return nvme_admin_passthru(dev_fd(config->dev), config->OPCODE, config->flags, config->rsvd,
+                                   config->NSID, config->cdw02, config->cdw03, config->cdw10,
+                                   config->cdw11, config->cdw12, config->cdw13, config->cdw14,
+                                   config->cdw15, config->data_len, config->data,
+                                   config->metadata_len, config->metadata, config->timeout_ms,
+                                   &config->result);
+}
+
+nmc_backend_t nmc_backend_nvme = {
+    .name      = "nvme",
+    .is_device = true,
+    .readable  = true,
+    .passthru  = nmc_backend_nvme_passthru,
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                null backend                                */
+/* -------------------------------------------------------------------------- */
+
+static int nmc_backend_null_passthru(nmc_backend_t *be, bool io_cmd, nmc_config_t *config)
+{
+    // nothing is returned by the sink, read commands get zeros
+    if (config->OPCODE != IO_NVM_NMC_WRITE && config->OPCODE != IO_NVM_NMC_ALLOC && config->data)
+        memset(config->data, 0, config->data_len);
+
+    config->result = 0;
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                file backend                                */
+/* -------------------------------------------------------------------------- */
+
+static int nmc_backend_file_passthru(nmc_backend_t *be, bool io_cmd, nmc_config_t *config)
+{
+    int fd = (int)(intptr_t)be->priv;
+
+    off_t off = (off_t)config->slba * BYTES_NVME_BLOCK;
+
+    if (io_cmd && config->OPCODE == IO_NVM_NMC_WRITE)
+    {
+        if (pwrite(fd, config->data, config->data_len, off) != (ssize_t)config->data_len)
+            return -errno;
+    }
+    else if (io_cmd && config->OPCODE == IO_NVM_READ)
+    {
+        if (pread(fd, config->data, config->data_len, off) != (ssize_t)config->data_len)
+            return -EIO;
+
+        config->result = 0;
+        return 0;
+    }
+
+    return nmc_backend_null_passthru(be, io_cmd, config);
+}
+
+static void nmc_backend_file_close(nmc_backend_t *be) { close((int)(intptr_t)be->priv); }
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Attach the transport backend described by `spec` to the config
+ *
+ * @param spec "nvme", "null", "file:PATH", "emu:PATH" or "sim[:PARAMS]" (NULL for the default)
+ */
+int nmc_backend_open(nmc_config_t *config, const char *spec)
+{
+    if (!spec)
+        spec = NMC_BACKEND_SPEC_DEFAULT;
+
+    nmc_backend_t *be = calloc(1, sizeof(nmc_backend_t));
+    assert_return(be, -ENOMEM, "Failed to allocate backend");
+
+    if (!strcmp(spec, "nvme"))
+        *be = nmc_backend_nvme;
+    else if (!strcmp(spec, "null"))
+    {
+        be->name     = "null";
+        be->passthru = nmc_backend_null_passthru;
+    }
+    else if (!strncmp(spec, "file:", 5))
+    {
+        int fd = open(spec + 5, O_RDWR | O_CREAT, 0644);
+        assert_goto(fd >= 0, failed, "Failed to open '%s' (%s)", spec + 5, strerror(errno));
+
+        be->name     = "file";
+        be->readable = true;
+        be->passthru = nmc_backend_file_passthru;
+        be->close    = nmc_backend_file_close;
+        be->priv     = (void *)(intptr_t)fd;
+    }
+    else if (!strncmp(spec, "emu:", 4))
+    {
+        int err = nmc_backend_emu_init(be, spec + 4);
+        assert_goto(!err, failed, "Failed to setup emulator '%s'", spec + 4);
+    }
+    else if (!strncmp(spec, "sim", 3) && (spec[3] == '\0' || spec[3] == ':'))
+    {
+        int err = nmc_backend_sim_init(be, spec[3] ? spec + 4 : NULL);
+        assert_goto(!err, failed, "Failed to setup simulator '%s'", spec);
+    }
+    else
+        assert_goto(0, failed, "Unknown backend '%s'", spec);
+
+    config->backend = be;
+    return 0;
+
+failed:
+    free(be);
+    return -EINVAL;
+}
+
+void nmc_backend_close(nmc_config_t *config)
+{
+    nmc_backend_t *be = config->backend;
+    if (!be)
+        return;
+
+    if (!be->is_device)
+        pr_info("backend '%s': %lu commands, %lu bytes", be->name, be->ncmds, be->nbytes);
+
+    if (be->close)
+        be->close(be);
+
+    free(be);
+    config->backend = NULL;
+}
@@ -0,0 +1,48 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_BACKEND_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_BACKEND_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nvme_nmc.h"
+
+// Transport backends behind nmc_send_passthru()
+//
+//   nvme       : the real device opened by parse_and_open() (default)
+//   null       : drop every command, only count commands and bytes
+//   file:PATH  : store IO_NVM_NMC_WRITE payloads into PATH at (slba * 4 KiB)
+//   emu:PATH   : emulate the NMC device with its state in PATH (nvme_nmc_emu.h)
+//   sim[:ARGS] : predict flash upload/inference-read time (nvme_nmc_sim.h)
+//
+// The non-device backends allow measuring the host side (parse, placement) of
+// write-tiff/write-model without an OpenSSD, pass any char device (/dev/null)
+// as the positional device to satisfy parse_and_open().
+
+#define NMC_BACKEND_SPEC_DEFAULT "nvme"
+#define NMC_BACKEND_OPT(ptr)     OPT_STR("backend", 'b', ptr, "transport: nvme, null, file:PATH, emu:PATH, sim[:ARGS]")
+
+typedef struct nmc_backend nmc_backend_t;
+
+struct nmc_backend
+{
+    const char *name;
+    bool is_device; // commands go to the real device (io_uring capable)
+    bool readable;  // serves NVMe reads of the written packets (verify)
+
+    int (*passthru)(nmc_backend_t *be, bool io_cmd, nmc_config_t *config);
+    void (*close)(nmc_backend_t *be);
+
+    uint64_t ncmds;
+    uint64_t nbytes;
+    void *priv;
+};
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+extern nmc_backend_t nmc_backend_nvme;
+
+int nmc_backend_open(nmc_config_t *config, const char *spec);
+void nmc_backend_close(nmc_config_t *config);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_BACKEND_H__ */
@@ -0,0 +1,226 @@
+#include "./nvme_nmc_batch.h"
+
+#include <limits.h>
+#include <libgen.h>
+
+#include "./nvme_nmc_bufpool.h"
+#include "./nvme_nmc_result.h"
+#include "./nvme_nmc_stats.h"
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    BATCH_PENDING,
+    BATCH_INFER,     // C3 in flight
+    BATCH_INFERRED,  // C3 completed, ticket known
+    BATCH_READ,      // C8 in flight
+    BATCH_READ_DONE, // C8 completed
+    BATCH_DONE,
+} batch_state_t;
+
+typedef struct
+{
+    const char *name;
+    batch_state_t state;
+    int err;
+    uint32_t ticket;
+    uint32_t resultLen;
+    uint8_t *buf;
+    uint64_t tStart;
+} batch_job_t;
+
+static void batch_inference_done(void *data, int err, uint32_t result, void *arg)
+{
+    batch_job_t *job = arg;
+    job->err         = err;
+    job->ticket      = result;
+    job->state       = BATCH_INFERRED;
+}
+
+static void batch_read_done(void *data, int err, uint32_t result, void *arg)
+{
+    batch_job_t *job = arg;
+    job->err         = err;
+    job->resultLen   = result;
+    job->state       = BATCH_READ_DONE;
+}
+
+static int batch_write_result(nmc_config_t *config, const batch_job_t *job, const char *outDir)
+{
+    // the name may be a host path, keep only its last component
+    char *name = strdup(job->name);
+    assert_return(name, -ENOMEM, "Failed to allocate output name");
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s.inf", outDir, basename(name));
+    free(name);
+
+    // stream the rest of a large result, the first chunk is read again
+    if (job->resultLen > NMC_RESULT_BYTES_LEGACY)
+        return nmc_result_read(config, job->ticket, path, 0, NULL);
+
+    // firmware reporting no length fills the whole buffer
+    uint32_t len = job->resultLen ? job->resultLen : NMC_RESULT_BYTES_LEGACY;
+
+    FILE *f = fopen(path, "w");
+    assert_return(f, -errno, "Failed to create '%s' (%s)", path, strerror(errno));
+
+    int err = (fwrite(job->buf, 1, len, f) == len) ? 0 : -EIO;
+    if (fclose(f) && !err)
+        err = -errno;
+    return err;
+}
+
+static void batch_finish(nmc_config_t *config, batch_job_t *job, const char *outDir)
+{
+    if (!job->err && outDir)
+        job->err = batch_write_result(config, job, outDir);
+
+    nmc_buf_free(job->buf);
+    job->buf   = NULL;
+    job->state = BATCH_DONE;
+
+    double us = (nmc_stats_now() - job->tStart) / 1e3;
+    if (job->err)
+        pr_error("%s: failed (%d)", job->name, job->err);
+    else
+        pr_info("%s: ticket %u, %.1f us", job->name, job->ticket, us);
+}
+
+/**
+ * @brief Advance a job whose command completed, return true if anything was done
+ */
+static bool batch_advance(nmc_config_t *config, batch_job_t *job, const char *outDir)
+{
+    switch (job->state)
+    {
+    case BATCH_INFERRED:
+        nmc_buf_free(job->buf);
+        job->buf = NULL;
+        if (job->err)
+        {
+            batch_finish(config, job, outDir);
+            return true;
+        }
+
+        job->buf = nmc_buf_alloc(NMC_RESULT_BYTES_LEGACY);
+        if (!job->buf)
+        {
+            job->err = -ENOMEM;
+            batch_finish(config, job, outDir);
+            return true;
+        }
+
+        job->state = BATCH_READ;
+        nmc_inference_read_async(config, job->buf, NMC_RESULT_BYTES_LEGACY, job->ticket, 0,
+                                 batch_read_done, job);
+        return true;
+
+    case BATCH_READ_DONE:
+        batch_finish(config, job, outDir);
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static void batch_start(nmc_config_t *config, batch_job_t *job)
+{
+    job->tStart = nmc_stats_now();
+    job->buf    = nmc_buf_alloc(BYTES_NVME_BLOCK);
+    if (!job->buf)
+    {
+        batch_inference_done(NULL, -ENOMEM, 0, job);
+        return;
+    }
+
+    job->state = BATCH_INFER;
+    nmc_inference_async(config, job->buf, job->name, batch_inference_done, job);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Run inference on every file of `names` and write the results into `outDir` (if not NULL)
+ *
+ * Commands are pipelined on the io_uring engine of `config` (nmc_async_open),
+ * without engine they complete in order but still go through the same steps.
+ *
+ * @param tickets The firmware hands out inference tickets, otherwise run one at a time
+ * @return 0 if all succeeded, otherwise -EIO
+ */
+int nmc_batch_inference(nmc_config_t *config, char **names, size_t nnames, uint32_t window,
+                        bool tickets, const char *outDir)
+{
+    assert_return(window > 0 && window <= NMC_BATCH_WINDOW_MAX, -EINVAL, "Invalid window %u", window);
+
+    batch_job_t *jobs = calloc(nnames, sizeof(batch_job_t));
+    assert_return(jobs, -ENOMEM, "Failed to allocate batch jobs");
+    for (size_t iJob = 0; iJob < nnames; ++iJob)
+        jobs[iJob].name = names[iJob];
+
+    // one inference until the first C3 confirms the firmware hands out tickets
+    uint32_t limit  = 1;
+    bool probed     = !tickets;
+    size_t first    = 0; // oldest job not done
+    size_t next     = 0; // next job to start
+    uint64_t tStart = nmc_stats_now();
+
+    if (!tickets && window > 1)
+        pr_info("batch: window %u needs firmware with inference tickets (--tickets), run one at a time",
+                window);
+
+    while (first < nnames)
+    {
+        bool progress = false;
+        for (size_t iJob = first; iJob < next; ++iJob)
+        {
+            batch_job_t *job = &jobs[iJob];
+
+            // DW0 of legacy firmware is not a ticket, read whatever result is the latest
+            if (job->state == BATCH_INFERRED && !tickets)
+                job->ticket = NMC_INFERENCE_TICKET_LATEST;
+
+            if (job->state == BATCH_INFERRED && !job->err && !probed)
+            {
+                // nothing overlaps without engine, keep the results from being overwritten
+                probed = true;
+                limit  = (job->ticket && config->uring) ? window : 1;
+                if (!job->ticket && window > 1)
+                    pr_info("batch: inference tickets not supported, run one at a time");
+            }
+            progress |= batch_advance(config, job, outDir);
+        }
+
+        while (first < nnames && jobs[first].state == BATCH_DONE)
+            first += 1;
+
+        for (; next < nnames && next - first < limit; ++next, progress = true)
+            batch_start(config, &jobs[next]);
+
+        // wait for a completion, without engine every command has completed already
+        if (!progress && config->uring)
+            nmc_uring_reap(config->uring, true);
+        else if (!progress)
+            assert_goto(first == nnames, stalled, "Batch stalled at job %zu", first);
+    }
+
+stalled:;
+    double sec     = (nmc_stats_now() - tStart) / 1e9;
+    size_t nfailed = 0;
+    for (size_t iJob = 0; iJob < nnames; ++iJob)
+        nfailed += (jobs[iJob].err || jobs[iJob].state != BATCH_DONE);
+
+    pr_info("batch: %zu files, %zu failed, %.3f s (%.1f files/s, window %u)", nnames, nfailed, sec,
+            sec > 0 ? nnames / sec : 0, limit);
+
+    free(jobs);
+    return nfailed ? -EIO : 0;
+}
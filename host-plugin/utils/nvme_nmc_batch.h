@@ -0,0 +1,37 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_BATCH_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_BATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "nvme_nmc.h"
+#include "nvme_nmc_uring.h"
+
+// Batch inference over many uploaded files
+//
+//   names ---> C3 (window outstanding) ---> ticket ---> C8 (cdw14 = ticket) ---> <outDir>/<name>.inf
+//
+// By default one inference runs at a time and C8 reads the latest result, which
+// any firmware supports. With `tickets`, the firmware is trusted to follow the
+// ticket contract of nvme_nmc.h (C3 returns a nonzero ticket in DW0, C8 selects
+// its result by CDW14): up to `window` inferences run on the device at once,
+// the result of each one is read back as soon as its C3 completes. Legacy
+// firmware may complete C3 with any DW0 and ignore CDW14, so tickets cannot be
+// detected and results would be paired with the wrong files; a C3 completing
+// with 0 still falls back to one at a time. The window should not exceed the
+// number of results the device keeps.
+
+#define NMC_BATCH_WINDOW_DEFAULT 4
+#define NMC_BATCH_WINDOW_MAX     NMC_URING_QDEPTH_MAX
+
+#define NMC_BATCH_TICKETS_OPT(ptr)                                                               \
+    OPT_FLAG("tickets", 'T', ptr, "firmware returns inference tickets (C3 DW0, C8 CDW14), run a window")
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+int nmc_batch_inference(nmc_config_t *config, char **names, size_t nnames, uint32_t window,
+                        bool tickets, const char *outDir);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_BATCH_H__ */
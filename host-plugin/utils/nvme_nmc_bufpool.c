@@ -0,0 +1,203 @@
+#include "./nvme_nmc_bufpool.h"
+
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+#define NMC_BUFPOOL_MAX_IOVECS 64
+
+static struct
+{
+    pthread_mutex_t lock;
+
+    uint8_t *base;
+    size_t bytes;
+    bool hugetlb;
+
+    uint64_t *used;   // one bit per granule
+    uint32_t *nunits; // number of granules of the allocation starting at a granule
+    size_t ngranules;
+
+    uint64_t nfallbacks;
+
+    struct iovec iovecs[NMC_BUFPOOL_MAX_IOVECS];
+    int niovecs;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static inline bool granule_used(size_t i) { return pool.used[i / 64] & (1ULL << (i % 64)); }
+
+static inline void granule_set(size_t i, size_t n, bool used)
+{
+    for (; n--; ++i)
+        if (used)
+            pool.used[i / 64] |= 1ULL << (i % 64);
+        else
+            pool.used[i / 64] &= ~(1ULL << (i % 64));
+}
+
+static size_t granule_find(size_t n)
+{
+    for (size_t i = 0, run = 0; i < pool.ngranules; ++i)
+    {
+        // skip a fully used word at once
+        if (!run && i % 64 == 0 && pool.used[i / 64] == ~0ULL)
+        {
+            i += 63;
+            continue;
+        }
+
+        run = granule_used(i) ? 0 : run + 1;
+        if (run == n)
+            return i + 1 - n;
+    }
+    return SIZE_MAX;
+}
+
+static void *nmc_bufpool_map(size_t bytes, bool *hugetlb)
+{
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+
+    void *base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+    *hugetlb   = (base != MAP_FAILED);
+    if (*hugetlb)
+        return base;
+
+    // no hugetlbfs pages reserved, ask for transparent hugepages instead
+    base = mmap(NULL, bytes + NMC_BUFPOOL_HUGEPAGE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    // trim to a hugepage aligned range, so that THP can back it entirely
+    uint8_t *aligned = (uint8_t *)(((uintptr_t)base + NMC_BUFPOOL_HUGEPAGE - 1) &
+                                   ~(NMC_BUFPOOL_HUGEPAGE - 1));
+    if (aligned != (uint8_t *)base)
+        munmap(base, aligned - (uint8_t *)base);
+    munmap(aligned + bytes, NMC_BUFPOOL_HUGEPAGE - (aligned - (uint8_t *)base));
+
+    madvise(aligned, bytes, MADV_HUGEPAGE);
+    return aligned;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Map and pin the arena (once per process, later calls are no-ops)
+ *
+ * @param bytes Size of the arena, rounded up to hugepages
+ */
+int nmc_bufpool_init(size_t bytes)
+{
+    int err = 0;
+    pthread_mutex_lock(&pool.lock);
+    if (pool.base)
+        goto out;
+
+    bytes     = (bytes + NMC_BUFPOOL_HUGEPAGE - 1) & ~(NMC_BUFPOOL_HUGEPAGE - 1);
+    pool.base = nmc_bufpool_map(bytes, &pool.hugetlb);
+    if (!pool.base)
+    {
+        pr_error("Failed to map buffer pool of %zu bytes (%s)", bytes, strerror(errno));
+        err = -ENOMEM;
+        goto out;
+    }
+
+    // pin (and fault in) the pages, hugetlbfs pages are never swapped, THP ones may be
+    if (mlock(pool.base, bytes))
+        pr_info("bufpool: mlock failed (%s), buffers are not pinned", strerror(errno));
+
+    pool.bytes     = bytes;
+    pool.ngranules = bytes / NMC_BUFPOOL_GRANULE;
+    pool.used      = calloc((pool.ngranules + 63) / 64, sizeof(uint64_t));
+    pool.nunits    = calloc(pool.ngranules, sizeof(uint32_t));
+    assert_exit(pool.used && pool.nunits, "Failed to allocate buffer pool bitmap");
+
+    for (size_t off = 0; off < bytes && pool.niovecs < NMC_BUFPOOL_MAX_IOVECS;
+         off += NMC_BUFPOOL_MAX_IOVEC)
+    {
+        size_t len = bytes - off;
+        pool.iovecs[pool.niovecs++] =
+            (struct iovec){pool.base + off, (len < NMC_BUFPOOL_MAX_IOVEC) ? len : NMC_BUFPOOL_MAX_IOVEC};
+    }
+
+    pr_info("bufpool: %zu MiB (%s)", bytes >> 20, pool.hugetlb ? "hugetlb" : "thp");
+
+out:
+    pthread_mutex_unlock(&pool.lock);
+    return err;
+}
+
+/**
+ * @brief The arena as io_uring fixed buffers, returns the number of iovecs
+ */
+int nmc_bufpool_iovecs(const struct iovec **iov)
+{
+    *iov = pool.iovecs;
+    return pool.niovecs;
+}
+
+/**
+ * @brief Find the registered buffer index of [buf, buf + len), false if not in the arena
+ */
+bool nmc_bufpool_lookup(const void *buf, size_t len, uint16_t *index)
+{
+    for (int iVec = 0; iVec < pool.niovecs; ++iVec)
+    {
+        uint8_t *base = pool.iovecs[iVec].iov_base;
+        if ((uint8_t *)buf >= base && (uint8_t *)buf + len <= base + pool.iovecs[iVec].iov_len)
+        {
+            *index = iVec;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Carve a buffer from the arena, or aligned_alloc if it is not initialized or full
+ */
+void *nmc_buf_alloc(size_t bytes)
+{
+    size_t n  = bytes ? (bytes + NMC_BUFPOOL_GRANULE - 1) / NMC_BUFPOOL_GRANULE : 1;
+    void *buf = NULL;
+
+    pthread_mutex_lock(&pool.lock);
+    size_t idx = pool.base ? granule_find(n) : SIZE_MAX;
+    if (idx != SIZE_MAX)
+    {
+        granule_set(idx, n, true);
+        pool.nunits[idx] = n;
+        buf              = pool.base + idx * NMC_BUFPOOL_GRANULE;
+    }
+    else if (pool.base && pool.nfallbacks++ == 0)
+        pr_info("bufpool: exhausted, falling back to aligned_alloc");
+    pthread_mutex_unlock(&pool.lock);
+
+    return buf ? buf : aligned_alloc(getpagesize(), n * NMC_BUFPOOL_GRANULE);
+}
+
+void nmc_buf_free(void *buf)
+{
+    if (!buf)
+        return;
+
+    if ((uint8_t *)buf < pool.base || (uint8_t *)buf >= pool.base + pool.bytes)
+    {
+        free(buf);
+        return;
+    }
+
+    size_t idx = ((uint8_t *)buf - pool.base) / NMC_BUFPOOL_GRANULE;
+
+    pthread_mutex_lock(&pool.lock);
+    granule_set(idx, pool.nunits[idx], false);
+    pool.nunits[idx] = 0;
+    pthread_mutex_unlock(&pool.lock);
+}
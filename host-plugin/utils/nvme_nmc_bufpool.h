@@ -0,0 +1,40 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_BUFPOOL_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_BUFPOOL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+// Process-wide pool of pinned DMA buffers for NVMe commands
+//
+//   [ 2 MiB hugepage | 2 MiB hugepage | ... ]  one arena, mapped and pinned once
+//     ^ nmc_buf_alloc() carves page-aligned buffers (4 KiB granularity, first fit)
+//
+// The arena is backed by hugetlbfs pages when available (MAP_HUGETLB), or by
+// transparent hugepages otherwise, populated and locked up front so the upload
+// path takes neither page faults nor TLB misses on 4 KiB pages. The arena can
+// be registered as io_uring fixed buffers (nmc_bufpool_iovecs). A request the
+// pool cannot serve falls back to aligned_alloc, nmc_buf_free() handles both.
+//
+// Only the paths that keep buffers busy (upload sessions, serve, bench) set
+// the arena up with nmc_bufpool_init(). Until then nmc_buf_alloc() is plain
+// aligned_alloc, so one-shot commands (inference, monitor) never map and pin
+// an arena for a single 4 KiB buffer.
+
+#define NMC_BUFPOOL_HUGEPAGE      (2UL << 20)
+#define NMC_BUFPOOL_GRANULE       4096
+#define NMC_BUFPOOL_MAX_IOVEC     (1UL << 30) // io_uring limit per registered buffer
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+int nmc_bufpool_init(size_t bytes);
+int nmc_bufpool_iovecs(const struct iovec **iov);
+bool nmc_bufpool_lookup(const void *buf, size_t len, uint16_t *index);
+
+void *nmc_buf_alloc(size_t bytes);
+void nmc_buf_free(void *buf);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_BUFPOOL_H__ */
@@ -0,0 +1,547 @@
+#include "./nvme_nmc_cache.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+#define NMC_HASH_P1 11400714785074694791ULL
+#define NMC_HASH_P2 14029467366897019727ULL
+#define NMC_HASH_P3 1609587929392839161ULL
+#define NMC_HASH_P4 9650029242287828579ULL
+#define NMC_HASH_P5 2870177450012600261ULL
+
+#define NMC_CACHE_INDEX      "streams"
+#define NMC_CACHE_INDEX_SLACK 64 // stale records kept before the index is rewritten
+#define NMC_CACHE_HASH_CHUNK  (1 << 16)
+
+typedef struct
+{
+    uint32_t filetype;
+    uint64_t hash;
+    int64_t size;    // of the source file, 0 if unknown
+    int64_t mtimeNs; // of the source file, 0 if unknown
+    char *name;
+} nmc_cache_stream_t;
+
+struct nmc_cache
+{
+    char *dir;
+    uint64_t maxBytes;
+    pthread_mutex_t lock; // the upload and the inference stage share the cache
+
+    char *indexPath;
+    FILE *index;
+    size_t nlines; // records in the index file, stale ones included
+    size_t nstreams, cap;
+    nmc_cache_stream_t *streams;
+};
+
+typedef struct
+{
+    char *name;
+    int64_t mtimeNs;
+    uint64_t size;
+} nmc_cache_blob_t;
+
+static inline uint64_t nmc_hash_rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t nmc_hash_round(uint64_t acc, uint64_t in)
+{
+    return nmc_hash_rotl(acc + in * NMC_HASH_P2, 31) * NMC_HASH_P1;
+}
+
+static inline uint64_t nmc_hash_merge(uint64_t acc, uint64_t v)
+{
+    return (acc ^ nmc_hash_round(0, v)) * NMC_HASH_P1 + NMC_HASH_P4;
+}
+
+static int64_t nmc_cache_mtime_ns(const struct stat *st)
+{
+    return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Append `s` as the most recent record, replacing the one of the same name
+ */
+static int nmc_cache_add(nmc_cache_t *cache, nmc_cache_stream_t s)
+{
+    for (size_t iStream = 0; iStream < cache->nstreams; ++iStream)
+    {
+        if (strcmp(cache->streams[iStream].name, s.name))
+            continue;
+
+        free(cache->streams[iStream].name);
+        memmove(&cache->streams[iStream], &cache->streams[iStream + 1],
+                (cache->nstreams - iStream - 1) * sizeof(nmc_cache_stream_t));
+        cache->nstreams -= 1;
+        break;
+    }
+
+    if (cache->nstreams == cache->cap)
+    {
+        size_t cap                   = cache->cap ? cache->cap * 2 : 64;
+        nmc_cache_stream_t *streams = realloc(cache->streams, cap * sizeof(nmc_cache_stream_t));
+        assert_return(streams, -ENOMEM, "Failed to allocate cache index");
+        cache->streams = streams;
+        cache->cap     = cap;
+    }
+
+    cache->streams[cache->nstreams++] = s;
+    return 0;
+}
+
+static int nmc_cache_write(FILE *f, const nmc_cache_stream_t *s)
+{
+    int n = fprintf(f, "%u %016" PRIx64 " %" PRId64 " %" PRId64 " %s\n", s->filetype, s->hash,
+                    s->size, s->mtimeNs, s->name);
+    return (n < 0) ? -EIO : 0;
+}
+
+static void nmc_cache_load(nmc_cache_t *cache, FILE *f)
+{
+    char *line = NULL;
+    size_t len = 0;
+    while (getline(&line, &len, f) > 0)
+    {
+        cache->nlines += 1;
+
+        nmc_cache_stream_t s = {0};
+        int offset           = 0;
+        if (sscanf(line, "%u %" SCNx64 " %" SCNd64 " %" SCNd64 " %n", &s.filetype, &s.hash, &s.size,
+                   &s.mtimeNs, &offset) != 4 || !offset)
+            continue;
+
+        line[strcspn(line, "\n")] = '\0';
+        s.name                    = strdup(&line[offset]);
+        if (!s.name || nmc_cache_add(cache, s))
+            free(s.name);
+    }
+    free(line);
+}
+
+/**
+ * @brief Rewrite the index with the last record of each name (cache->lock held or not shared)
+ */
+static int nmc_cache_compact(nmc_cache_t *cache)
+{
+    char *tmp;
+    assert_return(asprintf(&tmp, "%s.%d.tmp", cache->indexPath, (int)gettid()) != -1, -ENOMEM,
+                  "Failed to allocate cache path");
+
+    int err = -EIO;
+    FILE *f = fopen(tmp, "w");
+    assert_goto(f, out, "Failed to rewrite cache index '%s' (%s)", tmp, strerror(errno));
+
+    err = 0;
+    for (size_t iStream = 0; iStream < cache->nstreams && !err; ++iStream)
+        err = nmc_cache_write(f, &cache->streams[iStream]);
+    if (fclose(f) && !err)
+        err = -errno;
+
+    // the old index stays in use if the new one cannot replace it
+    FILE *index = NULL;
+    if (!err && rename(tmp, cache->indexPath))
+        err = -errno;
+    if (!err && !(index = fopen(cache->indexPath, "a")))
+        err = -errno;
+    if (err)
+    {
+        pr_error("cache: failed to rewrite index (%d)", err);
+        unlink(tmp);
+        goto out;
+    }
+
+    pr_debug("cache: index %zu -> %zu records", cache->nlines, cache->nstreams);
+    fclose(cache->index);
+    cache->index  = index;
+    cache->nlines = cache->nstreams;
+
+out:
+    free(tmp);
+    return err;
+}
+
+static char *nmc_cache_blob_path(const nmc_cache_t *cache, uint64_t image, uint64_t model)
+{
+    char *path;
+    if (asprintf(&path, "%s/%016" PRIx64 "-%016" PRIx64 ".inf", cache->dir, image, model) == -1)
+        return NULL;
+    return path;
+}
+
+static int nmc_cache_copy(const char *src, const char *dst)
+{
+    int fdIn = open(src, O_RDONLY);
+    if (fdIn < 0)
+        return -errno;
+
+    int fdOut = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fdOut < 0)
+    {
+        int err = -errno;
+        close(fdIn);
+        return err;
+    }
+
+    // in-kernel copy (reflink on capable filesystems), plain read/write otherwise
+    int err = 0;
+    ssize_t n;
+    while ((n = copy_file_range(fdIn, NULL, fdOut, NULL, 1 << 30, 0)) > 0)
+        ;
+    if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+    {
+        char buf[1 << 16];
+        while ((n = read(fdIn, buf, sizeof(buf))) > 0)
+            if (write(fdOut, buf, n) != n)
+            {
+                n = -1;
+                break;
+            }
+    }
+    if (n < 0)
+        err = -errno;
+
+    close(fdIn);
+    if (close(fdOut) && !err)
+        err = -errno;
+    return err;
+}
+
+static int nmc_cache_blob_cmp(const void *a, const void *b)
+{
+    int64_t ta = ((const nmc_cache_blob_t *)a)->mtimeNs;
+    int64_t tb = ((const nmc_cache_blob_t *)b)->mtimeNs;
+    return (ta > tb) - (ta < tb);
+}
+
+/**
+ * @brief Remove the least recently used blobs until the cache fits its cap
+ */
+static void nmc_cache_evict(nmc_cache_t *cache)
+{
+    DIR *d = opendir(cache->dir);
+    if (!d)
+        return;
+
+    size_t n = 0, cap = 0;
+    uint64_t total          = 0;
+    nmc_cache_blob_t *blobs = NULL;
+    for (struct dirent *e; (e = readdir(d));)
+    {
+        size_t len = strlen(e->d_name);
+        if (len < 4 || strcmp(&e->d_name[len - 4], ".inf"))
+            continue;
+
+        struct stat st;
+        if (fstatat(dirfd(d), e->d_name, &st, 0) || !S_ISREG(st.st_mode))
+            continue;
+
+        if (n == cap)
+        {
+            cap                  = cap ? cap * 2 : 64;
+            nmc_cache_blob_t *nb = realloc(blobs, cap * sizeof(nmc_cache_blob_t));
+            if (!nb)
+                break;
+            blobs = nb;
+        }
+        blobs[n++] = (nmc_cache_blob_t){strdup(e->d_name), nmc_cache_mtime_ns(&st), st.st_size};
+        total += st.st_size;
+    }
+
+    if (total > cache->maxBytes)
+    {
+        qsort(blobs, n, sizeof(nmc_cache_blob_t), nmc_cache_blob_cmp);
+        for (size_t iBlob = 0; iBlob < n && total > cache->maxBytes; ++iBlob)
+        {
+            if (!blobs[iBlob].name || unlinkat(dirfd(d), blobs[iBlob].name, 0))
+                continue;
+            total -= blobs[iBlob].size;
+            pr_debug("cache: evict %s", blobs[iBlob].name);
+        }
+    }
+
+    for (size_t iBlob = 0; iBlob < n; ++iBlob)
+        free(blobs[iBlob].name);
+    free(blobs);
+    closedir(d);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+void nmc_hash_init(nmc_hash_t *h)
+{
+    *h = (nmc_hash_t){.v = {NMC_HASH_P1 + NMC_HASH_P2, NMC_HASH_P2, 0, -NMC_HASH_P1}};
+}
+
+/**
+ * @brief Feed `len` bytes (a multiple of 32, e.g. a flash page) to XXH64 with seed 0
+ */
+void nmc_hash_update(nmc_hash_t *h, const void *buf, size_t len)
+{
+    assert_exit(len % 32 == 0, "Hash input must be a multiple of 32 bytes, not %zu", len);
+
+    const uint8_t *p = buf;
+    for (size_t off = 0; off < len; off += 32)
+    {
+        uint64_t lane[4];
+        memcpy(lane, &p[off], sizeof(lane));
+        for (int i = 0; i < 4; ++i)
+            h->v[i] = nmc_hash_round(h->v[i], lane[i]);
+    }
+    h->len += len;
+}
+
+/**
+ * @brief Hash the content of the file at `path` (the identity of a model)
+ */
+int nmc_cache_hash_file(const char *path, uint64_t *hash)
+{
+    int fd = open(path, O_RDONLY);
+    assert_return(fd >= 0, -errno, "Failed to open '%s' (%s)", path, strerror(errno));
+
+    nmc_hash_t h;
+    nmc_hash_init(&h);
+
+    uint8_t buf[NMC_CACHE_HASH_CHUNK + 32];
+    uint64_t size = 0;
+    size_t fill   = 0;
+    ssize_t n;
+    while ((n = read(fd, &buf[fill], NMC_CACHE_HASH_CHUNK - fill)) > 0)
+    {
+        fill += n;
+        size += n;
+        if (fill < NMC_CACHE_HASH_CHUNK)
+            continue;
+        nmc_hash_update(&h, buf, fill);
+        fill = 0;
+    }
+    int err = (n < 0) ? -errno : 0;
+    close(fd);
+    assert_return(!err, err, "Failed to read '%s' (%s)", path, strerror(-err));
+
+    // the tail is zero padded to a lane, the size after it tells padding from content
+    size_t tail = (fill + 31) / 32 * 32;
+    memset(&buf[fill], 0, tail + 32 - fill);
+    memcpy(&buf[tail], &size, sizeof(size));
+    nmc_hash_update(&h, buf, tail + 32);
+
+    *hash = nmc_hash_final(&h);
+    return 0;
+}
+
+uint64_t nmc_hash_final(const nmc_hash_t *h)
+{
+    uint64_t x = NMC_HASH_P5;
+    if (h->len)
+    {
+        x = nmc_hash_rotl(h->v[0], 1) + nmc_hash_rotl(h->v[1], 7) + nmc_hash_rotl(h->v[2], 12) +
+            nmc_hash_rotl(h->v[3], 18);
+        for (int i = 0; i < 4; ++i)
+            x = nmc_hash_merge(x, h->v[i]);
+    }
+
+    x += h->len;
+    x ^= x >> 33;
+    x *= NMC_HASH_P2;
+    x ^= x >> 29;
+    x *= NMC_HASH_P3;
+    x ^= x >> 32;
+    return x;
+}
+
+nmc_cache_t *nmc_cache_open(const char *dir, uint64_t maxBytes)
+{
+    if (!dir)
+        return NULL;
+
+    int err = mkdir(dir, 0755);
+    assert_return(!err || errno == EEXIST, NULL, "Failed to create cache '%s' (%s)", dir,
+                  strerror(errno));
+
+    nmc_cache_t *cache = calloc(1, sizeof(nmc_cache_t));
+    assert_return(cache, NULL, "Failed to allocate cache");
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->maxBytes = maxBytes ? maxBytes : NMC_CACHE_MAX_DEFAULT;
+    cache->dir      = strdup(dir);
+
+    assert_goto(cache->dir && asprintf(&cache->indexPath, "%s/" NMC_CACHE_INDEX, dir) != -1, failed,
+                "Failed to allocate cache path");
+    cache->index = fopen(cache->indexPath, "a+");
+    assert_goto(cache->index, failed, "Failed to open cache index in '%s' (%s)", dir, strerror(errno));
+
+    rewind(cache->index);
+    nmc_cache_load(cache, cache->index);
+    if (cache->nlines > cache->nstreams)
+        nmc_cache_compact(cache);
+    pr_info("cache: '%s', %zu streams recorded, cap %" PRIu64 " bytes", dir, cache->nstreams,
+            cache->maxBytes);
+    return cache;
+
+failed:
+    nmc_cache_close(cache);
+    return NULL;
+}
+
+void nmc_cache_close(nmc_cache_t *cache)
+{
+    if (!cache)
+        return;
+
+    if (cache->index)
+        fclose(cache->index);
+    for (size_t iStream = 0; iStream < cache->nstreams; ++iStream)
+        free(cache->streams[iStream].name);
+    free(cache->streams);
+    free(cache->indexPath);
+    free(cache->dir);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+/**
+ * @brief Record the stream hash of an upload, with the size and mtime of its source file
+ */
+int nmc_cache_record(nmc_cache_t *cache, uint32_t filetype, const char *name, uint64_t hash)
+{
+    if (!cache)
+        return 0;
+
+    struct stat st;
+    nmc_cache_stream_t s = {.filetype = filetype, .hash = hash, .name = strdup(name)};
+    assert_return(s.name, -ENOMEM, "Failed to allocate cache entry");
+    if (!stat(name, &st))
+    {
+        s.size    = st.st_size;
+        s.mtimeNs = nmc_cache_mtime_ns(&st);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    int err = nmc_cache_write(cache->index, &s);
+    if (!err && fflush(cache->index))
+        err = -errno;
+    if (!err)
+        err = nmc_cache_add(cache, s);
+    if (err)
+        free(s.name);
+
+    // a daemon records the same names over and over, keep the index bounded
+    if (!err && ++cache->nlines > 2 * cache->nstreams + NMC_CACHE_INDEX_SLACK)
+        nmc_cache_compact(cache);
+    pthread_mutex_unlock(&cache->lock);
+    return err;
+}
+
+/**
+ * @brief Get the stream hash last recorded for `name`
+ *
+ * @param sameSource Only if the source file still has the recorded size and mtime
+ */
+bool nmc_cache_stream(nmc_cache_t *cache, const char *name, bool sameSource, uint64_t *hash)
+{
+    if (!cache)
+        return false;
+
+    struct stat st;
+    if (sameSource && stat(name, &st))
+        return false;
+
+    bool found = false;
+    pthread_mutex_lock(&cache->lock);
+    for (size_t iStream = cache->nstreams; iStream-- > 0;)
+    {
+        const nmc_cache_stream_t *s = &cache->streams[iStream];
+        if (strcmp(s->name, name))
+            continue;
+
+        // the last record decides, an older one with the same source is stale
+        found = !sameSource || (s->size && s->size == st.st_size &&
+                                s->mtimeNs == nmc_cache_mtime_ns(&st));
+        *hash = s->hash;
+        break;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+/**
+ * @brief Check that the last model uploaded is the one of hash `hash` (nmc_cache_hash_file)
+ */
+bool nmc_cache_model(nmc_cache_t *cache, uint64_t hash)
+{
+    if (!cache)
+        return false;
+
+    bool found = false;
+    pthread_mutex_lock(&cache->lock);
+    for (size_t iStream = cache->nstreams; iStream-- > 0;)
+    {
+        if (cache->streams[iStream].filetype != NMC_FILE_TYPE_MODEL_UNET)
+            continue;
+        found = (cache->streams[iStream].hash == hash);
+        break;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+/**
+ * @brief Copy the cached result of (image, model) to `path`
+ *
+ * @return 0 on hit, -ENOENT on miss
+ */
+int nmc_cache_get(nmc_cache_t *cache, uint64_t image, uint64_t model, const char *path)
+{
+    if (!cache)
+        return -ENOENT;
+
+    char *blob = nmc_cache_blob_path(cache, image, model);
+    assert_return(blob, -ENOMEM, "Failed to allocate cache path");
+
+    int err = nmc_cache_copy(blob, path);
+    if (!err)
+        utimensat(AT_FDCWD, blob, NULL, 0); // most recently used
+    free(blob);
+    return err;
+}
+
+/**
+ * @brief Store the result in `path` as (image, model), then evict to the size cap
+ */
+int nmc_cache_put(nmc_cache_t *cache, uint64_t image, uint64_t model, const char *path)
+{
+    if (!cache)
+        return 0;
+
+    char *blob = nmc_cache_blob_path(cache, image, model), *tmp;
+    assert_return(blob, -ENOMEM, "Failed to allocate cache path");
+    if (asprintf(&tmp, "%s.%d.tmp", blob, (int)gettid()) == -1)
+    {
+        free(blob);
+        return -ENOMEM;
+    }
+
+    // readers never see a partial blob
+    int err = nmc_cache_copy(path, tmp);
+    if (!err && rename(tmp, blob))
+        err = -errno;
+    if (err)
+        unlink(tmp);
+
+    free(tmp);
+    free(blob);
+
+    pthread_mutex_lock(&cache->lock);
+    nmc_cache_evict(cache);
+    pthread_mutex_unlock(&cache->lock);
+    return err;
+}
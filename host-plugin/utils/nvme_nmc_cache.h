@@ -0,0 +1,66 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_CACHE_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "nvme_nmc.h"
+
+// Content-addressed cache of inference results on the host
+//
+//   <dir>/streams                      : <type> <hash> <size> <mtime> <name>, last line wins
+//   <dir>/<image hash>-<model hash>.inf : result blob, mtime = last use
+//
+// The hash of an image upload (XXH64 of the placed pages, in flush order) is
+// taken in the placement pass while each page is still in cache, and recorded
+// for the uploaded name together with the size and mtime of its source file.
+// A model upload is recorded by the hash of its file, and as unknown (0) while
+// it is in progress, so a failed upload matches no model.
+//
+// A result is keyed by the stream hash of the image and the hash of the model
+// file the user names at lookup (NMC_CACHE_MODEL_OPT). It is served only if
+// that model is the last one uploaded through a cache in this directory, any
+// other model upload invalidates the results of the previous one. Uploads made
+// without the cache are not seen.
+//
+// The index keeps the last record of each name, older lines are dropped when
+// it is opened or once they outnumber the live ones. Blobs are evicted least
+// recently used first once the directory exceeds its cap.
+
+#define NMC_CACHE_MAX_DEFAULT (1ULL << 30)
+
+#define NMC_CACHE_OPT(dir, max)                                                                  \
+    OPT_FILE("cache", 'k', dir, "serve repeated inferences from this result cache directory"),   \
+        OPT_SUFFIX("cache-max", 'K', max, "size cap of the result cache (default 1G)")
+
+#define NMC_CACHE_MODEL_OPT(path)                                                                \
+    OPT_FILE("cache-model", 'W', path, "model file on the device, cached results are keyed on it")
+
+typedef struct
+{
+    uint64_t v[4];
+    uint64_t len;
+} nmc_hash_t;
+
+typedef struct nmc_cache nmc_cache_t;
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+void nmc_hash_init(nmc_hash_t *h);
+void nmc_hash_update(nmc_hash_t *h, const void *buf, size_t len);
+uint64_t nmc_hash_final(const nmc_hash_t *h);
+
+nmc_cache_t *nmc_cache_open(const char *dir, uint64_t maxBytes);
+void nmc_cache_close(nmc_cache_t *cache);
+
+int nmc_cache_record(nmc_cache_t *cache, uint32_t filetype, const char *name, uint64_t hash);
+bool nmc_cache_stream(nmc_cache_t *cache, const char *name, bool sameSource, uint64_t *hash);
+bool nmc_cache_model(nmc_cache_t *cache, uint64_t hash);
+int nmc_cache_hash_file(const char *path, uint64_t *hash);
+
+int nmc_cache_get(nmc_cache_t *cache, uint64_t image, uint64_t model, const char *path);
+int nmc_cache_put(nmc_cache_t *cache, uint64_t image, uint64_t model, const char *path);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_CACHE_H__ */
@@ -0,0 +1,336 @@
+#include "./nvme_nmc_emu.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    char name[NMC_FILENAME_MAX_BYTES];
+    uint32_t filetype;
+    uint32_t nblks;
+    uint32_t firstBlk;
+    uint32_t npackets;
+    uint32_t closed;
+} emu_file_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nfiles;
+    uint32_t nextBlk;
+    int32_t iOpen; // index of the opened mapping table, -1 if none
+    uint32_t resultLen;
+    uint32_t lastTicket;                // ticket of the last inference, 0 if none
+    uint32_t tickets[EMU_RESULT_SLOTS]; // ticket held by each result slot
+    emu_file_t files[EMU_MAX_FILES];
+} emu_table_t;
+
+_Static_assert(sizeof(emu_table_t) <= EMU_RESULT_OFF, "mapping table overlaps result");
+
+// the LBA of the first write of a mapping is not checked
+#define EMU_LBA_ANY UINT64_MAX
+
+typedef struct
+{
+    int fd;
+    pthread_mutex_t lock; // uploads and inferences may come from different threads
+    emu_table_t table;
+    uint64_t nextLba; // of the next write to the opened mapping
+} emu_t;
+
+static inline off_t emu_page_off(uint32_t iBlk, uint32_t iCh, uint32_t iPage)
+{
+    return EMU_DATA_OFF +
+           (((off_t)iBlk * NUM_CHANNELS + iCh) * NUM_PAGES_PER_BLOCK + iPage) * BYTES_PER_PAGE;
+}
+
+static int emu_sync_table(emu_t *emu)
+{
+    ssize_t n = pwrite(emu->fd, &emu->table, sizeof(emu_table_t), 0);
+    return (n == sizeof(emu_table_t)) ? 0 : -EIO;
+}
+
+static inline off_t emu_result_off(uint32_t ticket)
+{
+    return EMU_RESULT_OFF + (off_t)(ticket % EMU_RESULT_SLOTS) * EMU_RESULT_BYTES;
+}
+
+static emu_file_t *emu_find_file(emu_t *emu, const char *name)
+{
+    for (uint32_t iFile = 0; iFile < emu->table.nfiles; ++iFile)
+        if (!strncmp(emu->table.files[iFile].name, name, NMC_FILENAME_MAX_BYTES))
+            return &emu->table.files[iFile];
+    return NULL;
+}
+
+// the filename is either in the data buffer or packed into cdw10 (NMC_SHORT_FILENAME)
+static int emu_get_filename(const nmc_config_t *config, char name[NMC_FILENAME_MAX_BYTES])
+{
+    memset(name, 0, NMC_FILENAME_MAX_BYTES);
+    if (!config->data)
+    {
+        memcpy(name, &config->cdw10, sizeof(config->cdw10));
+        return 0;
+    }
+
+    size_t n = strnlen(config->data, config->data_len);
+    if (n >= NMC_FILENAME_MAX_BYTES)
+        return NMC_SC_MAPPING_FILENAME_TOO_LONG;
+
+    memcpy(name, config->data, n);
+    for (size_t iCh = 0; iCh < n; ++iCh)
+        if (!isprint((unsigned char)name[iCh]))
+            return NMC_SC_MAPPING_FILENAME_UNSUPPORTED;
+
+    return n ? 0 : NMC_SC_MAPPING_FILENAME_UNSUPPORTED;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                NMC commands                                */
+/* -------------------------------------------------------------------------- */
+
+static int emu_alloc(emu_t *emu, nmc_config_t *config)
+{
+    if (emu->table.iOpen >= 0)
+        return NMC_SC_MAPPING_REOPENED;
+
+    char name[NMC_FILENAME_MAX_BYTES];
+    int err = emu_get_filename(config, name);
+    if (err)
+        return err;
+
+    // re-allocate an existing file drops its old blocks (no reclaim)
+    emu_file_t *file = emu_find_file(emu, name);
+    if (!file)
+    {
+        if (emu->table.nfiles == EMU_MAX_FILES)
+            return EMU_SC_CAPACITY_EXCEEDED;
+        file = &emu->table.files[emu->table.nfiles++];
+    }
+
+    *file = (emu_file_t){
+        .filetype = config->nmc_new_mapping_filetype,
+        .nblks    = config->nmc_new_mapping_nblks,
+        .firstBlk = emu->table.nextBlk,
+    };
+    memcpy(file->name, name, NMC_FILENAME_MAX_BYTES);
+
+    emu->table.nextBlk += file->nblks;
+    emu->table.iOpen = file - emu->table.files;
+    emu->nextLba     = EMU_LBA_ANY;
+    return emu_sync_table(emu);
+}
+
+static int emu_flush(emu_t *emu, nmc_config_t *config)
+{
+    if (emu->table.iOpen < 0)
+        return NMC_SC_MAPPING_RECLOSED;
+
+    emu->table.files[emu->table.iOpen].closed = true;
+    emu->table.iOpen                          = -1;
+
+    int err = emu_sync_table(emu);
+    return err ? err : (fdatasync(emu->fd) ? -errno : 0);
+}
+
+static int emu_write(emu_t *emu, nmc_config_t *config)
+{
+    if (emu->table.iOpen < 0)
+        return NMC_SC_MAPPING_DISABLED;
+
+    emu_file_t *file  = &emu->table.files[emu->table.iOpen];
+    uint32_t npackets = config->data_len / BYTES_PACKET;
+    uint32_t nblks    = (uint32_t)config->nlb + 1; // zero-based
+
+    if ((uint64_t)nblks * BYTES_NVME_BLOCK != config->data_len)
+        return EMU_SC_INVALID_FIELD;
+    if (emu->nextLba != EMU_LBA_ANY && config->slba != emu->nextLba)
+        return EMU_SC_LBA_OUT_OF_RANGE;
+    if (file->npackets + npackets > file->nblks * NUM_PAGES_PER_BLOCK)
+        return EMU_SC_CAPACITY_EXCEEDED;
+
+    // distribute each packet to all channels, one page per channel
+    for (uint32_t iPacket = 0; iPacket < npackets; ++iPacket, ++file->npackets)
+    {
+        uint32_t iBlk  = file->firstBlk + file->npackets / NUM_PAGES_PER_BLOCK;
+        uint32_t iPage = file->npackets % NUM_PAGES_PER_BLOCK;
+
+        for (uint32_t iCh = 0; iCh < NUM_CHANNELS; ++iCh)
+        {
+            const char *page = &config->data[(size_t)iPacket * BYTES_PACKET + iCh * BYTES_PER_PAGE];
+            if (pwrite(emu->fd, page, BYTES_PER_PAGE, emu_page_off(iBlk, iCh, iPage)) !=
+                BYTES_PER_PAGE)
+                return -EIO;
+        }
+    }
+
+    emu->nextLba = config->slba + nblks;
+    return 0;
+}
+
+static int emu_inference(emu_t *emu, nmc_config_t *config)
+{
+    char name[NMC_FILENAME_MAX_BYTES];
+    emu_file_t *file = emu_get_filename(config, name) ? NULL : emu_find_file(emu, name);
+    if (!file || !file->closed)
+        return EMU_SC_INVALID_FIELD;
+
+    uint32_t(*hist)[256] = calloc(1, EMU_RESULT_BYTES);
+    uint8_t *page        = malloc(BYTES_PER_PAGE);
+    assert_return(hist && page, -ENOMEM, "Failed to allocate inference buffers");
+
+    int err = 0;
+    for (uint32_t iPacket = 0; iPacket < file->npackets && !err; ++iPacket)
+    {
+        uint32_t iBlk  = file->firstBlk + iPacket / NUM_PAGES_PER_BLOCK;
+        uint32_t iPage = iPacket % NUM_PAGES_PER_BLOCK;
+
+        for (uint32_t iCh = 0; iCh < NUM_CHANNELS && !err; ++iCh)
+        {
+            if (pread(emu->fd, page, BYTES_PER_PAGE, emu_page_off(iBlk, iCh, iPage)) !=
+                BYTES_PER_PAGE)
+                err = -EIO;
+
+            for (size_t iByte = 0; iByte < BYTES_PER_PAGE && !err; ++iByte)
+                hist[iCh][page[iByte]] += 1;
+        }
+    }
+
+    if (!err)
+    {
+        uint32_t ticket = emu->table.lastTicket + 1;
+        if (ticket == NMC_INFERENCE_TICKET_LATEST)
+            ticket += 1;
+
+        if (pwrite(emu->fd, hist, EMU_RESULT_BYTES, emu_result_off(ticket)) != EMU_RESULT_BYTES)
+            err = -EIO;
+        else
+        {
+            emu->table.resultLen                          = NUM_CHANNELS * sizeof(*hist);
+            emu->table.lastTicket                         = ticket;
+            emu->table.tickets[ticket % EMU_RESULT_SLOTS] = ticket;
+            config->result                                = ticket;
+            err                                           = emu_sync_table(emu);
+        }
+    }
+
+    free(page);
+    free(hist);
+    return err;
+}
+
+static int emu_inference_read(emu_t *emu, nmc_config_t *config)
+{
+    uint32_t ticket = config->nmc_inference_ticket;
+    if (ticket == NMC_INFERENCE_TICKET_LATEST)
+        ticket = emu->table.lastTicket;
+
+    // overwritten by a newer inference, or never issued
+    if (!ticket || emu->table.tickets[ticket % EMU_RESULT_SLOTS] != ticket)
+        return EMU_SC_INVALID_FIELD;
+
+    // chunked reads address the result by byte offset
+    uint64_t off = config->nmc_result_offset;
+    if (off && off >= emu->table.resultLen)
+        return EMU_SC_INVALID_FIELD;
+
+    uint32_t len = EMU_RESULT_BYTES - off;
+    if (config->data_len < len)
+        len = config->data_len;
+
+    memset(config->data, 0, config->data_len);
+    if (pread(emu->fd, config->data, len, emu_result_off(ticket) + off) != len)
+        return -EIO;
+
+    config->result = emu->table.resultLen;
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               backend callbacks                            */
+/* -------------------------------------------------------------------------- */
+
+static int emu_dispatch(emu_t *emu, nmc_config_t *config)
+{
+    switch (config->OPCODE)
+    {
+    case IO_NVM_NMC_ALLOC:
+        return emu_alloc(emu, config);
+    case IO_NVM_NMC_FLUSH:
+        return emu_flush(emu, config);
+    case IO_NVM_NMC_WRITE:
+        return emu_write(emu, config);
+    case IO_NVM_NMC_INFERENCE:
+        return emu_inference(emu, config);
+    case IO_NVM_NMC_INFERENCE_READ:
+        return emu_inference_read(emu, config);
+    default:
+        return EMU_SC_INVALID_FIELD;
+    }
+}
+
+static int nmc_backend_emu_passthru(nmc_backend_t *be, bool io_cmd, nmc_config_t *config)
+{
+    emu_t *emu = be->priv;
+
+    config->result = 0;
+    if (!io_cmd)
+        return 0; // monitor (admin) commands are not emulated
+
+    pthread_mutex_lock(&emu->lock);
+    int err = emu_dispatch(emu, config);
+    pthread_mutex_unlock(&emu->lock);
+    return err;
+}
+
+static void nmc_backend_emu_close(nmc_backend_t *be)
+{
+    emu_t *emu = be->priv;
+    emu_sync_table(emu);
+    close(emu->fd);
+    pthread_mutex_destroy(&emu->lock);
+    free(emu);
+}
+
+/**
+ * @brief Setup the emulator backend, the state file is created if not exists
+ */
+int nmc_backend_emu_init(nmc_backend_t *be, const char *path)
+{
+    emu_t *emu = calloc(1, sizeof(emu_t));
+    assert_return(emu, -ENOMEM, "Failed to allocate emulator");
+    pthread_mutex_init(&emu->lock, NULL);
+
+    emu->nextLba = EMU_LBA_ANY;
+    emu->fd      = open(path, O_RDWR | O_CREAT, 0644);
+    assert_goto(emu->fd >= 0, failed, "Failed to open '%s' (%s)", path, strerror(errno));
+
+    ssize_t n = pread(emu->fd, &emu->table, sizeof(emu_table_t), 0);
+    if (n != sizeof(emu_table_t) || emu->table.magic != EMU_MAGIC)
+    {
+        pr_info("emu: initialize new device state in '%s'", path);
+        emu->table = (emu_table_t){.magic = EMU_MAGIC, .version = EMU_VERSION, .iOpen = -1};
+        assert_goto(!emu_sync_table(emu), failed, "Failed to write '%s'", path);
+    }
+    assert_goto(emu->table.version == EMU_VERSION, failed, "Unsupported emulator state version");
+
+    be->name     = "emu";
+    be->passthru = nmc_backend_emu_passthru;
+    be->close    = nmc_backend_emu_close;
+    be->priv     = emu;
+    return 0;
+
+failed:
+    if (emu->fd >= 0)
+        close(emu->fd);
+    free(emu);
+    return -EINVAL;
+}
@@ -0,0 +1,43 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_EMU_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_EMU_H__
+
+#include <stdint.h>
+#include "nvme_nmc_backend.h"
+
+// File-backed emulator of the NMC device (backend spec "emu:PATH")
+//
+// Plays the device side of C1/C2/C3/C8/C9 and returns the NMC_SC_* codes, so
+// write-tiff, write-model and inference can run end-to-end on any Linux box.
+// State persists in a sparse file across plugin invocations:
+//
+//   0                 EMU_RESULT_OFF          EMU_DATA_OFF
+//   | mapping table   | inference results[8]  | blk0.ch0.page[0..255] | blk0.ch1... | blk1.ch0...
+//
+// A file owns consecutive blocks, packet k of a file is page (k % 256) of
+// block (firstBlk + k / 256) on every channel, like the flash layout. The
+// writes of a mapping are checked like a device would: NLB must match the
+// payload, and each write must start at the LBA after the previous one.
+//
+// C3 does not run the model, it reads back every page of the file and
+// reports the per-channel byte histogram (uint32_t[NUM_CHANNELS][256]) as the
+// inference result, which depends on every byte written by placement. The
+// completion of C3 returns a ticket, the results of the last EMU_RESULT_SLOTS
+// tickets can be read by C8 (nvme_nmc.h, NMC_INFERENCE_TICKET_LATEST).
+
+#define EMU_MAGIC     0x454d434e // "NCME"
+#define EMU_VERSION   2
+#define EMU_MAX_FILES 128
+
+#define EMU_RESULT_BYTES (BYTES_INF_RESULT * 4)
+#define EMU_RESULT_SLOTS 8
+#define EMU_RESULT_OFF   (1UL << 20)
+#define EMU_DATA_OFF     (EMU_RESULT_OFF + EMU_RESULT_SLOTS * EMU_RESULT_BYTES)
+
+// NVMe generic status codes used by the emulator
+#define EMU_SC_INVALID_FIELD     0x0002
+#define EMU_SC_LBA_OUT_OF_RANGE  0x0080
+#define EMU_SC_CAPACITY_EXCEEDED 0x0081
+
+int nmc_backend_emu_init(nmc_backend_t *be, const char *path);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_EMU_H__ */
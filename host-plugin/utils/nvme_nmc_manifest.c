@@ -0,0 +1,106 @@
+#include "./nvme_nmc_manifest.h"
+
+#include <inttypes.h>
+
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+FILE *nmc_manifest_create(const char *path, const char *dataFile)
+{
+    FILE *manifest = fopen(path, "w");
+    assert_return(manifest, NULL, "Failed to create manifest '%s' (%s)", path, strerror(errno));
+
+    fprintf(manifest, "# nmc-manifest v%d %s\n", NMC_MANIFEST_VERSION, dataFile ? dataFile : "");
+    return manifest;
+}
+
+void nmc_manifest_add(FILE *manifest, uint64_t slba, const uint32_t crcs[NUM_CHANNELS])
+{
+    fprintf(manifest, "0x%08" PRIx64, slba);
+    for (uint32_t iCh = 0; iCh < NUM_CHANNELS; ++iCh)
+        fprintf(manifest, " %08x", crcs[iCh]);
+    fputc('\n', manifest);
+}
+
+int nmc_manifest_close(FILE *manifest)
+{
+    if (!manifest)
+        return 0;
+
+    int err = ferror(manifest) ? -EIO : 0;
+    if (fclose(manifest))
+        err = -errno;
+    return err;
+}
+
+/**
+ * @brief Load all entries of a manifest, the caller should free the returned list
+ */
+nmc_manifest_entry_t *nmc_manifest_load(const char *path, size_t *nentries)
+{
+    FILE *manifest = fopen(path, "r");
+    assert_return(manifest, NULL, "Failed to open manifest '%s' (%s)", path, strerror(errno));
+
+    size_t cap = 1024, n = 0;
+    nmc_manifest_entry_t *entries = malloc(cap * sizeof(nmc_manifest_entry_t));
+    assert_exit(entries, "Failed to allocate manifest entries");
+
+    int version = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), manifest))
+    {
+        if (line[0] == '#')
+        {
+            sscanf(line, "# nmc-manifest v%d", &version);
+            continue;
+        }
+
+        if (n == cap)
+        {
+            cap *= 2;
+            entries = realloc(entries, cap * sizeof(nmc_manifest_entry_t));
+            assert_exit(entries, "Failed to allocate manifest entries");
+        }
+
+        nmc_manifest_entry_t *e = &entries[n];
+        char *p                 = line;
+        e->slba                 = strtoull(p, &p, 16);
+        for (uint32_t iCh = 0; iCh < NUM_CHANNELS; ++iCh)
+            e->crcs[iCh] = (uint32_t)strtoul(p, &p, 16);
+        n += 1;
+    }
+    fclose(manifest);
+
+    if (version != NMC_MANIFEST_VERSION)
+    {
+        pr_error("Unsupported manifest '%s' (version %d)", path, version);
+        free(entries);
+        return NULL;
+    }
+
+    *nentries = n;
+    return entries;
+}
+
+/**
+ * @brief Get the data file recorded in the header of a manifest, the caller should free it
+ */
+char *nmc_manifest_data_file(const char *path)
+{
+    FILE *manifest = fopen(path, "r");
+    assert_return(manifest, NULL, "Failed to open manifest '%s' (%s)", path, strerror(errno));
+
+    int version = 0, offset = 0;
+    char line[NMC_FILENAME_MAX_BYTES + 32];
+    if (fgets(line, sizeof(line), manifest))
+        sscanf(line, "# nmc-manifest v%d %n", &version, &offset);
+    fclose(manifest);
+
+    assert_return(version == NMC_MANIFEST_VERSION && offset, NULL, "Unsupported manifest '%s'", path);
+
+    line[strcspn(line, "\r\n")] = '\0';
+    return line[offset] ? strdup(&line[offset]) : NULL;
+}
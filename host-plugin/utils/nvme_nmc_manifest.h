@@ -0,0 +1,44 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_MANIFEST_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_MANIFEST_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "nvme_nmc.h"
+
+// Host-side manifest of per-page CRC-32C of an uploaded file
+//
+// One line per packet, the crc of each 16 KiB flash page (= channel) in order:
+//
+//   # nmc-manifest v1 <data file>
+//   <slba (hex)> <crc ch0> <crc ch1> ... <crc ch7>
+//
+// The same crcs are sent as the metadata of IO_NVM_NMC_WRITE (NUM_CHANNELS
+// uint32_t per packet) when requested, so an audit only needs to read back a
+// page and compare, without a second pass over the source file.
+
+#define NMC_MANIFEST_VERSION 1
+#define NMC_MANIFEST_BYTES_META_PER_PACKET (NUM_CHANNELS * sizeof(uint32_t))
+
+#define NMC_MANIFEST_OPT(path, meta)                                                             \
+    OPT_FILE("manifest", 'm', path, "write per-page CRC-32C of the upload to this file"),        \
+        OPT_FLAG("metadata", 'M', meta, "also send the per-page CRC-32C as NVMe metadata")
+
+typedef struct
+{
+    uint64_t slba;
+    uint32_t crcs[NUM_CHANNELS];
+} nmc_manifest_entry_t;
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+FILE *nmc_manifest_create(const char *path, const char *dataFile);
+void nmc_manifest_add(FILE *manifest, uint64_t slba, const uint32_t crcs[NUM_CHANNELS]);
+int nmc_manifest_close(FILE *manifest);
+
+nmc_manifest_entry_t *nmc_manifest_load(const char *path, size_t *nentries);
+char *nmc_manifest_data_file(const char *path);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_MANIFEST_H__ */
@@ -0,0 +1,233 @@
+#include "./nvme_nmc_pipe.h"
+
+#include <pthread.h>
+
+#include "./nvme_nmc_uring.h"
+#include "./nvme_nmc_manifest.h"
+#include "./spsc_ring.h"
+#include "./nvme_nmc_bufpool.h"
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+// a contiguous buffer of `packetsPerCmd` packets, sent by a single command
+typedef struct
+{
+    nmc_pipe_t *pipe;
+    uint8_t *data;
+    uint32_t *crcs;    // NUM_CHANNELS per packet, NULL if checksum disabled
+    uint32_t npackets; // number of filled packets
+} nmc_pipe_cmd_t;
+
+struct nmc_pipe
+{
+    nmc_config_t *config;
+    pthread_t submitter;
+
+    uint32_t ncmds;
+    uint32_t packetsPerCmd;
+    nmc_pipe_cmd_t *cmds;
+
+    nmc_pipe_cmd_t *filling; // owned by placement
+
+    FILE *manifest; // per-page crcs of submitted packets, NULL if not requested
+    bool metadata;  // send per-page crcs as command metadata
+
+    spsc_ring_t free; // submitter -> placement
+    spsc_ring_t full; // placement -> submitter
+
+    int err; // first error seen by the submitter, read by placement (nmc_pipe_error)
+};
+
+static void nmc_pipe_done(void *data, int err, uint32_t result, void *arg)
+{
+    nmc_pipe_cmd_t *cmd = arg;
+    if (err && !cmd->pipe->err)
+        __atomic_store_n(&cmd->pipe->err, err, __ATOMIC_RELEASE);
+
+    cmd->npackets = 0;
+    spsc_ring_push(&cmd->pipe->free, cmd);
+}
+
+static void *nmc_pipe_submitter(void *arg)
+{
+    nmc_pipe_t *pipe       = arg;
+    struct nmc_uring *ring = pipe->config->uring;
+    nmc_pipe_cmd_t *cmd    = NULL;
+
+    for (uint32_t spins = 0;;)
+    {
+        if (spsc_ring_try_pop(&pipe->full, (void **)&cmd))
+        {
+            // the upload failed, hand the packet back unwritten so placement does not block
+            if (pipe->err)
+            {
+                nmc_pipe_done(cmd->data, 0, 0, cmd);
+                continue;
+            }
+
+            for (uint32_t iPacket = 0; pipe->manifest && iPacket < cmd->npackets; ++iPacket)
+                nmc_manifest_add(pipe->manifest,
+                                 pipe->config->slba + iPacket * (BYTES_PACKET / BYTES_NVME_BLOCK),
+                                 &cmd->crcs[iPacket * NUM_CHANNELS]);
+
+            // a failure (also before submission) completes through nmc_pipe_done
+            nmc_flush_packet_async(pipe->config, cmd->data, cmd->npackets * BYTES_PACKET,
+                                   pipe->metadata ? cmd->crcs : NULL, nmc_pipe_done, cmd);
+            spins = 0;
+            continue;
+        }
+
+        if (spsc_ring_closed(&pipe->full) && spsc_ring_empty(&pipe->full))
+            break;
+
+        // nothing to submit, recycle the completed packets for placement, and
+        // block on the device only when no more packets can be submitted. With
+        // nothing in flight there is only placement to wait for.
+        if (ring && nmc_uring_inflight(ring) == nmc_uring_qdepth(ring))
+            nmc_uring_reap(ring, true);
+        else if (ring && nmc_uring_inflight(ring))
+        {
+            nmc_uring_reap(ring, false);
+            spsc_ring_backoff(&spins);
+        }
+        else
+            spsc_ring_wait(&pipe->full, &spins, true);
+    }
+
+    if (ring)
+        nmc_uring_drain(ring);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start the submitter stage
+ *
+ * @param config The write config (owned by the submitter until nmc_pipe_close)
+ * @param ncmds Number of command buffers (in-flight + being filled)
+ * @param packetsPerCmd Number of consecutive packets coalesced into one command
+ */
+nmc_pipe_t *nmc_pipe_open(nmc_config_t *config, uint32_t ncmds, uint32_t packetsPerCmd)
+{
+    assert_return(packetsPerCmd > 0, NULL, "Invalid packets per command");
+
+    nmc_pipe_t *pipe = calloc(1, sizeof(nmc_pipe_t));
+    assert_return(pipe, NULL, "Failed to allocate pipe");
+
+    pipe->config        = config;
+    pipe->ncmds         = ncmds;
+    pipe->packetsPerCmd = packetsPerCmd;
+    pipe->cmds          = calloc(ncmds, sizeof(nmc_pipe_cmd_t));
+    assert_exit(pipe->cmds, "Failed to allocate command list");
+
+    assert_exit(spsc_ring_init(&pipe->free, ncmds), "Failed to allocate free ring");
+    assert_exit(spsc_ring_init(&pipe->full, ncmds), "Failed to allocate full ring");
+
+    // the buffer used by NVMe comand should be aligned to dram page size (pool granule)
+    for (uint32_t iCmd = 0; iCmd < ncmds; ++iCmd)
+    {
+        pipe->cmds[iCmd].pipe = pipe;
+        pipe->cmds[iCmd].data = nmc_buf_alloc(packetsPerCmd * BYTES_PACKET);
+        assert_exit(pipe->cmds[iCmd].data, "Failed to allocate packet buffer");
+        spsc_ring_push(&pipe->free, &pipe->cmds[iCmd]);
+    }
+
+    int err = pthread_create(&pipe->submitter, NULL, nmc_pipe_submitter, pipe);
+    assert_exit(!err, "Failed to create submitter thread (%s)", strerror(err));
+
+    return pipe;
+}
+
+/**
+ * @brief Wait for all packets to be submitted and completed, then release the pipe
+ *
+ * @return The first error returned by the device (0 if all packets succeeded)
+ */
+int nmc_pipe_close(nmc_pipe_t *pipe)
+{
+    // the last command may be partially filled
+    if (pipe->filling && pipe->filling->npackets)
+        spsc_ring_push(&pipe->full, pipe->filling);
+
+    spsc_ring_close(&pipe->full);
+    pthread_join(pipe->submitter, NULL);
+
+    int err = pipe->err;
+    for (uint32_t iCmd = 0; iCmd < pipe->ncmds; ++iCmd)
+    {
+        nmc_buf_free(pipe->cmds[iCmd].data);
+        free(pipe->cmds[iCmd].crcs);
+    }
+
+    spsc_ring_free(&pipe->free);
+    spsc_ring_free(&pipe->full);
+    free(pipe->cmds);
+    free(pipe);
+    return err;
+}
+
+/**
+ * @brief The first error of the submitter, 0 while all packets are written
+ *
+ * Once set, the packets put are dropped, placement should stop and close the pipe.
+ */
+int nmc_pipe_error(nmc_pipe_t *pipe) { return __atomic_load_n(&pipe->err, __ATOMIC_ACQUIRE); }
+
+uint8_t *nmc_pipe_get(nmc_pipe_t *pipe)
+{
+    if (!pipe->filling)
+        pipe->filling = spsc_ring_pop(&pipe->free);
+
+    return &pipe->filling->data[pipe->filling->npackets * BYTES_PACKET];
+}
+
+void nmc_pipe_put(nmc_pipe_t *pipe, uint8_t *packet)
+{
+    nmc_pipe_cmd_t *cmd = pipe->filling;
+    assert_exit(packet == &cmd->data[cmd->npackets * BYTES_PACKET], "Packets put out of order");
+
+    // send the command once all its packets are filled
+    cmd->npackets += 1;
+    if (cmd->npackets == pipe->packetsPerCmd)
+    {
+        spsc_ring_push(&pipe->full, cmd);
+        pipe->filling = NULL;
+    }
+}
+
+/**
+ * @brief Enable per-page CRC-32C, must be called before the first nmc_pipe_get()
+ *
+ * @param manifest Append the crcs of each submitted packet to it (NULL for none)
+ * @param metadata Send the crcs as the metadata of the write commands
+ */
+void nmc_pipe_checksum(nmc_pipe_t *pipe, FILE *manifest, bool metadata)
+{
+    if (!manifest && !metadata)
+        return;
+
+    pipe->manifest = manifest;
+    pipe->metadata = metadata;
+
+    for (uint32_t iCmd = 0; iCmd < pipe->ncmds; ++iCmd)
+    {
+        pipe->cmds[iCmd].crcs = calloc(pipe->packetsPerCmd, NMC_MANIFEST_BYTES_META_PER_PACKET);
+        assert_exit(pipe->cmds[iCmd].crcs, "Failed to allocate checksum buffer");
+    }
+}
+
+/**
+ * @brief The crc slots of the packet returned by the last nmc_pipe_get(), NULL if disabled
+ */
+uint32_t *nmc_pipe_crcs(nmc_pipe_t *pipe)
+{
+    nmc_pipe_cmd_t *cmd = pipe->filling;
+    return cmd->crcs ? &cmd->crcs[cmd->npackets * NUM_CHANNELS] : NULL;
+}
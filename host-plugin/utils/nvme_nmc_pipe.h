@@ -0,0 +1,50 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_PIPE_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_PIPE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "nvme_nmc.h"
+
+// Submitter stage of the upload pipeline
+//
+//   placement thread                      submitter thread
+//   nmc_pipe_get() <---- free ring <---- done (sync, or io_uring completion)
+//   nmc_pipe_put() ----> full ring ----> nmc_flush_packet_async()
+//
+// The packet buffers are page-aligned and recycled between the two rings, the
+// placement thread keeps filling packets while the submitter is blocked on the
+// device. While the pipe is open, `config` (slba, uring) is owned by the
+// submitter thread and should not be touched by the caller.
+//
+// Consecutive packets can be coalesced into one IO_NVM_NMC_WRITE, in which
+// case each buffer holds `packetsPerCmd` contiguous packets and the command is
+// sent once all of them are filled (or the pipe is closed).
+//
+// With nmc_pipe_checksum(), the placement stage stores a CRC-32C per flash page
+// into nmc_pipe_crcs() of the packet being filled, the submitter appends them
+// to the manifest and/or sends them as the command metadata.
+//
+// After the first failed command, the submitter stops writing and hands the
+// buffers straight back, so placement never waits on a dead device. It should
+// poll nmc_pipe_error() and stop early, nmc_pipe_close() returns the error.
+
+#define NMC_PIPE_SLACK_CMDS 4 // buffers for placement besides the in-flight ones
+
+typedef struct nmc_pipe nmc_pipe_t;
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+nmc_pipe_t *nmc_pipe_open(nmc_config_t *config, uint32_t ncmds, uint32_t packetsPerCmd);
+int nmc_pipe_close(nmc_pipe_t *pipe);
+int nmc_pipe_error(nmc_pipe_t *pipe);
+
+uint8_t *nmc_pipe_get(nmc_pipe_t *pipe);
+void nmc_pipe_put(nmc_pipe_t *pipe, uint8_t *packet);
+
+void nmc_pipe_checksum(nmc_pipe_t *pipe, FILE *manifest, bool metadata);
+uint32_t *nmc_pipe_crcs(nmc_pipe_t *pipe);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_PIPE_H__ */
@@ -0,0 +1,137 @@
+#include "./nvme_nmc_result.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "./nvme_nmc_uring.h"
+#include "./nvme_nmc_bufpool.h"
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    uint32_t pending;
+    int err;
+    uint32_t total; // reported by the first chunk
+} nmc_result_ctx_t;
+
+static void nmc_result_chunk_done(void *data, int err, uint32_t result, void *arg)
+{
+    nmc_result_ctx_t *ctx = arg;
+    ctx->pending -= 1;
+    ctx->total = result;
+    if (err && !ctx->err)
+        ctx->err = err;
+}
+
+static int nmc_result_wait(nmc_config_t *config, nmc_result_ctx_t *ctx)
+{
+    while (ctx->pending && config->uring)
+    {
+        int err = nmc_uring_reap(config->uring, true);
+        assert_return(err >= 0 || ctx->err, err, "Failed to reap result chunks");
+    }
+    return ctx->err;
+}
+
+static int nmc_result_read_chunk(nmc_config_t *config, nmc_result_ctx_t *ctx, uint8_t *buf,
+                                 uint32_t sz, uint32_t ticket, uint64_t offset)
+{
+    ctx->pending += 1;
+    return nmc_inference_read_async(config, buf, sz, ticket, offset, nmc_result_chunk_done, ctx);
+}
+
+static uint64_t nmc_result_chunk_bytes(nmc_config_t *config, uint64_t chunk)
+{
+    // bounded by the max transfer size, the emulated backends have no such limit
+    uint64_t maxChunk = (uint64_t)nmc_max_packets_per_cmd(*config) * BYTES_PACKET;
+    if (maxChunk > NMC_RESULT_CHUNK_MAX)
+        maxChunk = NMC_RESULT_CHUNK_MAX;
+    if (!chunk || chunk > maxChunk)
+        chunk = maxChunk;
+
+    // whole NVMe blocks, the data length of a command is a multiple of them
+    chunk -= chunk % BYTES_NVME_BLOCK;
+    return chunk ? chunk : BYTES_NVME_BLOCK;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Read the whole result of inference `ticket` into `path` (truncated first)
+ *
+ * @param chunk Bytes per C8, 0 for the max transfer size
+ * @param total Set to the length of the result if not NULL
+ */
+int nmc_result_read(nmc_config_t *config, uint32_t ticket, const char *path, uint64_t chunk,
+                    uint64_t *total)
+{
+    chunk = nmc_result_chunk_bytes(config, chunk);
+
+    // the first chunk tells the length of the whole result
+    nmc_result_ctx_t ctx = {0};
+    uint8_t *head        = nmc_buf_alloc(chunk);
+    assert_return(head, -ENOMEM, "Failed to allocate result buffer");
+
+    int err = nmc_result_read_chunk(config, &ctx, head, chunk, ticket, 0);
+    if (!err)
+        err = nmc_result_wait(config, &ctx);
+    if (err || config->dry)
+    {
+        nmc_buf_free(head);
+        return err;
+    }
+
+    uint64_t len = ctx.total;
+    if (!len)
+    {
+        pr_info("Result length not reported, keep the first %u bytes", NMC_RESULT_BYTES_LEGACY);
+        len = (chunk < NMC_RESULT_BYTES_LEGACY) ? chunk : NMC_RESULT_BYTES_LEGACY;
+    }
+    if (total)
+        *total = len;
+
+    // preallocate, so the chunks never wait on block allocation or hit ENOSPC in a fault
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    err    = (fd >= 0) ? 0 : -errno;
+    assert_goto(!err, failed, "Failed to create '%s' (%s)", path, strerror(-err));
+
+    err = -posix_fallocate(fd, 0, len);
+    if (err == -EOPNOTSUPP || err == -EINVAL)
+        err = ftruncate(fd, len) ? -errno : 0;
+    assert_goto(!err, failed, "Failed to allocate %lu bytes for '%s' (%s)", len, path, strerror(-err));
+
+    uint8_t *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    err          = (map != MAP_FAILED) ? 0 : -errno;
+    assert_goto(!err, failed, "Failed to map '%s' (%s)", path, strerror(-err));
+
+    memcpy(map, head, (len < chunk) ? len : chunk);
+    nmc_buf_free(head);
+    head = NULL;
+
+    // the rest goes straight into the page cache of the file, the mapping covers
+    // the tail up to a page boundary so a rounded up last transfer is safe
+    for (uint64_t off = chunk; off < len && !ctx.err; off += chunk)
+    {
+        uint64_t sz = (len - off < chunk) ? len - off : chunk;
+        sz          = (sz + BYTES_NVME_BLOCK - 1) / BYTES_NVME_BLOCK * BYTES_NVME_BLOCK;
+        nmc_result_read_chunk(config, &ctx, &map[off], sz, ticket, off);
+    }
+    err = nmc_result_wait(config, &ctx);
+
+    munmap(map, len);
+    if (close(fd) && !err)
+        err = -errno;
+    return err;
+
+failed:
+    if (fd >= 0)
+        close(fd);
+    nmc_buf_free(head);
+    return err;
+}
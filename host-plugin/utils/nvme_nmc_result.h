@@ -0,0 +1,28 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_RESULT_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_RESULT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nvme_nmc.h"
+
+// Streaming readback of an inference result into a file
+//
+//   C8(off 0) ---> total length (DW0) ---> fallocate + mmap(path, total)
+//   C8(off k * chunk, chunk) ---> DMA directly into the mapping, k = 1 .. n-1
+//
+// Chunks are bounded by the max transfer size (MDTS) and are all in flight at
+// once on the io_uring engine (up to its qdepth), so a whole-slide mask comes
+// back at device bandwidth with no bounce buffer except for the first chunk.
+
+#define NMC_RESULT_CHUNK_MAX (4UL << 20)
+
+#define NMC_RESULT_OPT_CHUNK(ptr) OPT_SUFFIX("chunk", 'c', ptr, "bytes per result read (0: max transfer size)")
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+int nmc_result_read(nmc_config_t *config, uint32_t ticket, const char *path, uint64_t chunk,
+                    uint64_t *total);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_RESULT_H__ */
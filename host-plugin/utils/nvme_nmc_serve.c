@@ -0,0 +1,197 @@
+#include "nvme_nmc_serve.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "nvme.h"
+#include "nvme_nmc_stats.h"
+#include "debug.h"
+
+typedef enum
+{
+    NMC_SERVE_NEXT,     // wait for the next request on the connection
+    NMC_SERVE_HANGUP,   // close the connection
+    NMC_SERVE_SHUTDOWN, // stop the daemon
+} nmc_serve_state_t;
+
+static volatile sig_atomic_t nmcServeStop = 0;
+
+static void nmc_serve_on_signal(int sig) { nmcServeStop = 1; }
+
+static int nmc_serve_listen(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    assert_return(strlen(path) < sizeof(addr.sun_path), -ENAMETOOLONG, "Socket path too long: '%s'",
+                  path);
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert_return(fd >= 0, -errno, "Failed to create socket (%s)", strerror(errno));
+
+    // a stale socket left by a crashed daemon would fail bind() with EADDRINUSE,
+    // but never steal the socket of a daemon that still accepts. The probe has its own
+    // socket, one that tried to connect() cannot be bound anymore
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        assert_goto(probe >= 0, failed, "Failed to create socket (%s)", strerror(errno));
+        int err = connect(probe, (struct sockaddr *)&addr, sizeof(addr));
+        close(probe);
+        assert_goto(err != 0, busy, "Another daemon is serving on '%s'", path);
+        unlink(path);
+    }
+
+    // jobs run with the rights of the daemon, only the owner may connect
+    mode_t mask = umask(0177);
+    int err     = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    assert_goto(err == 0, failed, "Failed to bind '%s' (%s)", path, strerror(errno));
+
+    err = listen(fd, 4);
+    assert_goto(err == 0, failed, "Failed to listen on '%s' (%s)", path, strerror(errno));
+    return fd;
+
+failed:
+    err = -errno;
+    close(fd);
+    return err;
+
+busy:
+    close(fd);
+    return -EADDRINUSE;
+}
+
+static nmc_serve_state_t nmc_serve_request(char *line, FILE *out, nmc_serve_fn handler, void *arg)
+{
+    char *argv[NMC_SERVE_MAX_ARGS + 1] = {NULL};
+    int argc                           = 0;
+
+    for (char *save, *tok = strtok_r(line, " \t\r\n", &save); tok; tok = strtok_r(NULL, " \t\r\n", &save))
+    {
+        if (argc == NMC_SERVE_MAX_ARGS)
+        {
+            fprintf(out, "err %d too many arguments\n", E2BIG);
+            return NMC_SERVE_NEXT;
+        }
+        argv[argc++] = tok;
+    }
+
+    if (argc == 0)
+        return NMC_SERVE_NEXT;
+    if (!strcmp(argv[0], "quit"))
+    {
+        fprintf(out, "ok\n");
+        return NMC_SERVE_HANGUP;
+    }
+    if (!strcmp(argv[0], "shutdown"))
+    {
+        fprintf(out, "ok\n");
+        return NMC_SERVE_SHUTDOWN;
+    }
+    if (!strcmp(argv[0], "ping"))
+    {
+        fprintf(out, "ok pong\n");
+        return NMC_SERVE_NEXT;
+    }
+
+    uint64_t tStart = nmc_stats_now();
+    int err         = handler(argc, argv, out, arg);
+    double ms       = (nmc_stats_now() - tStart) / 1e6;
+
+    if (err == 0)
+        fprintf(out, "ok %.3fms\n", ms);
+    else if (err < 0)
+        fprintf(out, "err %d %s\n", -err, strerror(-err));
+    else
+        fprintf(out, "err %d %s\n", err, nvme_strerror(err));
+
+    pr_info("serve: %s -> %d (%.3f ms)", argv[0], err, ms);
+    return NMC_SERVE_NEXT;
+}
+
+static nmc_serve_state_t nmc_serve_client(int fd, nmc_serve_fn handler, void *arg)
+{
+    // one stream per direction, a socket cannot seek to switch an r+ stream between them
+    // and its read buffer would hold on to the requests pipelined behind the current one
+    int fdOut = dup(fd);
+    FILE *in  = fdopen(fd, "r");
+    FILE *out = fdOut >= 0 ? fdopen(fdOut, "w") : NULL;
+    if (!in || !out)
+    {
+        if (in)
+            fclose(in);
+        else
+            close(fd);
+        if (out)
+            fclose(out);
+        else if (fdOut >= 0)
+            close(fdOut);
+        return NMC_SERVE_HANGUP;
+    }
+
+    nmc_serve_state_t state = NMC_SERVE_NEXT;
+    char *line              = NULL;
+    size_t cap              = 0;
+
+    // a signal interrupts getline() with EINTR, which ends the connection
+    while (state == NMC_SERVE_NEXT && !nmcServeStop && getline(&line, &cap, in) > 0)
+    {
+        state = nmc_serve_request(line, out, handler, arg);
+        fflush(out);
+    }
+
+    free(line);
+    fclose(out);
+    fclose(in);
+    return state;
+}
+
+/**
+ * @brief Accept clients on `path` until `shutdown`, SIGINT or SIGTERM
+ */
+int nmc_serve_run(const char *path, nmc_serve_fn handler, void *arg)
+{
+    int fd = nmc_serve_listen(path);
+    if (fd < 0)
+        return fd;
+
+    // no SA_RESTART, blocking accept()/getline() must return to check the stop flag
+    struct sigaction sa = {.sa_handler = nmc_serve_on_signal}, saInt, saTerm, saPipe;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &saInt);
+    sigaction(SIGTERM, &sa, &saTerm);
+
+    // a client going away mid-reply must not kill the daemon
+    sigaction(SIGPIPE, &(struct sigaction){.sa_handler = SIG_IGN}, &saPipe);
+
+    pr_info("serve: listening on '%s'", path);
+
+    int err                 = 0;
+    nmcServeStop            = 0;
+    nmc_serve_state_t state = NMC_SERVE_NEXT;
+    while (state != NMC_SERVE_SHUTDOWN && !nmcServeStop)
+    {
+        int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            err = -errno;
+            pr_error("accept() failed (%s)", strerror(errno));
+            break;
+        }
+        state = nmc_serve_client(client, handler, arg);
+    }
+
+    sigaction(SIGINT, &saInt, NULL);
+    sigaction(SIGTERM, &saTerm, NULL);
+    sigaction(SIGPIPE, &saPipe, NULL);
+
+    close(fd);
+    unlink(path);
+    pr_info("serve: stopped");
+    return err;
+}
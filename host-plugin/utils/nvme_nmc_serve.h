@@ -0,0 +1,36 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_SERVE_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_SERVE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Line protocol of the `serve` daemon over a Unix stream socket
+//
+//   client: <verb> [arg...]\n
+//   server: [payload line...]\n
+//           ok [detail]\n | err <errno> <message>\n
+//
+// Clients are served one at a time and may send any number of requests on a
+// connection. `ping`, `quit` (close the connection) and `shutdown` (stop the
+// daemon) are handled here, everything else goes to the handler. SIGINT and
+// SIGTERM stop the daemon after the request in progress.
+
+#define NMC_SERVE_SOCKET_DEFAULT "/tmp/nmc.sock"
+#define NMC_SERVE_MAX_ARGS       8
+#define NMC_SERVE_OPT(path)      OPT_FILE("socket", 'S', path, "unix socket to accept jobs on")
+
+/**
+ * @brief Handle one request, payload lines may be written to `out` before returning
+ *
+ * @return 0 on success or a negative errno (or a positive NVMe status) reported to the client
+ */
+typedef int (*nmc_serve_fn)(int argc, char **argv, FILE *out, void *arg);
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+int nmc_serve_run(const char *path, nmc_serve_fn handler, void *arg);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_SERVE_H__ */
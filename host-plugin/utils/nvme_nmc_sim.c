@@ -0,0 +1,463 @@
+#include "./nvme_nmc_sim.h"
+
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    nmc_sim_param_t param;
+
+    bool mapping;                      // a mapping is opened
+    char name[NMC_FILENAME_MAX_BYTES]; // current mapping
+    nmc_sim_trace_t trace;             // packets of current mapping
+    bool based;                        // firstLba is set by the first write
+    uint64_t firstLba;                 // lowest LBA written to the mapping
+    uint64_t nmappings;
+
+    nmc_sim_report_t upload, read; // accumulated over all mappings
+} nmc_sim_t;
+
+typedef struct
+{
+    const nmc_sim_param_t *param;
+    double tXfer;   // us, one page over a channel bus
+    double tHost;   // us, one packet over the host link
+    double tEngine; // us, one page through the NMC engine
+
+    double busFree[NUM_CHANNELS];
+    double engineFree[NUM_CHANNELS];
+    double dieFree[NUM_CHANNELS * NMC_SIM_MAX_WAYS];
+} nmc_sim_state_t;
+
+static inline double max2(double a, double b) { return (a > b) ? a : b; }
+
+static void nmc_sim_state_init(nmc_sim_state_t *s, const nmc_sim_param_t *param)
+{
+    *s = (nmc_sim_state_t){
+        .param   = param,
+        .tXfer   = BYTES_PER_PAGE / param->bus,  // B / (MB/s) = us
+        .tHost   = BYTES_PACKET / param->host,
+        .tEngine = BYTES_PER_PAGE / BYTES_PER_CYCLE_PER_FC / param->clk,
+    };
+}
+
+static double nmc_sim_state_makespan(const nmc_sim_state_t *s, const double *t, uint32_t n)
+{
+    double makespan = 0;
+    for (uint32_t i = 0; i < n; ++i)
+        makespan = max2(makespan, t[i]);
+    return makespan;
+}
+
+static void nmc_sim_pr_report(const char *what, nmc_sim_report_t r, const nmc_sim_param_t *param)
+{
+    double mbps = r.makespan ? (double)r.npackets * BYTES_PACKET / r.makespan : 0;
+    double dies = r.makespan ? r.dieBusy / r.makespan : 0;
+
+    pr_info("sim: %-14s %8lu packets %10.3f ms %9.1f MB/s, %5.1f/%u dies busy", what, r.npackets,
+            r.makespan / 1000, mbps, dies, NUM_CHANNELS * param->ways);
+}
+
+static void nmc_sim_accumulate(nmc_sim_report_t *acc, nmc_sim_report_t r)
+{
+    acc->npackets += r.npackets;
+    acc->makespan += r.makespan;
+    acc->dieBusy += r.dieBusy;
+}
+
+static void nmc_sim_pr_occupancy(const nmc_sim_trace_t *t)
+{
+    uint64_t bytes[NUM_CHANNELS] = {0}, nempty = 0, nwritten = 0, total = 0, max = 0;
+
+    for (uint64_t pos = 0; pos < t->npackets; ++pos)
+    {
+        if (!t->written[pos])
+            continue;
+
+        nwritten += 1;
+        for (uint32_t iCh = 0; iCh < NUM_CHANNELS; ++iCh)
+        {
+            bytes[iCh] += t->fill[pos][iCh];
+            nempty += !t->fill[pos][iCh];
+        }
+    }
+
+    if (!nwritten)
+        return;
+
+    char line[16 * NUM_CHANNELS];
+    int n = 0;
+    for (uint32_t iCh = 0; iCh < NUM_CHANNELS; ++iCh)
+    {
+        n += snprintf(&line[n], sizeof(line) - n, " %5.1f%%",
+                      100.0 * bytes[iCh] / (nwritten * BYTES_PER_PAGE));
+        total += bytes[iCh];
+        max = (bytes[iCh] > max) ? bytes[iCh] : max;
+    }
+
+    pr_info("sim: occupancy     %s (FC0-%u)", line, NUM_CHANNELS - 1);
+    pr_info("sim: FC imbalance   %.3f (max/mean occupied bytes), %lu/%lu pages padding only",
+            total ? (double)max * NUM_CHANNELS / total : 0, nempty, nwritten * NUM_CHANNELS);
+
+    if (t->nreordered || t->nrewritten || nwritten != t->npackets)
+        pr_info("sim: ordering       %lu packets out of LBA order, %lu rewritten, %lu holes",
+                t->nreordered, t->nrewritten, t->npackets - nwritten);
+}
+
+// bytes up to the last non-zero one, the zero tail of a page is padding
+static uint16_t nmc_sim_page_fill(const uint8_t *page)
+{
+    size_t n = BYTES_PER_PAGE;
+    while (n && !page[n - 1])
+        --n;
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Parse "key=val,..." (keys: tR, tPROG, bus, host, clk, ways) over the defaults
+ */
+int nmc_sim_parse(nmc_sim_param_t *param, const char *spec)
+{
+    *param = (nmc_sim_param_t){
+        .tR    = NMC_SIM_DEFAULT_TR,
+        .tPROG = NMC_SIM_DEFAULT_TPROG,
+        .bus   = NMC_SIM_DEFAULT_BUS,
+        .host  = NMC_SIM_DEFAULT_HOST,
+        .clk   = NMC_SIM_DEFAULT_CLK,
+        .ways  = NMC_SIM_DEFAULT_WAYS,
+    };
+
+    for (const char *p = spec; p && *p;)
+    {
+        char key[16];
+        double val;
+        int n = 0;
+
+        assert_return(sscanf(p, "%15[^=]=%lf%n", key, &val, &n) == 2 && val > 0, -EINVAL,
+                      "Invalid simulator parameter '%s'", p);
+
+        if (!strcmp(key, "tR"))
+            param->tR = val;
+        else if (!strcmp(key, "tPROG"))
+            param->tPROG = val;
+        else if (!strcmp(key, "bus"))
+            param->bus = val;
+        else if (!strcmp(key, "host"))
+            param->host = val;
+        else if (!strcmp(key, "clk"))
+            param->clk = val;
+        else if (!strcmp(key, "ways"))
+            param->ways = (uint32_t)val;
+        else
+            assert_return(0, -EINVAL, "Unknown simulator parameter '%s'", key);
+
+        p += n;
+        p += (*p == ',');
+    }
+
+    assert_return(param->ways >= 1 && param->ways <= NMC_SIM_MAX_WAYS, -EINVAL,
+                  "ways should be in [1, %d]", NMC_SIM_MAX_WAYS);
+    return 0;
+}
+
+/**
+ * @brief Trace `npackets` packets written at position `pos` of the mapping
+ */
+static int nmc_sim_trace_reserve(nmc_sim_trace_t *t, uint64_t npackets)
+{
+    if (npackets > t->cap)
+    {
+        uint64_t cap = t->cap ? t->cap : 1024;
+        while (cap < npackets)
+            cap *= 2;
+
+        void *fill    = realloc(t->fill, cap * sizeof(*t->fill));
+        t->fill       = fill ? fill : t->fill;
+        bool *written = realloc(t->written, cap * sizeof(bool));
+        t->written    = written ? written : t->written;
+        assert_return(fill && written, -ENOMEM, "Failed to grow simulator trace");
+
+        memset(&t->fill[t->cap], 0, (cap - t->cap) * sizeof(*t->fill));
+        memset(&t->written[t->cap], 0, (cap - t->cap) * sizeof(bool));
+        t->cap = cap;
+    }
+    return 0;
+}
+
+// a write below the first position, move the traced positions up by `shift`
+static int nmc_sim_trace_rebase(nmc_sim_trace_t *t, uint64_t shift)
+{
+    int err = nmc_sim_trace_reserve(t, t->npackets + shift);
+    if (err)
+        return err;
+
+    memmove(&t->fill[shift], t->fill, t->npackets * sizeof(*t->fill));
+    memmove(&t->written[shift], t->written, t->npackets * sizeof(bool));
+    memset(t->fill, 0, shift * sizeof(*t->fill));
+    memset(t->written, 0, shift * sizeof(bool));
+
+    for (uint64_t iArrived = 0; iArrived < t->narrived; ++iArrived)
+        t->order[iArrived] += shift;
+    t->npackets += shift;
+    return 0;
+}
+
+/**
+ * @brief Trace `npackets` packets written at position `pos` of the mapping
+ */
+int nmc_sim_trace_packets(nmc_sim_trace_t *t, uint64_t pos, const uint8_t *data, uint32_t npackets)
+{
+    int err = nmc_sim_trace_reserve(t, pos + npackets);
+    if (err)
+        return err;
+
+    if (t->narrived + npackets > t->capOrder)
+    {
+        uint64_t cap = t->capOrder ? t->capOrder : 1024;
+        while (cap < t->narrived + npackets)
+            cap *= 2;
+
+        uint64_t *order = realloc(t->order, cap * sizeof(uint64_t));
+        assert_return(order, -ENOMEM, "Failed to grow simulator trace");
+        t->order    = order;
+        t->capOrder = cap;
+    }
+
+    for (uint32_t iPacket = 0; iPacket < npackets; ++iPacket)
+    {
+        uint64_t p = pos + iPacket;
+
+        if (t->written[p])
+            t->nrewritten += 1;
+        else if (p < t->npackets)
+            t->nreordered += 1;
+
+        const uint8_t *packet = &data[(size_t)iPacket * BYTES_PACKET];
+        for (uint32_t iCh = 0; iCh < NUM_CHANNELS; ++iCh)
+            t->fill[p][iCh] = nmc_sim_page_fill(&packet[iCh * BYTES_PER_PAGE]);
+
+        t->written[p]           = true;
+        t->order[t->narrived++] = p;
+        t->npackets             = (p + 1 > t->npackets) ? p + 1 : t->npackets;
+    }
+
+    return 0;
+}
+
+void nmc_sim_trace_reset(nmc_sim_trace_t *t)
+{
+    free(t->fill);
+    free(t->written);
+    free(t->order);
+    *t = (nmc_sim_trace_t){0};
+}
+
+/**
+ * @brief Predict the time from the first packet leaving the host to the last page programmed
+ *
+ * Every page is programmed, padding or not, in the order the packets arrived.
+ */
+nmc_sim_report_t nmc_sim_upload(const nmc_sim_param_t *param, const nmc_sim_trace_t *trace)
+{
+    nmc_sim_state_t s;
+    nmc_sim_state_init(&s, param);
+
+    nmc_sim_report_t r = {.npackets = trace->narrived};
+    double hostFree    = 0;
+
+    for (uint64_t iArrived = 0; iArrived < trace->narrived; ++iArrived)
+    {
+        // the whole packet is in device DRAM before its pages are dispatched
+        hostFree += s.tHost;
+        uint32_t iWay = trace->order[iArrived] % param->ways;
+
+        for (uint32_t iCh = 0; iCh < NUM_CHANNELS; ++iCh)
+        {
+            double *die  = &s.dieFree[iWay * NUM_CHANNELS + iCh];
+            double start = max2(hostFree, max2(s.busFree[iCh], *die));
+
+            s.busFree[iCh] = start + s.tXfer;
+            *die           = s.busFree[iCh] + param->tPROG;
+            r.dieBusy += s.tXfer + param->tPROG;
+        }
+    }
+
+    r.makespan = nmc_sim_state_makespan(&s, s.dieFree, NUM_CHANNELS * param->ways);
+    return r;
+}
+
+/**
+ * @brief Predict the time to stream the pages of a file from the dies into the NMC engine
+ *
+ * The file is read in LBA order, pages holding only padding are not read, and
+ * the engine spends cycles on the occupied bytes of a page only.
+ */
+nmc_sim_report_t nmc_sim_inference_read(const nmc_sim_param_t *param, const nmc_sim_trace_t *trace)
+{
+    nmc_sim_state_t s;
+    nmc_sim_state_init(&s, param);
+
+    nmc_sim_report_t r = {0};
+
+    for (uint64_t pos = 0; pos < trace->npackets; ++pos)
+    {
+        if (!trace->written[pos])
+            continue;
+
+        uint32_t iWay = pos % param->ways;
+        r.npackets += 1;
+
+        for (uint32_t iCh = 0; iCh < NUM_CHANNELS; ++iCh)
+        {
+            const uint16_t fill = trace->fill[pos][iCh];
+            if (!fill)
+                continue;
+
+            // the page register is held until its occupied bytes are transferred out
+            double *die  = &s.dieFree[iWay * NUM_CHANNELS + iCh];
+            double start = max2(*die + param->tR, s.busFree[iCh]);
+            double tXfer = s.tXfer * fill / BYTES_PER_PAGE;
+
+            r.dieBusy += start + tXfer - *die;
+            s.busFree[iCh]    = start + tXfer;
+            *die              = s.busFree[iCh];
+            s.engineFree[iCh] = max2(s.engineFree[iCh], s.busFree[iCh]) +
+                                s.tEngine * fill / BYTES_PER_PAGE;
+        }
+    }
+
+    r.makespan = nmc_sim_state_makespan(&s, s.engineFree, NUM_CHANNELS);
+    return r;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               backend callbacks                            */
+/* -------------------------------------------------------------------------- */
+
+static void nmc_sim_close_mapping(nmc_sim_t *sim)
+{
+    nmc_sim_report_t up = nmc_sim_upload(&sim->param, &sim->trace);
+    nmc_sim_report_t rd = nmc_sim_inference_read(&sim->param, &sim->trace);
+
+    pr_info("sim: mapping '%s'", sim->name);
+    nmc_sim_pr_report("upload", up, &sim->param);
+    nmc_sim_pr_report("inference read", rd, &sim->param);
+    nmc_sim_pr_occupancy(&sim->trace);
+
+    nmc_sim_accumulate(&sim->upload, up);
+    nmc_sim_accumulate(&sim->read, rd);
+    sim->nmappings += 1;
+    sim->mapping = false;
+    sim->based   = false;
+    nmc_sim_trace_reset(&sim->trace);
+}
+
+// packets are traced at their position in the file, from the lowest LBA written
+static int nmc_sim_write(nmc_sim_t *sim, const nmc_config_t *config)
+{
+    const uint64_t blksPacket = BYTES_PACKET / BYTES_NVME_BLOCK;
+    uint32_t npackets         = config->data_len / BYTES_PACKET;
+
+    if (!sim->based)
+    {
+        sim->firstLba = config->slba;
+        sim->based    = true;
+    }
+
+    if (config->slba < sim->firstLba)
+    {
+        int err = nmc_sim_trace_rebase(&sim->trace, (sim->firstLba - config->slba) / blksPacket);
+        if (err)
+            return err;
+        sim->firstLba = config->slba;
+    }
+
+    return nmc_sim_trace_packets(&sim->trace, (config->slba - sim->firstLba) / blksPacket,
+                                 (const uint8_t *)config->data, npackets);
+}
+
+static int nmc_backend_sim_passthru(nmc_backend_t *be, bool io_cmd, nmc_config_t *config)
+{
+    nmc_sim_t *sim = be->priv;
+
+    if (io_cmd)
+    {
+        switch (config->OPCODE)
+        {
+        case IO_NVM_NMC_ALLOC:
+            memset(sim->name, 0, sizeof(sim->name));
+            if (config->data)
+                strncpy(sim->name, config->data, sizeof(sim->name) - 1);
+            nmc_sim_trace_reset(&sim->trace);
+            sim->based   = false;
+            sim->mapping = true;
+            break;
+        case IO_NVM_NMC_WRITE:
+        {
+            int err = nmc_sim_write(sim, config);
+            if (err)
+                return err;
+            break;
+        }
+        case IO_NVM_NMC_FLUSH:
+            if (sim->mapping)
+                nmc_sim_close_mapping(sim);
+            break;
+        }
+    }
+
+    if (config->OPCODE != IO_NVM_NMC_WRITE && config->OPCODE != IO_NVM_NMC_ALLOC && config->data)
+        memset(config->data, 0, config->data_len);
+
+    config->result = 0;
+    return 0;
+}
+
+static void nmc_backend_sim_close(nmc_backend_t *be)
+{
+    nmc_sim_t *sim = be->priv;
+
+    // packets written without a closing C2 are still reported
+    if (sim->trace.narrived)
+        nmc_sim_close_mapping(sim);
+    nmc_sim_trace_reset(&sim->trace);
+
+    if (sim->nmappings > 1)
+    {
+        pr_info("sim: total of %lu mappings", sim->nmappings);
+        nmc_sim_pr_report("upload", sim->upload, &sim->param);
+        nmc_sim_pr_report("inference read", sim->read, &sim->param);
+    }
+
+    free(sim);
+}
+
+int nmc_backend_sim_init(nmc_backend_t *be, const char *spec)
+{
+    nmc_sim_t *sim = calloc(1, sizeof(nmc_sim_t));
+    assert_return(sim, -ENOMEM, "Failed to allocate simulator");
+
+    int err = nmc_sim_parse(&sim->param, spec);
+    if (err)
+    {
+        free(sim);
+        return err;
+    }
+
+    pr_info("sim: tR=%.1fus tPROG=%.1fus bus=%.0fMB/s host=%.0fMB/s clk=%.0fMHz ways=%u",
+            sim->param.tR, sim->param.tPROG, sim->param.bus, sim->param.host, sim->param.clk,
+            sim->param.ways);
+
+    be->name     = "sim";
+    be->passthru = nmc_backend_sim_passthru;
+    be->close    = nmc_backend_sim_close;
+    be->priv     = sim;
+    return 0;
+}
@@ -0,0 +1,82 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_SIM_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_SIM_H__
+
+#include <stdint.h>
+#include "nvme_nmc_backend.h"
+
+// Flash timing simulator (backend spec "sim[:key=val,...]")
+//
+// Replays the packet stream of each mapping (C1 ... C9 ... C2) against a
+// channel/way model of the flash array and predicts how long the device
+// takes to program it (upload) and to stream it back into the NMC engine
+// (inference read). Commands are otherwise dropped like the null backend.
+//
+//   host ---> DRAM ---> ch bus (tXfer) ---> die (ch, way) tPROG
+//   die tR ---> ch bus (tXfer) ---> NMC engine (BYTES_PER_CYCLE_PER_FC @ clk)
+//
+// Page `ch` of packet k goes to die (ch, k % ways), i.e. VDIE2PCH/VDIE2PWAY
+// of dieNo = (k % ways) * NUM_CHANNELS + ch, where k is the position of the
+// packet in the file (its LBA from the lowest one written to the mapping).
+//
+// The payload is what tells placement policies apart: every page written is
+// traced with its occupied bytes (the zero tail is taken as padding). Upload
+// programs whole pages in the order they arrive. Inference read streams the
+// file in LBA order, skips pages with nothing but padding, and moves only the
+// occupied bytes of a page over the bus and through the engine, so an FC
+// holding more of the data finishes last. Writes out of LBA order, rewrites of
+// a position and holes are counted. Compare policies by the predicted time, the average
+// number of busy dies and the per-FC occupancy.
+
+#define NMC_SIM_DEFAULT_TR     50.0   // us, page read
+#define NMC_SIM_DEFAULT_TPROG  600.0  // us, page program
+#define NMC_SIM_DEFAULT_BUS    200.0  // MB/s, per channel bus
+#define NMC_SIM_DEFAULT_HOST   3200.0 // MB/s, host link
+#define NMC_SIM_DEFAULT_CLK    100.0  // MHz, NMC engine
+#define NMC_SIM_DEFAULT_WAYS   8
+#define NMC_SIM_MAX_WAYS       64
+
+typedef struct
+{
+    double tR, tPROG; // us
+    double bus, host; // MB/s
+    double clk;       // MHz
+    uint32_t ways;
+} nmc_sim_param_t;
+
+typedef struct
+{
+    uint64_t npackets;
+    double makespan; // us
+    double dieBusy;  // us, summed over all dies
+} nmc_sim_report_t;
+
+// the packets of a mapping as written, by position (LBA from its lowest write)
+typedef struct
+{
+    uint64_t npackets;              // positions, up to the highest written
+    uint16_t (*fill)[NUM_CHANNELS]; // occupied bytes of each page
+    bool *written;
+    uint64_t cap;
+
+    uint64_t *order; // positions in arrival order
+    uint64_t narrived, capOrder;
+
+    uint64_t nreordered; // arrived below the highest position so far
+    uint64_t nrewritten; // arrived at a position already written
+} nmc_sim_trace_t;
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+int nmc_sim_parse(nmc_sim_param_t *param, const char *spec);
+int nmc_sim_trace_packets(nmc_sim_trace_t *trace, uint64_t pos, const uint8_t *data,
+                          uint32_t npackets);
+void nmc_sim_trace_reset(nmc_sim_trace_t *trace);
+nmc_sim_report_t nmc_sim_upload(const nmc_sim_param_t *param, const nmc_sim_trace_t *trace);
+nmc_sim_report_t nmc_sim_inference_read(const nmc_sim_param_t *param,
+                                        const nmc_sim_trace_t *trace);
+
+int nmc_backend_sim_init(nmc_backend_t *be, const char *spec);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_SIM_H__ */
@@ -0,0 +1,185 @@
+#include "./nvme_nmc_stats.h"
+
+#include <pthread.h>
+
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    bool io_cmd;
+    uint8_t opcode;
+    int status; // NVMe status if > 0, -errno if the command did not complete
+
+    uint64_t count, sum, min, max; // ns
+    uint64_t buckets[NMC_STATS_NBUCKETS];
+} nmc_stats_hist_t;
+
+static struct
+{
+    pthread_mutex_t lock;
+    uint32_t nkeys;
+    nmc_stats_hist_t *hists[NMC_STATS_MAX_KEYS];
+} stats = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static inline uint32_t nmc_stats_bucket(uint64_t ns)
+{
+    if (ns < NMC_STATS_SUB)
+        return (uint32_t)ns;
+
+    uint32_t shift = 63 - __builtin_clzll(ns) - NMC_STATS_SUB_BITS;
+    return ((shift + 1) << NMC_STATS_SUB_BITS) + ((ns >> shift) & (NMC_STATS_SUB - 1));
+}
+
+// the highest latency falls into the bucket
+static inline uint64_t nmc_stats_bucket_value(uint32_t iBucket)
+{
+    if (iBucket < NMC_STATS_SUB)
+        return iBucket;
+
+    uint32_t shift = (iBucket >> NMC_STATS_SUB_BITS) - 1;
+    uint64_t sub   = NMC_STATS_SUB + (iBucket & (NMC_STATS_SUB - 1));
+    return ((sub + 1) << shift) - 1;
+}
+
+static uint64_t nmc_stats_percentile(const nmc_stats_hist_t *h, double p)
+{
+    uint64_t target = (uint64_t)(p * h->count + 0.5);
+    if (target == 0)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (uint32_t iBucket = 0; iBucket < NMC_STATS_NBUCKETS; ++iBucket)
+    {
+        seen += h->buckets[iBucket];
+        if (seen >= target)
+        {
+            uint64_t v = nmc_stats_bucket_value(iBucket);
+            return (v < h->max) ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+static nmc_stats_hist_t *nmc_stats_find(bool io_cmd, uint8_t opcode, int status)
+{
+    for (uint32_t iKey = 0; iKey < stats.nkeys; ++iKey)
+    {
+        nmc_stats_hist_t *h = stats.hists[iKey];
+        if (h->io_cmd == io_cmd && h->opcode == opcode && h->status == status)
+            return h;
+    }
+
+    if (stats.nkeys == NMC_STATS_MAX_KEYS)
+        return NULL;
+
+    nmc_stats_hist_t *h = calloc(1, sizeof(nmc_stats_hist_t));
+    if (!h)
+        return NULL;
+
+    *h = (nmc_stats_hist_t){.io_cmd = io_cmd, .opcode = opcode, .status = status, .min = UINT64_MAX};
+    stats.hists[stats.nkeys++] = h;
+    return h;
+}
+
+static void nmc_stats_dump_json(FILE *fp)
+{
+    fprintf(fp, "{\n  \"unit\": \"us\",\n  \"commands\": [");
+    for (uint32_t iKey = 0; iKey < stats.nkeys; ++iKey)
+    {
+        const nmc_stats_hist_t *h = stats.hists[iKey];
+
+        fprintf(fp, "%s\n    {\"type\": \"%s\", \"opcode\": \"0x%02x\", \"status\": %d, \"errno\": %d, ",
+                iKey ? "," : "", h->io_cmd ? "io" : "admin", h->opcode,
+                h->status > 0 ? h->status : 0, h->status < 0 ? -h->status : 0);
+        fprintf(fp, "\"count\": %lu, \"mean\": %.3f, \"min\": %.3f, ", h->count,
+                h->sum / 1e3 / h->count, h->min / 1e3);
+        fprintf(fp, "\"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f,\n",
+                nmc_stats_percentile(h, 0.5) / 1e3, nmc_stats_percentile(h, 0.99) / 1e3,
+                nmc_stats_percentile(h, 0.999) / 1e3, h->max / 1e3);
+
+        // non-empty buckets as [highest latency, count], enough to rebuild the histogram
+        fprintf(fp, "     \"buckets\": [");
+        for (uint32_t iBucket = 0, n = 0; iBucket < NMC_STATS_NBUCKETS; ++iBucket)
+            if (h->buckets[iBucket])
+                fprintf(fp, "%s[%.3f, %lu]", n++ ? ", " : "",
+                        nmc_stats_bucket_value(iBucket) / 1e3, h->buckets[iBucket]);
+        fprintf(fp, "]}");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+void nmc_stats_record(bool io_cmd, uint8_t opcode, int status, uint64_t ns)
+{
+    pthread_mutex_lock(&stats.lock);
+
+    nmc_stats_hist_t *h = nmc_stats_find(io_cmd, opcode, status);
+    if (h)
+    {
+        h->count += 1;
+        h->sum += ns;
+        h->min = (ns < h->min) ? ns : h->min;
+        h->max = (ns > h->max) ? ns : h->max;
+        h->buckets[nmc_stats_bucket(ns)] += 1;
+    }
+
+    pthread_mutex_unlock(&stats.lock);
+}
+
+/**
+ * @brief Print the latency summary of every (opcode, status), and the JSON if requested
+ *
+ * @param jsonPath Path of the JSON output, "-" for stdout, NULL for none
+ */
+void nmc_stats_report(const char *jsonPath)
+{
+    pthread_mutex_lock(&stats.lock);
+
+    for (uint32_t iKey = 0; iKey < stats.nkeys; ++iKey)
+    {
+        const nmc_stats_hist_t *h = stats.hists[iKey];
+
+        char status[16];
+        if (h->status < 0)
+            snprintf(status, sizeof(status), "errno=%d", -h->status);
+        else
+            snprintf(status, sizeof(status), "sc=0x%04x", h->status);
+
+        pr_info("latency: %-5s op=0x%02x %-10s n=%-8lu p50=%9.1fus p99=%9.1fus "
+                "p999=%9.1fus max=%9.1fus",
+                h->io_cmd ? "io" : "admin", h->opcode, status, h->count,
+                nmc_stats_percentile(h, 0.5) / 1e3, nmc_stats_percentile(h, 0.99) / 1e3,
+                nmc_stats_percentile(h, 0.999) / 1e3, h->max / 1e3);
+    }
+
+    if (jsonPath)
+    {
+        FILE *fp = strcmp(jsonPath, "-") ? fopen(jsonPath, "w") : stdout;
+        if (fp)
+        {
+            nmc_stats_dump_json(fp);
+            if (fp != stdout)
+                fclose(fp);
+        }
+        else
+            pr_error("Failed to open '%s' (%s)", jsonPath, strerror(errno));
+    }
+
+    pthread_mutex_unlock(&stats.lock);
+}
+
+void nmc_stats_reset(void)
+{
+    pthread_mutex_lock(&stats.lock);
+    for (uint32_t iKey = 0; iKey < stats.nkeys; ++iKey)
+        free(stats.hists[iKey]);
+    stats.nkeys = 0;
+    pthread_mutex_unlock(&stats.lock);
+}
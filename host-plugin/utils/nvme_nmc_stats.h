@@ -0,0 +1,40 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_STATS_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_STATS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Latency histograms of passthru commands, keyed by (io/admin, opcode, status)
+// where status is the NVMe status, or -errno of a command that did not complete
+// (reported apart as "errno").
+//
+// HDR-style log-linear buckets: each power of two of nanoseconds is split into
+// 2^NMC_STATS_SUB_BITS linear sub-buckets, so a recorded latency is off by at
+// most 1/32 (~3%) from 1 ns up to hours, at a fixed 15 KiB per key. Recording
+// is thread-safe (the writer, the verifier and the io_uring reaper share it).
+
+#define NMC_STATS_SUB_BITS 5
+#define NMC_STATS_SUB      (1U << NMC_STATS_SUB_BITS)
+#define NMC_STATS_NBUCKETS ((64 - NMC_STATS_SUB_BITS + 1) * NMC_STATS_SUB)
+#define NMC_STATS_MAX_KEYS 64
+
+#define NMC_STATS_OPT(path)                                                                      \
+    OPT_FILE("stats-json", 'J', path, "dump per-opcode latency histograms as JSON ('-': stdout)")
+
+static inline uint64_t nmc_stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+void nmc_stats_record(bool io_cmd, uint8_t opcode, int status, uint64_t ns);
+void nmc_stats_report(const char *jsonPath);
+void nmc_stats_reset(void);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_STATS_H__ */
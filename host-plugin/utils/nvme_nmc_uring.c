@@ -0,0 +1,368 @@
+#include "./nvme_nmc_uring.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/nvme_ioctl.h>
+
+#include "./nvme_nmc_bufpool.h"
+#include "./nvme_nmc_stats.h"
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+// NVMe passthru needs the big SQE/CQE format (the command lives in sqe->cmd)
+#define NMC_URING_SETUP_FLAGS (IORING_SETUP_SQE128 | IORING_SETUP_CQE32)
+#define NMC_URING_SQE_SZ      (sizeof(struct io_uring_sqe) * 2)
+#define NMC_URING_CQE_SZ      (sizeof(struct io_uring_cqe) * 2)
+
+typedef struct
+{
+    nmc_done_fn done;
+    void *arg;
+    void *data;
+    bool io_cmd;
+    bool busy;
+    uint8_t opcode;
+    uint64_t tSubmit; // ns, for the latency histograms
+} nmc_uring_slot_t;
+
+struct nmc_uring
+{
+    int fd;   // io_uring instance
+    int ngfd; // NVMe generic char device
+
+    uint32_t qdepth;
+    uint32_t inflight;
+    bool fixed; // buffer pool registered as fixed buffers
+    int err;    // fatal io_uring_enter error, the engine accepts no more commands
+
+    // submission queue
+    void *sqRing;
+    size_t sqRingSz;
+    uint8_t *sqes;
+    size_t sqesSz;
+    uint32_t *sqHead, *sqTail, *sqMask, *sqArray;
+
+    // completion queue
+    void *cqRing;
+    size_t cqRingSz;
+    uint32_t *cqHead, *cqTail, *cqMask;
+    uint8_t *cqes;
+
+    // in-flight commands (indexed by sqe->user_data)
+    uint32_t nFreeSlots;
+    uint32_t *freeSlots;
+    nmc_uring_slot_t slots[];
+};
+
+static inline int sys_io_uring_setup(uint32_t entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, uint32_t submit, uint32_t wait, uint32_t flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static inline int sys_io_uring_register(int fd, uint32_t opcode, const void *arg, uint32_t nargs)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+/**
+ * @brief Fail all in-flight commands with `err` after a fatal io_uring_enter error
+ *
+ * Their completions can not be reaped anymore, so the slots are released and the
+ * callbacks invoked here to hand the buffers back.
+ */
+static void nmc_uring_fail_inflight(struct nmc_uring *ring, int err)
+{
+    ring->err = err;
+
+    for (uint32_t iSlot = 0; iSlot < ring->qdepth; ++iSlot)
+    {
+        nmc_uring_slot_t slot = ring->slots[iSlot];
+        if (!slot.busy)
+            continue;
+
+        ring->slots[iSlot].busy             = false;
+        ring->freeSlots[ring->nFreeSlots++] = iSlot;
+        ring->inflight -= 1;
+
+        nmc_stats_record(slot.io_cmd, slot.opcode, err, nmc_stats_now() - slot.tSubmit);
+        if (slot.done)
+            slot.done(slot.data, err, 0, slot.arg);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+struct nmc_uring *nmc_uring_open(const char *ngdev, uint32_t qdepth)
+{
+    assert_return(qdepth > 0 && qdepth <= NMC_URING_QDEPTH_MAX, NULL, "Invalid qdepth %u", qdepth);
+
+    struct nmc_uring *ring = calloc(1, sizeof(*ring) + qdepth * sizeof(nmc_uring_slot_t));
+    assert_return(ring, NULL, "Failed to allocate io_uring context");
+
+    ring->fd        = -1;
+    ring->ngfd      = -1;
+    ring->qdepth    = qdepth;
+    ring->freeSlots = calloc(qdepth, sizeof(uint32_t));
+    assert_goto(ring->freeSlots, failed, "Failed to allocate io_uring slots");
+
+    for (uint32_t iSlot = 0; iSlot < qdepth; ++iSlot)
+        ring->freeSlots[ring->nFreeSlots++] = qdepth - 1 - iSlot;
+
+    ring->ngfd = open(ngdev, O_RDWR);
+    assert_goto(ring->ngfd >= 0, failed, "Failed to open '%s' (%s)", ngdev, strerror(errno));
+
+    struct io_uring_params p = {.flags = NMC_URING_SETUP_FLAGS};
+    ring->fd                 = sys_io_uring_setup(qdepth, &p);
+    assert_goto(ring->fd >= 0, failed, "io_uring_setup failed (%s)", strerror(errno));
+
+    // map submission queue, completion queue and SQE array
+    ring->sqRingSz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    ring->cqRingSz = p.cq_off.cqes + p.cq_entries * NMC_URING_CQE_SZ;
+    ring->sqesSz   = p.sq_entries * NMC_URING_SQE_SZ;
+
+    ring->sqRing = mmap(NULL, ring->sqRingSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    ring->cqRing = mmap(NULL, ring->cqRingSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes   = mmap(NULL, ring->sqesSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQES);
+    assert_goto(ring->sqRing != MAP_FAILED && ring->cqRing != MAP_FAILED && ring->sqes != MAP_FAILED,
+                failed, "Failed to map io_uring queues (%s)", strerror(errno));
+
+    ring->sqHead  = (uint32_t *)((uint8_t *)ring->sqRing + p.sq_off.head);
+    ring->sqTail  = (uint32_t *)((uint8_t *)ring->sqRing + p.sq_off.tail);
+    ring->sqMask  = (uint32_t *)((uint8_t *)ring->sqRing + p.sq_off.ring_mask);
+    ring->sqArray = (uint32_t *)((uint8_t *)ring->sqRing + p.sq_off.array);
+
+    ring->cqHead = (uint32_t *)((uint8_t *)ring->cqRing + p.cq_off.head);
+    ring->cqTail = (uint32_t *)((uint8_t *)ring->cqRing + p.cq_off.tail);
+    ring->cqMask = (uint32_t *)((uint8_t *)ring->cqRing + p.cq_off.ring_mask);
+    ring->cqes   = (uint8_t *)ring->cqRing + p.cq_off.cqes;
+
+    pr_info("io_uring passthru on '%s' (qdepth=%u)", ngdev, qdepth);
+    return ring;
+
+failed:
+    nmc_uring_close(ring);
+    return NULL;
+}
+
+void nmc_uring_close(struct nmc_uring *ring)
+{
+    if (!ring)
+        return;
+
+    if (ring->inflight)
+        nmc_uring_drain(ring);
+
+    if (ring->sqRing && ring->sqRing != MAP_FAILED)
+        munmap(ring->sqRing, ring->sqRingSz);
+    if (ring->cqRing && ring->cqRing != MAP_FAILED)
+        munmap(ring->cqRing, ring->cqRingSz);
+    if (ring->sqes && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqesSz);
+
+    if (ring->fd >= 0)
+        close(ring->fd);
+    if (ring->ngfd >= 0)
+        close(ring->ngfd);
+
+    free(ring->freeSlots);
+    free(ring);
+}
+
+int nmc_uring_submit(struct nmc_uring *ring, bool io_cmd, const nmc_config_t *config,
+                     nmc_done_fn done, void *arg)
+{
+    // queue full, wait for the oldest commands to complete
+    while (ring->inflight == ring->qdepth && !ring->err)
+        nmc_uring_reap(ring, true);
+
+    int err = ring->err;
+    assert_goto(!err, failed, "io_uring engine is down (%s)", strerror(-err));
+
+    uint32_t iSlot     = ring->freeSlots[--ring->nFreeSlots];
+    ring->slots[iSlot] = (nmc_uring_slot_t){
+        .done    = done,
+        .arg     = arg,
+        .data    = config->data,
+        .io_cmd  = io_cmd,
+        .busy    = true,
+        .opcode  = config->OPCODE,
+        .tSubmit = nmc_stats_now(),
+    };
+    ring->inflight += 1;
+
+    // fill the sqe at the tail of submission queue
+    uint32_t tail            = *ring->sqTail;
+    uint32_t idx             = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)&ring->sqes[idx * NMC_URING_SQE_SZ];
+
+    memset(sqe, 0, NMC_URING_SQE_SZ);
+    sqe->opcode    = IORING_OP_URING_CMD;
+    sqe->fd        = ring->ngfd;
+    sqe->cmd_op    = io_cmd ? NVME_URING_CMD_IO : NVME_URING_CMD_ADMIN;
+    sqe->user_data = iSlot;
+
+    struct nvme_uring_cmd *cmd = (struct nvme_uring_cmd *)sqe->cmd;
+    *cmd                       = (struct nvme_uring_cmd){
+        .opcode       = config->OPCODE,
+        .flags        = config->flags,
+        .rsvd1        = config->rsvd,
+        .nsid         = config->NSID,
+        .cdw2         = config->cdw02,
+        .cdw3         = config->cdw03,
+        .metadata     = (uintptr_t)config->metadata,
+        .addr         = (uintptr_t)config->data,
+        .metadata_len = config->metadata_len,
+        .data_len     = config->data_len,
+        .cdw10        = config->cdw10,
+        .cdw11        = config->cdw11,
+        .cdw12        = config->cdw12,
+        .cdw13        = config->cdw13,
+        .cdw14        = config->cdw14,
+        .cdw15        = config->cdw15,
+        .timeout_ms   = config->timeout_ms,
+    };
+
+    // commands on the registered pool skip the per-IO page pinning
+    uint16_t iBuf;
+    if (ring->fixed && nmc_bufpool_lookup(config->data, config->data_len, &iBuf))
+    {
+        sqe->uring_cmd_flags = IORING_URING_CMD_FIXED;
+        sqe->buf_index       = iBuf;
+    }
+
+    ring->sqArray[idx] = idx;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    int ret = sys_io_uring_enter(ring->fd, 1, 0, 0);
+    err     = (ret < 0) ? -errno : -EAGAIN;
+
+    // the kernel took the sqe, its completion releases the slot
+    if (ret == 1 || __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) != tail)
+        return 0;
+
+    // not submitted, take back the sqe and the slot so the queue does not shrink
+    __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+    ring->slots[iSlot].busy             = false;
+    ring->freeSlots[ring->nFreeSlots++] = iSlot;
+    ring->inflight -= 1;
+
+    pr_error("io_uring_enter failed (%s)", strerror(-err));
+
+failed:
+    if (done)
+        done(config->data, err, 0, arg);
+    return err;
+}
+
+/**
+ * @brief Reap all completed commands and invoke their callbacks
+ *
+ * @param ring The submission engine
+ * @param wait Block until at least one command completes (if any in-flight)
+ * @return The first non-zero status among reaped commands, or 0. On a fatal
+ *         io_uring_enter error, all in-flight commands fail with it and it is
+ *         returned (also by any later call).
+ */
+int nmc_uring_reap(struct nmc_uring *ring, bool wait)
+{
+    int status = 0;
+
+    if (ring->err || !ring->inflight)
+        return ring->err;
+
+    uint32_t head = *ring->cqHead;
+    while (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+    {
+        if (!wait)
+            return 0;
+
+        if (sys_io_uring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            int err = -errno;
+            pr_error("io_uring_enter failed (%s)", strerror(-err));
+            nmc_uring_fail_inflight(ring, err);
+            return err;
+        }
+    }
+
+    for (; head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE); ++head)
+    {
+        struct io_uring_cqe *cqe =
+            (struct io_uring_cqe *)&ring->cqes[(head & *ring->cqMask) * NMC_URING_CQE_SZ];
+
+        uint32_t iSlot        = (uint32_t)cqe->user_data;
+        nmc_uring_slot_t slot = ring->slots[iSlot];
+        int err               = cqe->res; // <0: -errno, >0: NVMe status
+        uint32_t result       = (uint32_t)cqe->big_cqe[0];
+
+        if (slot.io_cmd && err == NMC_SC_SUCCESS)
+            err = 0;
+
+        nmc_stats_record(slot.io_cmd, slot.opcode, err, nmc_stats_now() - slot.tSubmit);
+
+        // release the cqe and slot first, the callback may submit new commands
+        __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+        ring->slots[iSlot].busy             = false;
+        ring->freeSlots[ring->nFreeSlots++] = iSlot;
+        ring->inflight -= 1;
+
+        if (err)
+            nmc_report_status(slot.io_cmd, err, result);
+        if (err && !status)
+            status = err;
+
+        if (slot.done)
+            slot.done(slot.data, err, result, slot.arg);
+    }
+
+    return status;
+}
+
+int nmc_uring_drain(struct nmc_uring *ring)
+{
+    int status = 0;
+    while (ring->inflight && !ring->err)
+    {
+        int err = nmc_uring_reap(ring, true);
+        if (err && !status)
+            status = err;
+    }
+    return status ? status : ring->err;
+}
+
+/**
+ * @brief Register the buffer pool (nvme_nmc_bufpool.h) as fixed buffers
+ *
+ * Needs NVMe passthru fixed buffer support (Linux 6.1) and enough RLIMIT_MEMLOCK.
+ */
+int nmc_uring_register_buffers(struct nmc_uring *ring)
+{
+    const struct iovec *iov;
+    int niov = nmc_bufpool_iovecs(&iov);
+    assert_return(niov > 0, -EINVAL, "Buffer pool not initialized");
+
+    int ret = sys_io_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iov, niov);
+    assert_return(ret == 0, -errno, "Failed to register fixed buffers (%s)", strerror(errno));
+
+    ring->fixed = true;
+    pr_info("io_uring: %d fixed buffers registered", niov);
+    return 0;
+}
+
+uint32_t nmc_uring_inflight(const struct nmc_uring *ring) { return ring->inflight; }
+uint32_t nmc_uring_qdepth(const struct nmc_uring *ring) { return ring->qdepth; }
@@ -0,0 +1,38 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_URING_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_URING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nvme_nmc.h"
+
+// Asynchronous submission engine for NMC commands
+//
+//   placement ---> nmc_uring_submit() ---> SQ ---> /dev/ngXnY (IORING_OP_URING_CMD)
+//                        ^                                   |
+//                        |  (blocks only when qdepth reached) v
+//   done(data, err) <--- nmc_uring_reap() <------------------ CQ
+//
+// The data buffer of a submitted command is owned by the engine until its
+// `done` callback (nmc_done_fn, see nvme_nmc.h) is invoked, the callback is
+// always called on the thread that submits/reaps, so no locking is needed.
+
+#define NMC_URING_QDEPTH_DEFAULT 1  // 1 means synchronous passthru (legacy behavior)
+#define NMC_URING_QDEPTH_MAX     256
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+struct nmc_uring *nmc_uring_open(const char *ngdev, uint32_t qdepth);
+void nmc_uring_close(struct nmc_uring *ring);
+
+int nmc_uring_submit(struct nmc_uring *ring, bool io_cmd, const nmc_config_t *config,
+                     nmc_done_fn done, void *arg);
+int nmc_uring_reap(struct nmc_uring *ring, bool wait);
+int nmc_uring_drain(struct nmc_uring *ring);
+int nmc_uring_register_buffers(struct nmc_uring *ring);
+
+uint32_t nmc_uring_inflight(const struct nmc_uring *ring);
+uint32_t nmc_uring_qdepth(const struct nmc_uring *ring);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_URING_H__ */
@@ -0,0 +1,221 @@
+#include "./nvme_nmc_verify.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#include "./nvme_nmc_backend.h"
+#include "./spsc_ring.h"
+#include "./nvme_nmc_bufpool.h"
+#include "./debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+typedef struct
+{
+    uint64_t slba;
+    uint64_t checksum;
+} nmc_verify_sample_t;
+
+typedef struct
+{
+    uint64_t slba;
+    uint64_t expected, actual;
+} nmc_verify_mismatch_t;
+
+struct nmc_verify
+{
+    nmc_config_t config; // snapshot of the write config, used for reads
+    pthread_t verifier;
+
+    uint32_t every;
+    bool random;
+    uint32_t seed;
+
+    // producer side (thread completing the writes)
+    uint64_t npackets, nsampled, ndropped;
+    uint32_t iSample;
+    nmc_verify_sample_t *samples;
+    spsc_ring_t ring;
+
+    // consumer side (verifier thread)
+    uint64_t nverified, nmismatched, nfailed;
+    nmc_verify_mismatch_t mismatches[NMC_VERIFY_MAX_REPORT];
+};
+
+/**
+ * @brief Fletcher-like checksum over 4 x 64-bit lanes (vectorized by the compiler)
+ *
+ * The running sum of sums makes the checksum sensitive to the order of the
+ * 32-byte words, a swapped or shifted page does not go unnoticed.
+ */
+static uint64_t nmc_verify_checksum(const uint8_t *data, size_t len)
+{
+    typedef uint64_t v4u64 __attribute__((vector_size(32)));
+
+    v4u64 a = {0}, b = {0};
+    for (size_t iByte = 0; iByte + sizeof(v4u64) <= len; iByte += sizeof(v4u64))
+    {
+        v4u64 v;
+        memcpy(&v, &data[iByte], sizeof(v));
+        a += v;
+        b += a;
+    }
+
+    uint64_t sum = 0;
+    for (int iLane = 0; iLane < 4; ++iLane)
+        sum = (sum ^ a[iLane]) * 0x100000001b3ULL ^ b[iLane];
+    return sum;
+}
+
+static bool nmc_verify_pick(struct nmc_verify *v)
+{
+    if (v->random)
+        return (rand_r(&v->seed) % v->every) == 0;
+
+    bool pick  = (v->iSample == 0);
+    v->iSample = (v->iSample + 1 == v->every) ? 0 : v->iSample + 1;
+    return pick;
+}
+
+static void nmc_verify_check(struct nmc_verify *v, const nmc_verify_sample_t *s, uint8_t *buf)
+{
+    nmc_config_t cfg = v->config;
+
+    cfg.OPCODE   = IO_NVM_READ;
+    cfg.slba     = s->slba;
+    cfg.data     = (char *)buf;
+    cfg.data_len = BYTES_PACKET;
+    cfg.nlb      = BYTES_PACKET / BYTES_NVME_BLOCK - 1;
+
+    int err = nmc_send_passthru(true, cfg);
+    if (err)
+    {
+        v->nfailed += 1;
+        return;
+    }
+
+    v->nverified += 1;
+    uint64_t actual = nmc_verify_checksum(buf, BYTES_PACKET);
+    if (actual != s->checksum)
+    {
+        if (v->nmismatched < NMC_VERIFY_MAX_REPORT)
+            v->mismatches[v->nmismatched] = (nmc_verify_mismatch_t){s->slba, s->checksum, actual};
+        v->nmismatched += 1;
+    }
+}
+
+static void *nmc_verify_thread(void *arg)
+{
+    struct nmc_verify *v = arg;
+
+    uint8_t *buf = nmc_buf_alloc(BYTES_PACKET);
+    assert_exit(buf, "Failed to allocate read-back buffer");
+
+    for (nmc_verify_sample_t *s; (s = spsc_ring_pop(&v->ring));)
+    {
+        nmc_verify_sample_t sample = *s;
+        nmc_verify_check(v, &sample, buf);
+    }
+
+    nmc_buf_free(buf);
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start the background verifier, NULL if disabled (every == 0 or dry run)
+ */
+struct nmc_verify *nmc_verify_open(const nmc_config_t *config, uint32_t every, bool random)
+{
+    if (!every || config->dry)
+        return NULL;
+
+    if (config->backend && !config->backend->readable)
+    {
+        pr_info("verify: backend '%s' cannot read back, verification disabled",
+                config->backend->name);
+        return NULL;
+    }
+
+    struct nmc_verify *v = calloc(1, sizeof(struct nmc_verify));
+    assert_return(v, NULL, "Failed to allocate verifier");
+
+    v->config        = *config;
+    v->config.uring  = NULL;
+    v->config.verify = NULL;
+    v->every         = every;
+    v->random        = random;
+    v->seed          = (uint32_t)time(NULL);
+
+    // a sample slot is reused once the ring has wrapped, hence twice the ring size
+    v->samples = calloc(NMC_VERIFY_QDEPTH * 2, sizeof(nmc_verify_sample_t));
+    assert_exit(v->samples, "Failed to allocate verify samples");
+    assert_exit(spsc_ring_init(&v->ring, NMC_VERIFY_QDEPTH), "Failed to allocate verify ring");
+
+    int err = pthread_create(&v->verifier, NULL, nmc_verify_thread, v);
+    assert_exit(!err, "Failed to create verifier thread (%s)", strerror(err));
+
+    pr_info("verify: read back %s1-in-%u packets", random ? "random " : "", every);
+    return v;
+}
+
+/**
+ * @brief Wait for the pending samples and report
+ *
+ * @return -EIO if any sampled packet mismatched or failed to read back, otherwise 0
+ */
+int nmc_verify_close(struct nmc_verify *v)
+{
+    if (!v)
+        return 0;
+
+    spsc_ring_close(&v->ring);
+    pthread_join(v->verifier, NULL);
+
+    pr_info("verify: %lu packets, %lu sampled, %lu dropped, %lu verified, %lu mismatched, "
+            "%lu read errors",
+            v->npackets, v->nsampled, v->ndropped, v->nverified, v->nmismatched, v->nfailed);
+
+    for (uint64_t iMis = 0; iMis < v->nmismatched && iMis < NMC_VERIFY_MAX_REPORT; ++iMis)
+        pr_error("verify: mismatch at slba 0x%lx (checksum 0x%016lx != 0x%016lx)",
+                 v->mismatches[iMis].slba, v->mismatches[iMis].actual, v->mismatches[iMis].expected);
+
+    int err = (v->nmismatched || v->nfailed) ? -EIO : 0;
+
+    spsc_ring_free(&v->ring);
+    free(v->samples);
+    free(v);
+    return err;
+}
+
+/**
+ * @brief Sample the packets of a completed write (the buffer is not kept)
+ *
+ * Must be called from a single thread, the one completing the writes.
+ */
+void nmc_verify_packets(struct nmc_verify *v, uint64_t slba, const uint8_t *data,
+                        uint32_t npackets)
+{
+    for (uint32_t iPacket = 0; iPacket < npackets; ++iPacket)
+    {
+        v->npackets += 1;
+        if (!nmc_verify_pick(v))
+            continue;
+
+        nmc_verify_sample_t *s = &v->samples[v->nsampled % (NMC_VERIFY_QDEPTH * 2)];
+        *s                     = (nmc_verify_sample_t){
+            .slba     = slba + (uint64_t)iPacket * (BYTES_PACKET / BYTES_NVME_BLOCK),
+            .checksum = nmc_verify_checksum(&data[(size_t)iPacket * BYTES_PACKET], BYTES_PACKET),
+        };
+
+        if (spsc_ring_try_push(&v->ring, s))
+            v->nsampled += 1;
+        else
+            v->ndropped += 1;
+    }
+}
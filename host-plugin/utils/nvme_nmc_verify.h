@@ -0,0 +1,35 @@
+#ifndef __NMC_HOST_PLUGIN_NVME_NMC_VERIFY_H__
+#define __NMC_HOST_PLUGIN_NVME_NMC_VERIFY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nvme_nmc.h"
+
+// Sampled background read-back of written packets
+//
+//   write done ---> nmc_verify_packets() ---> [ sample ring ] ---> verifier thread
+//                    (pick 1-in-N, checksum)                        (read slba, checksum, compare)
+//
+// Only the checksum of a sampled packet is kept, so the packet buffer can be
+// recycled right after the write completes. A sample is dropped (and counted)
+// instead of stalling the writer when the verifier falls behind. Mismatches
+// are collected and reported by nmc_verify_close().
+
+#define NMC_VERIFY_QDEPTH     64 // samples waiting for read-back
+#define NMC_VERIFY_MAX_REPORT 16 // mismatched packets listed in the report
+
+#define NMC_VERIFY_OPT(every, random)                                                            \
+    OPT_UINT("verify", 'v', every, "read back 1-in-N packets in background (0: off)"),           \
+        OPT_FLAG("verify-random", 'r', random, "sample packets randomly with probability 1/N")
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+struct nmc_verify *nmc_verify_open(const nmc_config_t *config, uint32_t every, bool random);
+int nmc_verify_close(struct nmc_verify *verify);
+
+void nmc_verify_packets(struct nmc_verify *verify, uint64_t slba, const uint8_t *data,
+                        uint32_t npackets);
+
+#endif /* __NMC_HOST_PLUGIN_NVME_NMC_VERIFY_H__ */
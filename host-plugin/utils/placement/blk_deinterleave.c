@@ -0,0 +1,364 @@
+#include "./blk_deinterleave.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+// byte j of a unit comes from byte BLK_UNIT_SRC[j] of its half block: R0 R1 G0 G1 B0 B1
+static const uint8_t BLK_UNIT_SRC[BYTES_PER_BLK_UNIT] = {0, 3, 1, 4, 2, 5};
+
+// source byte (in the row) of byte k of the FC stream of pixels 0-1 (hi: 2-3)
+static inline size_t blk_src_byte(size_t k, bool hi)
+{
+    return (k / BYTES_PER_BLK_UNIT) * BYTES_PER_BLK_ROW + (hi ? BYTES_PER_BLK_UNIT : 0) +
+           BLK_UNIT_SRC[k % BYTES_PER_BLK_UNIT];
+}
+
+static blk_isa_t blkIsa = BLK_ISA_SCALAR;
+
+const char *const blkIsaNames[BLK_ISA_NUM] = {"scalar", "ssse3", "avx2", "avx512"};
+
+static void scalar_row(const uint8_t *s, uint8_t *lo, uint8_t *hi, size_t nblks)
+{
+    for (; nblks; --nblks, s += BYTES_PER_BLK_ROW, lo += BYTES_PER_BLK_UNIT, hi += BYTES_PER_BLK_UNIT)
+    {
+        lo[0] = s[0], lo[1] = s[3], lo[2] = s[1], lo[3] = s[4], lo[4] = s[2], lo[5] = s[5];
+        hi[0] = s[6], hi[1] = s[9], hi[2] = s[7], hi[3] = s[10], hi[4] = s[8], hi[5] = s[11];
+    }
+}
+
+// r, g, b: the planes of a row, PX_BLK_WIDTH bytes per block each
+static void scalar_planar_row(const uint8_t *r, const uint8_t *g, const uint8_t *b, uint8_t *lo,
+                              uint8_t *hi, size_t nblks)
+{
+    for (; nblks; --nblks, r += PX_BLK_WIDTH, g += PX_BLK_WIDTH, b += PX_BLK_WIDTH,
+                  lo += BYTES_PER_BLK_UNIT, hi += BYTES_PER_BLK_UNIT)
+    {
+        memcpy(&lo[0], &r[0], PX_STEP_WIDTH), memcpy(&hi[0], &r[PX_STEP_WIDTH], PX_STEP_WIDTH);
+        memcpy(&lo[2], &g[0], PX_STEP_WIDTH), memcpy(&hi[2], &g[PX_STEP_WIDTH], PX_STEP_WIDTH);
+        memcpy(&lo[4], &b[0], PX_STEP_WIDTH), memcpy(&hi[4], &b[PX_STEP_WIDTH], PX_STEP_WIDTH);
+    }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * 4 blocks (48 bytes, 3 vectors l0-l2) give 24 bytes to each FC: bytes 0-15
+ * are shuffled from l0|l1 and bytes 16-23 from l1|l2, the 0x80 lanes of one
+ * mask are filled by the other. The pixels 2-3 use the same masks on the
+ * vectors shifted by 6 bytes.
+ */
+static uint8_t SHUF4[4][16] __attribute__((aligned(16)));
+
+/*
+ * 16 blocks (192 bytes, 3 vectors l0-l2) give 96 bytes to each FC: bytes 0-59
+ * (blocks 0-9) are permuted from l0:l1 and bytes 60-95 (blocks 10-15) from l1:l2.
+ */
+static uint8_t PERM16[2][2][64] __attribute__((aligned(64)));
+
+#define PERM16_SPLIT 60
+
+/*
+ * Planar: 4 blocks are 16 bytes (8 pairs) of each plane. UNZIP moves the pairs
+ * of pixels 0-1 to the low half and those of pixels 2-3 to the high half, the
+ * R and G pairs of a half are then interleaved (rg) by unpack. The 24 bytes of
+ * an FC are bytes 0-15: rg0 rg1 b0 rg2 rg3 b1 rg4 rg5, bytes 16-23: b2 rg6 rg7
+ * b3, counting pairs. PLANAR4 holds the rg and b masks of both.
+ */
+#define X 0x80
+static const uint8_t UNZIP[16] __attribute__((aligned(16))) = {
+    0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15,
+};
+static const uint8_t PLANAR4[2][2][16] __attribute__((aligned(16))) = {
+    {{0, 1, 2, 3, X, X, 4, 5, 6, 7, X, X, 8, 9, 10, 11}, {X, X, X, X, 0, 1, X, X, X, X, 2, 3, X, X, X, X}},
+    {{X, X, 12, 13, 14, 15, X, X, X, X, X, X, X, X, X, X}, {4, 5, X, X, X, X, 6, 7, X, X, X, X, X, X, X, X}},
+};
+#undef X
+
+static void blk_masks_init(void)
+{
+    for (size_t iVec = 0; iVec < 2; ++iVec)
+        for (size_t i = 0; i < 16; ++i)
+        {
+            size_t k   = 16 * iVec + i;
+            size_t src = blk_src_byte(k, false) - 16 * iVec;
+            bool valid = k < 4 * BYTES_PER_BLK_UNIT;
+
+            SHUF4[2 * iVec + 0][i] = (valid && src < 16) ? src : 0x80;
+            SHUF4[2 * iVec + 1][i] = (valid && src >= 16 && src < 32) ? src - 16 : 0x80;
+        }
+
+    for (int hi = 0; hi < 2; ++hi)
+        for (size_t i = 0; i < 64; ++i)
+        {
+            size_t k             = PERM16_SPLIT + i;
+            PERM16[hi][0][i]     = (i < PERM16_SPLIT) ? blk_src_byte(i, hi) : 0;
+            PERM16[hi][1][i]     = (k < 16 * BYTES_PER_BLK_UNIT) ? blk_src_byte(k, hi) - 64 : 0;
+        }
+}
+
+__attribute__((target("ssse3"))) static void ssse3_row(const uint8_t *s, uint8_t *lo, uint8_t *hi,
+                                                       size_t nblks)
+{
+    const __m128i m0a = _mm_load_si128((const __m128i *)SHUF4[0]);
+    const __m128i m0b = _mm_load_si128((const __m128i *)SHUF4[1]);
+    const __m128i m1a = _mm_load_si128((const __m128i *)SHUF4[2]);
+    const __m128i m1b = _mm_load_si128((const __m128i *)SHUF4[3]);
+
+    for (; nblks >= 4; nblks -= 4, s += 48, lo += 24, hi += 24)
+    {
+        __m128i l0 = _mm_loadu_si128((const __m128i *)s);
+        __m128i l1 = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i l2 = _mm_loadu_si128((const __m128i *)(s + 32));
+        __m128i h0 = _mm_alignr_epi8(l1, l0, 6);
+        __m128i h1 = _mm_alignr_epi8(l2, l1, 6);
+        __m128i h2 = _mm_srli_si128(l2, 6);
+
+        _mm_storeu_si128((__m128i *)lo, _mm_or_si128(_mm_shuffle_epi8(l0, m0a), _mm_shuffle_epi8(l1, m0b)));
+        _mm_storel_epi64((__m128i *)(lo + 16), _mm_or_si128(_mm_shuffle_epi8(l1, m1a), _mm_shuffle_epi8(l2, m1b)));
+        _mm_storeu_si128((__m128i *)hi, _mm_or_si128(_mm_shuffle_epi8(h0, m0a), _mm_shuffle_epi8(h1, m0b)));
+        _mm_storel_epi64((__m128i *)(hi + 16), _mm_or_si128(_mm_shuffle_epi8(h1, m1a), _mm_shuffle_epi8(h2, m1b)));
+    }
+
+    scalar_row(s, lo, hi, nblks);
+}
+
+// the two 128-bit lanes run the SSSE3 step on blocks 0-3 and 4-7
+#define LOAD_LANES(p) \
+    _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p))), \
+                            _mm_loadu_si128((const __m128i *)((p) + 48)), 1)
+
+__attribute__((target("avx2"))) static void avx2_store(uint8_t *dst, __m256i v0, __m256i v1)
+{
+    _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(v0));
+    _mm_storel_epi64((__m128i *)(dst + 16), _mm256_castsi256_si128(v1));
+    _mm_storeu_si128((__m128i *)(dst + 24), _mm256_extracti128_si256(v0, 1));
+    _mm_storel_epi64((__m128i *)(dst + 40), _mm256_extracti128_si256(v1, 1));
+}
+
+__attribute__((target("avx2"))) static void avx2_row(const uint8_t *s, uint8_t *lo, uint8_t *hi,
+                                                     size_t nblks)
+{
+    const __m256i m0a = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)SHUF4[0]));
+    const __m256i m0b = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)SHUF4[1]));
+    const __m256i m1a = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)SHUF4[2]));
+    const __m256i m1b = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)SHUF4[3]));
+
+    for (; nblks >= 8; nblks -= 8, s += 96, lo += 48, hi += 48)
+    {
+        __m256i l0 = LOAD_LANES(s);
+        __m256i l1 = LOAD_LANES(s + 16);
+        __m256i l2 = LOAD_LANES(s + 32);
+        __m256i h0 = _mm256_alignr_epi8(l1, l0, 6);
+        __m256i h1 = _mm256_alignr_epi8(l2, l1, 6);
+        __m256i h2 = _mm256_srli_si256(l2, 6);
+
+        avx2_store(lo, _mm256_or_si256(_mm256_shuffle_epi8(l0, m0a), _mm256_shuffle_epi8(l1, m0b)),
+                   _mm256_or_si256(_mm256_shuffle_epi8(l1, m1a), _mm256_shuffle_epi8(l2, m1b)));
+        avx2_store(hi, _mm256_or_si256(_mm256_shuffle_epi8(h0, m0a), _mm256_shuffle_epi8(h1, m0b)),
+                   _mm256_or_si256(_mm256_shuffle_epi8(h1, m1a), _mm256_shuffle_epi8(h2, m1b)));
+    }
+
+    // not ssse3_row(), its legacy SSE encoding after AVX code costs a state transition
+    scalar_row(s, lo, hi, nblks);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi"))) static void avx512_row(const uint8_t *s,
+                                                                              uint8_t *lo,
+                                                                              uint8_t *hi,
+                                                                              size_t nblks)
+{
+    const __m512i loA      = _mm512_load_si512(PERM16[0][0]);
+    const __m512i loB      = _mm512_load_si512(PERM16[0][1]);
+    const __m512i hiA      = _mm512_load_si512(PERM16[1][0]);
+    const __m512i hiB      = _mm512_load_si512(PERM16[1][1]);
+    const __mmask64 maskA  = (1ULL << PERM16_SPLIT) - 1;
+    const __mmask64 maskB  = (1ULL << (96 - PERM16_SPLIT)) - 1;
+
+    for (; nblks >= 16; nblks -= 16, s += 192, lo += 96, hi += 96)
+    {
+        __m512i l0 = _mm512_loadu_si512(s);
+        __m512i l1 = _mm512_loadu_si512(s + 64);
+        __m512i l2 = _mm512_loadu_si512(s + 128);
+
+        _mm512_mask_storeu_epi8(lo, maskA, _mm512_permutex2var_epi8(l0, loA, l1));
+        _mm512_mask_storeu_epi8(lo + PERM16_SPLIT, maskB, _mm512_permutex2var_epi8(l1, loB, l2));
+        _mm512_mask_storeu_epi8(hi, maskA, _mm512_permutex2var_epi8(l0, hiA, l1));
+        _mm512_mask_storeu_epi8(hi + PERM16_SPLIT, maskB, _mm512_permutex2var_epi8(l1, hiB, l2));
+    }
+
+    scalar_row(s, lo, hi, nblks);
+}
+
+__attribute__((target("ssse3"))) static void ssse3_planar_row(const uint8_t *r, const uint8_t *g,
+                                                              const uint8_t *b, uint8_t *lo,
+                                                              uint8_t *hi, size_t nblks)
+{
+    const __m128i unzip = _mm_load_si128((const __m128i *)UNZIP);
+    const __m128i m0rg  = _mm_load_si128((const __m128i *)PLANAR4[0][0]);
+    const __m128i m0b   = _mm_load_si128((const __m128i *)PLANAR4[0][1]);
+    const __m128i m1rg  = _mm_load_si128((const __m128i *)PLANAR4[1][0]);
+    const __m128i m1b   = _mm_load_si128((const __m128i *)PLANAR4[1][1]);
+
+    for (; nblks >= 4; nblks -= 4, r += 16, g += 16, b += 16, lo += 24, hi += 24)
+    {
+        __m128i vr  = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)r), unzip);
+        __m128i vg  = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)g), unzip);
+        __m128i bl  = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)b), unzip);
+        __m128i bh  = _mm_srli_si128(bl, 8);
+        __m128i rgl = _mm_unpacklo_epi16(vr, vg);
+        __m128i rgh = _mm_unpackhi_epi16(vr, vg);
+
+        _mm_storeu_si128((__m128i *)lo, _mm_or_si128(_mm_shuffle_epi8(rgl, m0rg), _mm_shuffle_epi8(bl, m0b)));
+        _mm_storel_epi64((__m128i *)(lo + 16), _mm_or_si128(_mm_shuffle_epi8(rgl, m1rg), _mm_shuffle_epi8(bl, m1b)));
+        _mm_storeu_si128((__m128i *)hi, _mm_or_si128(_mm_shuffle_epi8(rgh, m0rg), _mm_shuffle_epi8(bh, m0b)));
+        _mm_storel_epi64((__m128i *)(hi + 16), _mm_or_si128(_mm_shuffle_epi8(rgh, m1rg), _mm_shuffle_epi8(bh, m1b)));
+    }
+
+    scalar_planar_row(r, g, b, lo, hi, nblks);
+}
+
+// the two 128-bit lanes run the SSSE3 step on blocks 0-3 and 4-7
+__attribute__((target("avx2"))) static void avx2_planar_row(const uint8_t *r, const uint8_t *g,
+                                                            const uint8_t *b, uint8_t *lo,
+                                                            uint8_t *hi, size_t nblks)
+{
+    const __m256i unzip = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)UNZIP));
+    const __m256i m0rg  = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)PLANAR4[0][0]));
+    const __m256i m0b   = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)PLANAR4[0][1]));
+    const __m256i m1rg  = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)PLANAR4[1][0]));
+    const __m256i m1b   = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)PLANAR4[1][1]));
+
+    for (; nblks >= 8; nblks -= 8, r += 32, g += 32, b += 32, lo += 48, hi += 48)
+    {
+        __m256i vr  = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)r), unzip);
+        __m256i vg  = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)g), unzip);
+        __m256i bl  = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)b), unzip);
+        __m256i bh  = _mm256_srli_si256(bl, 8);
+        __m256i rgl = _mm256_unpacklo_epi16(vr, vg);
+        __m256i rgh = _mm256_unpackhi_epi16(vr, vg);
+
+        avx2_store(lo, _mm256_or_si256(_mm256_shuffle_epi8(rgl, m0rg), _mm256_shuffle_epi8(bl, m0b)),
+                   _mm256_or_si256(_mm256_shuffle_epi8(rgl, m1rg), _mm256_shuffle_epi8(bl, m1b)));
+        avx2_store(hi, _mm256_or_si256(_mm256_shuffle_epi8(rgh, m0rg), _mm256_shuffle_epi8(bh, m0b)),
+                   _mm256_or_si256(_mm256_shuffle_epi8(rgh, m1rg), _mm256_shuffle_epi8(bh, m1b)));
+    }
+
+    scalar_planar_row(r, g, b, lo, hi, nblks);
+}
+
+#endif /* __x86_64__ */
+
+#define BLK_KERNEL(isa, row)                                                                       \
+    static void blk_deinterleave_##isa(const uint8_t *const src[PX_BLK_HEIGHT],                    \
+                                       uint8_t *const dst[NUM_FLASH_CHANNELS], size_t nblks)        \
+    {                                                                                              \
+        for (size_t iRow = 0; iRow < PX_BLK_HEIGHT; ++iRow)                                        \
+            row(src[iRow], dst[iRow], dst[iRow + PX_BLK_HEIGHT], nblks);                           \
+    }
+
+BLK_KERNEL(scalar, scalar_row)
+#if defined(__x86_64__)
+BLK_KERNEL(ssse3, ssse3_row)
+BLK_KERNEL(avx2, avx2_row)
+BLK_KERNEL(avx512, avx512_row)
+#endif
+
+static blk_deinterleave_fn blkKernels[BLK_ISA_NUM] = {
+    [BLK_ISA_SCALAR] = blk_deinterleave_scalar,
+#if defined(__x86_64__)
+    [BLK_ISA_SSSE3]  = blk_deinterleave_ssse3,
+    [BLK_ISA_AVX2]   = blk_deinterleave_avx2,
+    [BLK_ISA_AVX512] = blk_deinterleave_avx512,
+#endif
+};
+
+#define BLK_PLANAR_KERNEL(isa, row)                                                                \
+    static void blk_deplanar_##isa(const uint8_t *const src[PX_BLK_HEIGHT], size_t planeStride,    \
+                                   uint8_t *const dst[NUM_FLASH_CHANNELS], size_t nblks)            \
+    {                                                                                              \
+        for (size_t iRow = 0; iRow < PX_BLK_HEIGHT; ++iRow)                                        \
+            row(src[iRow], &src[iRow][planeStride], &src[iRow][2 * planeStride], dst[iRow],        \
+                dst[iRow + PX_BLK_HEIGHT], nblks);                                                 \
+    }
+
+BLK_PLANAR_KERNEL(scalar, scalar_planar_row)
+#if defined(__x86_64__)
+BLK_PLANAR_KERNEL(ssse3, ssse3_planar_row)
+BLK_PLANAR_KERNEL(avx2, avx2_planar_row)
+#endif
+
+// no AVX-512 planar kernel, AVX-512 CPUs run the AVX2 one
+static blk_deplanar_fn blkPlanarKernels[BLK_ISA_NUM] = {
+    [BLK_ISA_SCALAR] = blk_deplanar_scalar,
+#if defined(__x86_64__)
+    [BLK_ISA_SSSE3]  = blk_deplanar_ssse3,
+    [BLK_ISA_AVX2]   = blk_deplanar_avx2,
+    [BLK_ISA_AVX512] = blk_deplanar_avx2,
+#endif
+};
+
+static blk_deinterleave_fn blkKernel = blk_deinterleave_scalar;
+static blk_deplanar_fn blkPlanarKernel = blk_deplanar_scalar;
+
+__attribute__((constructor)) static void blk_deinterleave_init(void)
+{
+#if defined(__x86_64__)
+    blk_masks_init();
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+        blkIsa = BLK_ISA_SSSE3;
+    if (__builtin_cpu_supports("avx2"))
+        blkIsa = BLK_ISA_AVX2;
+    if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vbmi"))
+        blkIsa = BLK_ISA_AVX512;
+#endif
+
+    blkKernel       = blkKernels[blkIsa];
+    blkPlanarKernel = blkPlanarKernels[blkIsa];
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief De-interleave `nblks` blocks with the fastest kernel of this CPU
+ */
+void blk_deinterleave(const uint8_t *const src[PX_BLK_HEIGHT],
+                      uint8_t *const dst[NUM_FLASH_CHANNELS], size_t nblks)
+{
+    blkKernel(src, dst, nblks);
+}
+
+/**
+ * @brief Get the kernel of `isa`, NULL if the CPU (or the build) does not support it
+ */
+blk_deinterleave_fn blk_deinterleave_kernel(blk_isa_t isa)
+{
+    return (isa <= blkIsa) ? blkKernels[isa] : NULL;
+}
+
+blk_isa_t blk_deinterleave_isa(void) { return blkIsa; }
+
+/**
+ * @brief Place `nblks` blocks of planar rows with the fastest kernel of this CPU
+ */
+void blk_deplanar(const uint8_t *const src[PX_BLK_HEIGHT], size_t planeStride,
+                  uint8_t *const dst[NUM_FLASH_CHANNELS], size_t nblks)
+{
+    blkPlanarKernel(src, planeStride, dst, nblks);
+}
+
+blk_deplanar_fn blk_deplanar_kernel(blk_isa_t isa)
+{
+    return (isa <= blkIsa) ? blkPlanarKernels[isa] : NULL;
+}
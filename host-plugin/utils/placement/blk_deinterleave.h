@@ -0,0 +1,60 @@
+#ifndef __NMC_HOST_PLUGIN_BLK_DEINTERLEAVE_H__
+#define __NMC_HOST_PLUGIN_BLK_DEINTERLEAVE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "./img_policy_contig.h"
+
+// De-interleave a run of 4x4 RGB blocks into the flash channels
+//
+//   src[iRow]                 : row iRow of the run, 12 bytes per block
+//   dst[iRow]                 : R0 R1 G0 G1 B0 B1 of pixels 0-1, 6 bytes per block
+//   dst[iRow + PX_BLK_HEIGHT] : R2 R3 G2 G3 B2 B3 of pixels 2-3, 6 bytes per block
+//
+// This is a fixed byte permutation per row, so the vector kernels move 4
+// (SSSE3 pshufb), 8 (AVX2 vpshufb) or 16 (AVX-512 VBMI vpermt2b) blocks per
+// iteration, the remaining blocks go through the scalar kernel. Every kernel
+// reads and writes exactly the bytes of the run. The fastest kernel supported
+// by the CPU is picked once at load time.
+//
+// Planar rows (PLANARCONFIG_SEPARATE) hold the R, G and B planes of a row
+// `planeStride` bytes apart, so each FC takes 2 contiguous bytes of every
+// plane per block: blk_deplanar() moves byte pairs instead of gathering bytes.
+// Its vector kernels split the even and odd pairs of 4 (SSSE3) or 8 (AVX2)
+// blocks and interleave the three planes.
+
+#define BYTES_PER_BLK_UNIT (PX_STEP_WIDTH * BYTES_PER_PIXEL)  // bytes per block per FC
+#define BYTES_PER_BLK_ROW  (PX_BLK_WIDTH * BYTES_PER_PIXEL)   // bytes per block per row
+
+typedef enum
+{
+    BLK_ISA_SCALAR,
+    BLK_ISA_SSSE3,
+    BLK_ISA_AVX2,
+    BLK_ISA_AVX512,
+    BLK_ISA_NUM,
+} blk_isa_t;
+
+typedef void (*blk_deinterleave_fn)(const uint8_t *const src[PX_BLK_HEIGHT],
+                                    uint8_t *const dst[NUM_FLASH_CHANNELS], size_t nblks);
+typedef void (*blk_deplanar_fn)(const uint8_t *const src[PX_BLK_HEIGHT], size_t planeStride,
+                                uint8_t *const dst[NUM_FLASH_CHANNELS], size_t nblks);
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+extern const char *const blkIsaNames[BLK_ISA_NUM];
+
+void blk_deinterleave(const uint8_t *const src[PX_BLK_HEIGHT],
+                      uint8_t *const dst[NUM_FLASH_CHANNELS], size_t nblks);
+
+blk_deinterleave_fn blk_deinterleave_kernel(blk_isa_t isa);
+blk_isa_t blk_deinterleave_isa(void);
+
+void blk_deplanar(const uint8_t *const src[PX_BLK_HEIGHT], size_t planeStride,
+                  uint8_t *const dst[NUM_FLASH_CHANNELS], size_t nblks);
+blk_deplanar_fn blk_deplanar_kernel(blk_isa_t isa);
+
+#endif /* __NMC_HOST_PLUGIN_BLK_DEINTERLEAVE_H__ */
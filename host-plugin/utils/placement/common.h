@@ -8,6 +8,7 @@
 #include "../flash_config.h"
 
 #define ALIGN_UP(x, align_to) (((x) + ((align_to)-1)) & ~((align_to)-1))
+#define ALIGN_DOWN(x, align_to) ((x) & ~((align_to)-1))
 
 typedef struct
 {
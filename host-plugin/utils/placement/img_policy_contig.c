@@ -4,15 +4,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "tiffio.h" // apt install libtiff5-dev, gcc -ltiff
 
+#include "./tiff_decoder.h"
+#include "./blk_deinterleave.h"
 #include "../debug.h"
 
-void dispatch_patch(size_t iPatch, const ByteMatrix_t *patch, size_t pxHeight, size_t pxWidth);
-void dispatch_blk_row(const ByteMatrix_t *blkRow, size_t pxWidth);
-void flush_img_fc_buffer(bool force);
-
 /* -------------------------------------------------------------------------- */
 /*                allow users define their flush handling logic               */
 /* -------------------------------------------------------------------------- */
@@ -28,406 +27,721 @@ void flush_page_image(uint8_t iFC, uint8_t *data)
 }
 #endif /* USER_FLUSH_IMAGE */
 
+#if (USER_FLUSH_IMAGE_PACKET == true)
+#pragma message "Use user defined packet buffers for IMAGE flush"
+extern uint8_t *acquire_packet_image(void);
+extern void flush_packet_image(uint8_t *packet);
+#else
+// stage the packet here and hand it over page by page
+static uint8_t PACKET[NUM_FLASH_CHANNELS * BYTES_PER_PAGE];
+
+uint8_t *acquire_packet_image(void) { return PACKET; }
+
+void flush_packet_image(uint8_t *packet)
+{
+    for (uint8_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
+        flush_page_image(iFC, &packet[iFC * BYTES_PER_PAGE]);
+}
+#endif /* USER_FLUSH_IMAGE_PACKET */
+
 /* -------------------------------------------------------------------------- */
 /*                   internal members and utility functions                   */
 /* -------------------------------------------------------------------------- */
 
 /*
- * FC_BUFFERS will be flushed after dispatching a blockRow, but the data will not
- * be flushed if the buffered data size < BYTES_PER_PAGE, therefore the max width
- * of the FC_BUFFERS should be `BYTES_BLK_ROW_WIDTH + BYTES_PER_PAGE`, where the
- * `BYTES_BLK_ROW_WIDTH` should be less than, or equal to, `BYTES_PATCH_WIDTH`.
+ * Every 4x4 block sends 6 bytes (a unit) to each FC: row `iRow` of the block
+ * goes to FC `iRow` (pixels 0-1) and FC `iRow + PX_BLK_HEIGHT` (pixels 2-3),
+ * as R0 R1 G0 G1 B0 B1 (see blk_deinterleave.h). All FCs advance in lockstep,
+ * so one page offset locates the next unit of every FC in the packet, and each
+ * pixel is copied once: from the decoded scanline into the packet buffer given
+ * to the device.
  */
 
-static size_t FC_BUFFER_SZ;
-static uint8_t FC_BUFFERS[NUM_FLASH_CHANNELS][BYTES_PATCH_WIDTH + BYTES_PER_PAGE];
+#define BYTES_PER_UNIT (BYTES_PER_BLK_UNIT)
+#define BYTES_BLK_ROW  (BYTES_PER_BLK_ROW)
 
-static size_t get_fc_buffer_sz() { return FC_BUFFER_SZ; }
+_Static_assert(NUM_FLASH_CHANNELS == 2 * PX_BLK_HEIGHT, "a block row feeds two FCs");
+_Static_assert(PX_PATCH_HEIGHT % TIFF_DECODER_ROWS_PER_BATCH == 0,
+               "a decoded batch must not straddle two patch rows");
 
-/* -------------------------------------------------------------------------- */
-/*                     implementation of public functions                     */
-/* -------------------------------------------------------------------------- */
+// bytes of a (full) patch in each FC
+#define BYTES_PATCH_PER_FC                                                                         \
+    ((PX_PATCH_HEIGHT / PX_BLK_HEIGHT) * (PX_PATCH_WIDTH / PX_BLK_WIDTH) * BYTES_PER_UNIT)
+
+// patch jobs in flight per placement worker
+#define NUM_JOBS_PER_WORKER 2
+
+typedef struct img_workers img_workers_t;
+
+typedef struct
+{
+    uint8_t *packet; // packet being filled, NULL until the first unit
+    size_t off;      // bytes filled in each page of the packet
+    size_t idxPatch;
+    size_t planeStride;     // bytes between the R, G and B planes of a row, 0 if interleaved
+    img_workers_t *workers; // parallel placement, NULL for serial
+} img_scatter_t;
+
+typedef void (*blk_row_fn)(void *arg, const uint8_t *const src[PX_BLK_HEIGHT], size_t planeStride,
+                           size_t nblks);
+
+// source of the padding rows below the image, as wide as a patch
+static const uint8_t ZERO_ROW[BYTES_PATCH_WIDTH];
+
+static size_t numPlacementThreads = 1;
+static bool placementStream       = false;
+static size_t numDecodeThreads    = 1;
+static bool (*placementCancelled)(void);
+
+// checked between batches, the rest of the image is not placed once it is set
+static inline bool placement_cancelled(void) { return placementCancelled && placementCancelled(); }
+
+static inline size_t patch_width(size_t pxWidth, size_t pxOff)
+{
+    return (pxWidth - pxOff < PX_PATCH_WIDTH) ? pxWidth - pxOff : PX_PATCH_WIDTH;
+}
+
+// place `nblks` blocks from block `iBlk` of the rows to `off` of each FC page in `dst`
+static inline void scatter_run(const uint8_t *const src[PX_BLK_HEIGHT], size_t planeStride,
+                               size_t iBlk, uint8_t *dst, size_t stride, size_t off, size_t nblks)
+{
+    const size_t iByte = iBlk * (planeStride ? PX_BLK_WIDTH : BYTES_BLK_ROW);
+    const uint8_t *rows[PX_BLK_HEIGHT];
+    uint8_t *pages[NUM_FLASH_CHANNELS];
+
+    for (size_t iRow = 0; iRow < PX_BLK_HEIGHT; ++iRow)
+        rows[iRow] = &src[iRow][iByte];
+    for (size_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
+        pages[iFC] = &dst[iFC * stride + off];
+
+    if (planeStride)
+        blk_deplanar(rows, planeStride, pages, nblks);
+    else
+        blk_deinterleave(rows, pages, nblks);
+}
+
+static void scatter_flush(img_scatter_t *sc)
+{
+    flush_packet_image(sc->packet);
+    sc->packet = NULL;
+    sc->off    = 0;
+}
 
 /**
- * @brief Split the image into patches and dispatch with a row major policy
- *
- * @param imgFlatten The flatten RGB image
- * @param pxWidth The width of the given image in pixels
- * @param pxHeight The height of the given image in pixels
+ * @brief Scatter `nblks` blocks of 4 rows to the FCs, starting at byte 0 of each row
  */
-void dispatch_image(uint8_t *imgFlatten, size_t pxWidth, size_t pxHeight)
+static void scatter_blocks(void *arg, const uint8_t *const src[PX_BLK_HEIGHT], size_t planeStride,
+                           size_t nblks)
 {
-    const size_t pxPatchRowWidth      = pxWidth;
-    const size_t bytesImgWidth        = pxWidth * BYTES_PER_PIXEL;
-    const size_t bytesPatchRowWidth   = pxPatchRowWidth * BYTES_PER_PIXEL;
-    const size_t numFullWidPatches    = pxPatchRowWidth / PX_PATCH_WIDTH;
-    const size_t pxPartWidPatchWid    = pxPatchRowWidth % PX_PATCH_WIDTH;
-    const size_t bytesPartWidPatchWid = pxPartWidPatchWid * BYTES_PER_PIXEL;
+    img_scatter_t *sc = arg;
 
-    // allocate buffers for storing the whole patch row and single patch
-    size_t idxPatch        = 0;
-    size_t bytesImgHandled = 0;
+    for (size_t iBlk = 0; nblks;)
+    {
+        if (!sc->packet)
+            sc->packet = acquire_packet_image();
 
-    // allocate for patch row buffer and patch buffer
-    ByteMatrix_t matPatch = INIT_BYTE_MATRIX(PX_PATCH_HEIGHT, BYTES_PATCH_WIDTH);
-    assert_exit(matPatch.base, "Failed to allocate memory for ByteMatrix");
+        size_t n = (BYTES_PER_PAGE - sc->off) / BYTES_PER_UNIT;
+        n        = (n < nblks) ? n : nblks;
+        scatter_run(src, planeStride, iBlk, sc->packet, BYTES_PER_PAGE, sc->off, n);
 
-    ByteMatrix_t matPatchRow = INIT_BYTE_MATRIX(PX_PATCH_HEIGHT, bytesPatchRowWidth);
-    assert_exit(matPatchRow.base, "Failed to allocate memory for ByteMatrix");
+        sc->off += n * BYTES_PER_UNIT;
+        iBlk += n;
+        nblks -= n;
+        if (!nblks)
+            break;
 
-    ARRAY_FROM_BYTE_MATRIX(patchRow, matPatchRow);
+        // the next unit straddles two pages, split it over this packet and the next
+        uint8_t unit[NUM_FLASH_CHANNELS * BYTES_PER_UNIT];
+        scatter_run(src, planeStride, iBlk, unit, BYTES_PER_UNIT, 0, 1);
 
-    // parse the image patch row by patch row
-    size_t idxTargetBufRow = 0;
-    for (size_t iImgRow = 0; iImgRow < pxHeight; ++iImgRow)
-    {
-        // copy image row data to the buffer
-        memcpy((*patchRow)[idxTargetBufRow], &imgFlatten[bytesImgHandled], bytesImgWidth);
+        size_t head = BYTES_PER_PAGE - sc->off;
+        for (size_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
+            memcpy(&sc->packet[iFC * BYTES_PER_PAGE + sc->off], &unit[iFC * BYTES_PER_UNIT], head);
 
-        // update current buffer info
-        idxTargetBufRow += 1;
-        bytesImgHandled += bytesImgWidth;
+        scatter_flush(sc);
+        sc->packet = acquire_packet_image();
+        for (size_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
+            memcpy(&sc->packet[iFC * BYTES_PER_PAGE], &unit[iFC * BYTES_PER_UNIT + head],
+                   BYTES_PER_UNIT - head);
 
-        // if buffer full, flush this patch row
-        if (idxTargetBufRow == PX_PATCH_HEIGHT)
-        {
-            idxTargetBufRow = 0;
+        sc->off = BYTES_PER_UNIT - head;
+        iBlk += 1;
+        nblks -= 1;
+    }
 
-            // handle full width patches
-            size_t bytesHandledWid = 0;
-            for (size_t iFullWidPatch = 0; iFullWidPatch < numFullWidPatches; ++iFullWidPatch)
-            {
-                // copy to patch buffer
-                memcpy_mat(&matPatch, &matPatchRow, bytesHandledWid, BYTES_PATCH_WIDTH,
-                           PX_PATCH_HEIGHT);
-                dispatch_patch(idxPatch, &matPatch, PX_PATCH_HEIGHT, PX_PATCH_WIDTH);
+    if (sc->off == BYTES_PER_PAGE)
+        scatter_flush(sc);
+}
 
-                idxPatch += 1;
-                bytesHandledWid += BYTES_PATCH_WIDTH;
-            }
+/**
+ * @brief Copy a rendered patch (`len` bytes per FC) to the packets, in stream order
+ */
+static void scatter_span(img_scatter_t *sc, const uint8_t *span, size_t len)
+{
+    for (size_t pos = 0; pos < len;)
+    {
+        if (!sc->packet)
+            sc->packet = acquire_packet_image();
 
-            // handle partial width patch (if exists)
-            if (pxPartWidPatchWid > 0)
-            {
-                // copy to patch buffer
-                memcpy_mat(&matPatch, &matPatchRow, bytesHandledWid, bytesPartWidPatchWid,
-                           PX_PATCH_HEIGHT);
-                dispatch_patch(idxPatch, &matPatch, PX_PATCH_HEIGHT, pxPartWidPatchWid);
+        size_t n = BYTES_PER_PAGE - sc->off;
+        n        = (n < len - pos) ? n : len - pos;
+        for (size_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
+            memcpy(&sc->packet[iFC * BYTES_PER_PAGE + sc->off], &span[iFC * BYTES_PATCH_PER_FC + pos], n);
 
-                idxPatch += 1;
-            }
-        }
+        sc->off += n;
+        pos += n;
+        if (sc->off == BYTES_PER_PAGE)
+            scatter_flush(sc);
     }
+}
 
-    // all image rows have been handled, but some may still in buffer
-    assert_exit((idxTargetBufRow < PX_PATCH_HEIGHT), "Unexpected idxTargetBufRow: %lu",
-                idxTargetBufRow);
+/**
+ * @brief Walk the block rows of the patch at `pxOff`, with zeros below and right of the image
+ *
+ * @param planeStride Bytes between the R, G and B planes of a row, 0 for interleaved rows
+ */
+static void walk_patch(const uint8_t *const *rows, size_t pxHeight, size_t pxOff,
+                       size_t pxPatchWidth, size_t planeStride, blk_row_fn fn, void *arg)
+{
+    const size_t nFullBlks = pxPatchWidth / PX_BLK_WIDTH;
+    const size_t pxPartBlk = pxPatchWidth % PX_BLK_WIDTH;
 
-    if (idxTargetBufRow > 0)
+    for (size_t iRow = 0; iRow < pxHeight; iRow += PX_BLK_HEIGHT)
     {
-        // the buffer may contain garbages, do memset 0 for padding zeros
-        // memset_mat(patch, PX_PATCH_HEIGHT, BYTES_PATCH_WIDTH, 0);
+        const uint8_t *src[PX_BLK_HEIGHT];
+        size_t stride = planeStride;
 
-        // dispatch partial height full width patches
-        size_t bytesHandledWid = 0;
-        for (size_t iFullWidPatch = 0; iFullWidPatch < numFullWidPatches; ++iFullWidPatch)
+        // planar rows below the image have no planes to point at, stage the block row
+        uint8_t edge[PX_BLK_HEIGHT][NUM_CHANNELS_PER_PIXEL][PX_PATCH_WIDTH];
+        if (planeStride && iRow + PX_BLK_HEIGHT > pxHeight)
         {
-            memcpy_mat(&matPatch, &matPatchRow, bytesHandledWid, BYTES_PATCH_WIDTH,
-                       idxTargetBufRow);
-            dispatch_patch(idxPatch, &matPatch, idxTargetBufRow, PX_PATCH_WIDTH);
-
-            idxPatch += 1;
-            bytesHandledWid += BYTES_PATCH_WIDTH;
+            memset(edge, 0, sizeof(edge));
+            for (size_t iBlkRow = 0; iBlkRow < PX_BLK_HEIGHT; ++iBlkRow)
+            {
+                for (size_t iPlane = 0; iRow + iBlkRow < pxHeight && iPlane < NUM_CHANNELS_PER_PIXEL; ++iPlane)
+                    memcpy(edge[iBlkRow][iPlane], &rows[iRow + iBlkRow][iPlane * planeStride + pxOff],
+                           pxPatchWidth);
+                src[iBlkRow] = edge[iBlkRow][0];
+            }
+            stride = PX_PATCH_WIDTH;
         }
-
-        // dispatch partial height partial width patch if exists
-        if (pxPartWidPatchWid > 0)
+        else
         {
-            memcpy_mat(&matPatch, &matPatchRow, bytesHandledWid, bytesPartWidPatchWid,
-                       idxTargetBufRow);
-            dispatch_patch(idxPatch, &matPatch, idxTargetBufRow, pxPartWidPatchWid);
-
-            idxPatch += 1;
+            for (size_t iBlkRow = 0; iBlkRow < PX_BLK_HEIGHT; ++iBlkRow)
+                src[iBlkRow] = (iRow + iBlkRow < pxHeight)
+                                   ? &rows[iRow + iBlkRow][pxOff * (planeStride ? 1 : BYTES_PER_PIXEL)]
+                                   : ZERO_ROW;
         }
-    }
 
-    // if some data (< page size) still in buffers, force flush
-    if (get_fc_buffer_sz() > 0)
-    {
-        pr_info("FC_BUFFERS still not empty but the image_dispatch is ended, "
-                "force flush");
-        flush_img_fc_buffer(true);
-    }
+        fn(arg, src, stride, nFullBlks);
 
-    free(matPatch.base);
-    free(matPatchRow.base);
+        // partial width block, padding zeros to the right
+        if (pxPartBlk)
+        {
+            uint8_t part[PX_BLK_HEIGHT][BYTES_BLK_ROW] = {0};
+            const uint8_t *srcPart[PX_BLK_HEIGHT];
+            for (size_t iBlkRow = 0; iBlkRow < PX_BLK_HEIGHT; ++iBlkRow)
+            {
+                if (stride)
+                    for (size_t iPlane = 0; iPlane < NUM_CHANNELS_PER_PIXEL; ++iPlane)
+                        memcpy(&part[iBlkRow][iPlane * PX_BLK_WIDTH],
+                               &src[iBlkRow][iPlane * stride + nFullBlks * PX_BLK_WIDTH], pxPartBlk);
+                else
+                    memcpy(part[iBlkRow], &src[iBlkRow][nFullBlks * BYTES_BLK_ROW],
+                           pxPartBlk * BYTES_PER_PIXEL);
+                srcPart[iBlkRow] = part[iBlkRow];
+            }
+            fn(arg, srcPart, stride ? PX_BLK_WIDTH : 0, 1);
+        }
+    }
 }
 
-void dispatch_image_zero_padded(uint8_t *img, size_t pxWidth, size_t pxHeight) {}
-
-void dispatch_tiff(const char *path)
+static void log_patch(size_t idxPatch, size_t pxHeight, size_t pxPatchWidth)
 {
+    // debug info, check whether the patch is full patch or not
+    if (pxHeight != PX_PATCH_HEIGHT || pxPatchWidth != PX_PATCH_WIDTH)
+        pr_info("Patch[%lu] is a partial patch (H=%lu,W=%lu)", idxPatch, pxHeight, pxPatchWidth);
+}
 
-    assert_exit(path != NULL, "Path not given!");
-
-    TIFF *tif = TIFFOpen(path, "r");
-    assert_exit(tif != NULL, "Failed to open TIFF file '%s'", path);
+/* -------------------------------------------------------------------------- */
+/*                             parallel placement                             */
+/* -------------------------------------------------------------------------- */
 
-    // get image attr: http://www.simplesystems.org/libtiff/functions/TIFFGetField.html
-    uint16_t cfgPlanar;
-    uint32_t pxHeight, pxWidth;
+/*
+ * Patches of a buffered patch row are independent, so workers render them
+ * into per-patch spans (BYTES_PATCH_PER_FC per FC) while the placement thread
+ * copies the finished spans to the packets in patch order. Patch i renders
+ * into job i % njobs, a job is reused once its span is emitted, so the output
+ * is the same byte stream as the serial placement.
+ */
 
-    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &pxWidth);
-    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &pxHeight);
-    TIFFGetField(tif, TIFFTAG_PLANARCONFIG, &cfgPlanar);
+typedef struct
+{
+    uint8_t *span;
+    size_t len; // bytes per FC
+    bool done;
+} img_job_t;
 
-    pr_info("%s (%u, %u)", path, pxHeight, pxWidth);
+struct img_workers
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // a job is done, emitted, or a patch row is posted
+    bool stop;
+
+    // the patch row being placed
+    const uint8_t *const *rows;
+    size_t pxHeight;
+    size_t pxWidth;
+    size_t npatches;
+    size_t planeStride;
+    size_t iNext; // next patch to render
+    size_t iEmit; // next patch to emit
+
+    size_t njobs;
+    img_job_t *jobs;
+    size_t nthreads;
+    pthread_t *threads;
+};
+
+typedef struct
+{
+    uint8_t *span;
+    size_t off;
+} img_span_t;
 
-    // prepare buffer for tiff image
-    tsize_t sz = TIFFScanlineSize(tif);
-    assert_exit(sz == (pxWidth * 3), "Line size should be 3 x pxWidth, but got %lu", sz);
+static void span_blocks(void *arg, const uint8_t *const src[PX_BLK_HEIGHT], size_t planeStride,
+                        size_t nblks)
+{
+    img_span_t *sp = arg;
+    scatter_run(src, planeStride, 0, sp->span, BYTES_PATCH_PER_FC, sp->off, nblks);
+    sp->off += nblks * BYTES_PER_UNIT;
+}
 
-    tdata_t buf = _TIFFmalloc(sz);
-    pr_debug("buffer addr: %p", buf);
+static void *placement_worker(void *arg)
+{
+    img_workers_t *w = arg;
 
-    if (cfgPlanar == PLANARCONFIG_CONTIG)
+    pthread_mutex_lock(&w->lock);
+    while (!w->stop)
     {
-        const size_t pxPatchRowWidth      = pxWidth;
-        const size_t bytesImgWidth        = pxWidth * BYTES_PER_PIXEL;
-        const size_t bytesPatchRowWidth   = pxPatchRowWidth * BYTES_PER_PIXEL;
-        const size_t numFullWidPatches    = pxPatchRowWidth / PX_PATCH_WIDTH;
-        const size_t pxPartWidPatchWid    = pxPatchRowWidth % PX_PATCH_WIDTH;
-        const size_t bytesPartWidPatchWid = pxPartWidPatchWid * BYTES_PER_PIXEL;
+        if (w->iNext == w->npatches || w->iNext == w->iEmit + w->njobs)
+        {
+            pthread_cond_wait(&w->cond, &w->lock);
+            continue;
+        }
 
-        // allocate buffers for storing the whole patch row and single patch
-        size_t idxPatch        = 0;
-        size_t bytesImgHandled = 0;
+        // the patch row is not changed until all its patches are emitted
+        size_t iPatch  = w->iNext++;
+        img_job_t *job = &w->jobs[iPatch % w->njobs];
+        pthread_mutex_unlock(&w->lock);
 
-        // allocate for patch row buffer and patch buffer
-        ByteMatrix_t matPatch = INIT_BYTE_MATRIX(PX_PATCH_HEIGHT, BYTES_PATCH_WIDTH);
-        assert_exit(matPatch.base, "Failed to allocate memory for ByteMatrix");
+        size_t pxOff   = iPatch * PX_PATCH_WIDTH;
+        img_span_t sp  = {.span = job->span};
+        walk_patch(w->rows, w->pxHeight, pxOff, patch_width(w->pxWidth, pxOff), w->planeStride,
+                   span_blocks, &sp);
 
-        ByteMatrix_t matPatchRow = INIT_BYTE_MATRIX(PX_PATCH_HEIGHT, bytesPatchRowWidth);
-        assert_exit(matPatchRow.base, "Failed to allocate memory for ByteMatrix");
+        pthread_mutex_lock(&w->lock);
+        job->len  = sp.off;
+        job->done = true;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
 
-        ARRAY_FROM_BYTE_MATRIX(patchRow, matPatchRow);
+    return NULL;
+}
 
-        size_t idxTargetBufRow = 0;
-        for (size_t iImgRow = 0; iImgRow < pxHeight; ++iImgRow)
-        {
-            // read line from tiff (the sample param is used in PlanarConfiguration == 2)
-            TIFFReadScanline(tif, buf, iImgRow, 0);
+static img_workers_t *workers_open(size_t nthreads)
+{
+    img_workers_t *w = calloc(1, sizeof(img_workers_t));
+    assert_exit(w, "Failed to allocate placement workers");
 
-            // copy image row data to the buffer
-            memcpy((*patchRow)[idxTargetBufRow], buf, bytesImgWidth);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
 
-            // update current buffer info
-            idxTargetBufRow += 1;
-            bytesImgHandled += bytesImgWidth;
+    w->njobs    = nthreads * NUM_JOBS_PER_WORKER;
+    w->jobs     = calloc(w->njobs, sizeof(img_job_t));
+    w->threads  = calloc(nthreads, sizeof(pthread_t));
+    assert_exit(w->jobs && w->threads, "Failed to allocate placement workers");
 
-            // if buffer full, flush this patch row
-            if (idxTargetBufRow == PX_PATCH_HEIGHT)
-            {
-                idxTargetBufRow = 0;
-
-                // handle full width patches
-                size_t bytesHandledWid = 0;
-                for (size_t iFullWidPatch = 0; iFullWidPatch < numFullWidPatches; ++iFullWidPatch)
-                {
-                    // copy to patch buffer
-                    memcpy_mat(&matPatch, &matPatchRow, bytesHandledWid, BYTES_PATCH_WIDTH,
-                               PX_PATCH_HEIGHT);
-                    dispatch_patch(idxPatch, &matPatch, PX_PATCH_HEIGHT, PX_PATCH_WIDTH);
-
-                    idxPatch += 1;
-                    bytesHandledWid += BYTES_PATCH_WIDTH;
-                }
-
-                // handle partial width patch (if exists)
-                if (pxPartWidPatchWid > 0)
-                {
-                    // copy to patch buffer
-                    memcpy_mat(&matPatch, &matPatchRow, bytesHandledWid, bytesPartWidPatchWid,
-                               PX_PATCH_HEIGHT);
-                    dispatch_patch(idxPatch, &matPatch, PX_PATCH_HEIGHT, pxPartWidPatchWid);
-
-                    idxPatch += 1;
-                }
-            }
-        }
+    for (size_t iJob = 0; iJob < w->njobs; ++iJob)
+    {
+        w->jobs[iJob].span = malloc(NUM_FLASH_CHANNELS * BYTES_PATCH_PER_FC);
+        assert_exit(w->jobs[iJob].span, "Failed to allocate patch span");
+    }
 
-        // all image rows have been handled, but some may still in buffer
-        assert_exit((idxTargetBufRow < PX_PATCH_HEIGHT), "Unexpected idxTargetBufRow: %lu",
-                    idxTargetBufRow);
+    for (; w->nthreads < nthreads; ++w->nthreads)
+    {
+        int err = pthread_create(&w->threads[w->nthreads], NULL, placement_worker, w);
+        assert_exit(!err, "Failed to create placement worker (%s)", strerror(err));
+    }
 
-        if (idxTargetBufRow > 0)
-        {
-            // the buffer may contain garbages, do memset 0 for padding zeros
-            // memset_mat(patch, PX_PATCH_HEIGHT, BYTES_PATCH_WIDTH, 0);
+    return w;
+}
 
-            // dispatch partial height full width patches
-            size_t bytesHandledWid = 0;
-            for (size_t iFullWidPatch = 0; iFullWidPatch < numFullWidPatches; ++iFullWidPatch)
-            {
-                memcpy_mat(&matPatch, &matPatchRow, bytesHandledWid, BYTES_PATCH_WIDTH,
-                           idxTargetBufRow);
-                dispatch_patch(idxPatch, &matPatch, idxTargetBufRow, PX_PATCH_WIDTH);
+static void workers_close(img_workers_t *w)
+{
+    pthread_mutex_lock(&w->lock);
+    w->stop = true;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+
+    for (size_t iThread = 0; iThread < w->nthreads; ++iThread)
+        pthread_join(w->threads[iThread], NULL);
+
+    for (size_t iJob = 0; iJob < w->njobs; ++iJob)
+        free(w->jobs[iJob].span);
+
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    free(w->threads);
+    free(w->jobs);
+    free(w);
+}
 
-                idxPatch += 1;
-                bytesHandledWid += BYTES_PATCH_WIDTH;
-            }
+static void scatter_patch_row_parallel(img_scatter_t *sc, const uint8_t *const *rows,
+                                       size_t pxHeight, size_t pxWidth)
+{
+    img_workers_t *w = sc->workers;
+
+    pthread_mutex_lock(&w->lock);
+    w->rows     = rows;
+    w->pxHeight = pxHeight;
+    w->pxWidth  = pxWidth;
+    w->npatches    = (pxWidth + PX_PATCH_WIDTH - 1) / PX_PATCH_WIDTH;
+    w->planeStride = sc->planeStride;
+    w->iNext       = 0;
+    w->iEmit    = 0;
+    pthread_cond_broadcast(&w->cond);
+
+    while (w->iEmit < w->npatches)
+    {
+        img_job_t *job = &w->jobs[w->iEmit % w->njobs];
+        while (!job->done)
+            pthread_cond_wait(&w->cond, &w->lock);
+        pthread_mutex_unlock(&w->lock);
+
+        log_patch(sc->idxPatch++, pxHeight, patch_width(pxWidth, w->iEmit * PX_PATCH_WIDTH));
+        scatter_span(sc, job->span, job->len);
+
+        pthread_mutex_lock(&w->lock);
+        job->done = false;
+        w->iEmit += 1;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
 
-            // dispatch partial height partial width patch if exists
-            if (pxPartWidPatchWid > 0)
-            {
-                memcpy_mat(&matPatch, &matPatchRow, bytesHandledWid, bytesPartWidPatchWid,
-                           idxTargetBufRow);
-                dispatch_patch(idxPatch, &matPatch, idxTargetBufRow, pxPartWidPatchWid);
+/* -------------------------------------------------------------------------- */
+/*                              patch row dispatch                            */
+/* -------------------------------------------------------------------------- */
 
-                idxPatch += 1;
-            }
-        }
+static void scatter_begin(img_scatter_t *sc, bool parallel)
+{
+    *sc = (img_scatter_t){0};
+    if (parallel && numPlacementThreads > 1)
+        sc->workers = workers_open(numPlacementThreads);
+}
 
-        // if some data (< page size) still in buffers, force flush
-        if (get_fc_buffer_sz() > 0)
-        {
-            pr_info("FC_BUFFERS still not empty but the image_dispatch is ended, "
-                    "force flush");
-            flush_img_fc_buffer(true);
-        }
+/**
+ * @brief Dispatch one patch row (up to PX_PATCH_HEIGHT rows), patch by patch
+ *
+ * @param rows Pointers to the rows of the patch row, read in place
+ */
+static void scatter_patch_row(img_scatter_t *sc, const uint8_t *const *rows, size_t pxHeight,
+                              size_t pxWidth)
+{
+    if (sc->workers)
+    {
+        scatter_patch_row_parallel(sc, rows, pxHeight, pxWidth);
+        return;
+    }
 
-        free(matPatch.base);
-        free(matPatchRow.base);
+    for (size_t pxOff = 0; pxOff < pxWidth; pxOff += PX_PATCH_WIDTH, ++sc->idxPatch)
+    {
+        log_patch(sc->idxPatch, pxHeight, patch_width(pxWidth, pxOff));
+        walk_patch(rows, pxHeight, pxOff, patch_width(pxWidth, pxOff), sc->planeStride,
+                   scatter_blocks, sc);
     }
-    else
-        pr_error("Unexpected PlanarConfig: %u", cfgPlanar);
+}
 
-    _TIFFfree(buf);
-    TIFFClose(tif);
+/**
+ * @brief Pad the last pages with zeros and flush them
+ */
+static void scatter_finish(img_scatter_t *sc)
+{
+    if (sc->workers)
+        workers_close(sc->workers);
+    sc->workers = NULL;
+
+    if (!sc->packet)
+        return;
+
+    pr_info("The last packet is not full but the image_dispatch is ended, force flush");
+    for (size_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
+        memset(&sc->packet[iFC * BYTES_PER_PAGE + sc->off], 0, BYTES_PER_PAGE - sc->off);
+    scatter_flush(sc);
 }
 
 /* -------------------------------------------------------------------------- */
-/*                    implementation of internal functions                    */
+/*                     implementation of public functions                     */
 /* -------------------------------------------------------------------------- */
 
-void dispatch_patch(size_t iPatch, const ByteMatrix_t *matPatch, size_t pxHeight, size_t pxWidth)
+/**
+ * @brief Split the image into patches and dispatch with a row major policy
+ *
+ * @param imgFlatten The flatten RGB image
+ * @param pxWidth The width of the given image in pixels
+ * @param pxHeight The height of the given image in pixels
+ */
+void dispatch_image(uint8_t *imgFlatten, size_t pxWidth, size_t pxHeight)
 {
-    // make sure both the blk row width and height are 4N
-    const size_t bytesPatchWidth  = pxWidth * BYTES_PER_PIXEL;
-    const size_t pxBlkBufWidth    = ALIGN_UP(pxWidth, PX_BLK_WIDTH);
-    const size_t bytesBlkBufWidth = pxBlkBufWidth * BYTES_PER_PIXEL;
+    const size_t bytesImgWidth = pxWidth * BYTES_PER_PIXEL;
+    const uint8_t *rows[PX_PATCH_HEIGHT];
+    img_scatter_t sc;
 
-    // debug info, check whether the patch is full patch or not
-    if (pxHeight != PX_PATCH_HEIGHT || pxWidth != PX_PATCH_WIDTH)
-        pr_info("Patch[%lu] is a partial patch (H=%lu,W=%lu)", iPatch, pxHeight, pxWidth);
+    scatter_begin(&sc, true);
+    for (size_t iImgRow = 0; iImgRow < pxHeight; iImgRow += PX_PATCH_HEIGHT)
+    {
+        size_t nRows = (pxHeight - iImgRow < PX_PATCH_HEIGHT) ? pxHeight - iImgRow : PX_PATCH_HEIGHT;
+        for (size_t iRow = 0; iRow < nRows; ++iRow)
+            rows[iRow] = &imgFlatten[(iImgRow + iRow) * bytesImgWidth];
 
-    assert_exit(pxBlkBufWidth <= PX_PATCH_WIDTH, "Unexpected BlockRow Width %lu", pxBlkBufWidth);
+        scatter_patch_row(&sc, rows, nRows, pxWidth);
+    }
 
-    // allocate buffer for a block and block row
-    ByteMatrix_t matBlockRow = INIT_BYTE_MATRIX(PX_BLK_HEIGHT, bytesBlkBufWidth);
-    assert_exit(matBlockRow.base, "Failed to allocate memory for ByteMatrix");
+    scatter_finish(&sc);
+}
 
-    ARRAY_FROM_BYTE_MATRIX(blockRow, matBlockRow);
-    ARRAY_FROM_BYTE_MATRIX(patch, *matPatch);
+void dispatch_image_zero_padded(uint8_t *img, size_t pxWidth, size_t pxHeight) {}
+
+/**
+ * @brief Set the number of threads rendering patches, 0 or 1 for the serial placement
+ */
+void dispatch_set_threads(size_t nthreads) { numPlacementThreads = nthreads ? nthreads : 1; }
+
+/**
+ * @brief Place TIFF rows as they are decoded, holding a few batches instead of a patch row
+ */
+void dispatch_set_streaming(bool stream) { placementStream = stream; }
+
+/**
+ * @brief Set the number of threads decoding TIFF strips or tiles, 0 or 1 for one
+ */
+void dispatch_set_decoders(size_t nthreads) { numDecodeThreads = nthreads ? nthreads : 1; }
+
+/**
+ * @brief Stop placing the TIFF image once `cancelled` returns true (e.g. the writes failed)
+ */
+void dispatch_set_cancel(bool (*cancelled)(void)) { placementCancelled = cancelled; }
 
-    // handle patch (flush blockRow by blockRow)
-    size_t idxTargetBufRow = 0;
-    for (size_t iRow = 0; iRow < pxHeight; ++iRow)
+/* -------------------------------------------------------------------------- */
+/*                                TIFF placement                              */
+/* -------------------------------------------------------------------------- */
+
+// tiled images come as one batch per patch
+static void place_tiles(img_scatter_t *sc, tiff_decoder_t *decoder)
+{
+    const uint8_t *rows[PX_PATCH_HEIGHT];
+
+    for (const tiff_rows_t *batch; !placement_cancelled() && (batch = tiff_decoder_next(decoder));)
     {
-        // copy the whole row to target row of blockRow buffer
-        memcpy((*blockRow)[idxTargetBufRow], (*patch)[iRow], bytesPatchWidth);
-        idxTargetBufRow += 1;
+        for (size_t iRow = 0; iRow < batch->nRows; ++iRow)
+            rows[iRow] = &batch->rows[iRow * batch->bytesRow];
+
+        sc->planeStride = batch->planeStride;
+        scatter_patch_row(sc, rows, batch->nRows, batch->nCols);
+        tiff_decoder_release(decoder, batch);
+    }
+}
+
+// hold the batches of a whole patch row and scatter from them in place
+static void place_patch_rows(img_scatter_t *sc, tiff_decoder_t *decoder, size_t pxWidth,
+                             size_t pxHeight)
+{
+    // batches end at strip boundaries, so a patch row may come in more than 512 / 64 of them
+    const tiff_rows_t *batches[PX_PATCH_HEIGHT];
+    const uint8_t *rows[PX_PATCH_HEIGHT];
 
-        // blockRow buffer full, flush block by block (row major)
-        if (idxTargetBufRow == 4)
+    for (size_t iImgRow = 0; iImgRow < pxHeight && !placement_cancelled();)
+    {
+        size_t nBatches = 0, nRows = 0;
+        const tiff_rows_t *batch = NULL;
+        while (nRows < PX_PATCH_HEIGHT && iImgRow < pxHeight)
         {
-            idxTargetBufRow = 0;
-            dispatch_blk_row(&matBlockRow, pxBlkBufWidth);
-            memset_mat(&matBlockRow, 0, bytesBlkBufWidth); // clear blk buffer
+            // decoding failed, the patch row is left incomplete
+            if (!(batch = tiff_decoder_next(decoder)))
+                break;
+            assert_exit(batch->iRow == iImgRow, "Missing row %lu from decoder", iImgRow);
+
+            for (size_t iRow = 0; iRow < batch->nRows; ++iRow)
+                rows[nRows++] = &batch->rows[iRow * batch->bytesRow];
+            batches[nBatches++] = batch;
+            iImgRow += batch->nRows;
+            sc->planeStride = batch->planeStride;
         }
+
+        if (batch)
+            scatter_patch_row(sc, rows, nRows, pxWidth);
+
+        for (size_t iBatch = 0; iBatch < nBatches; ++iBatch)
+            tiff_decoder_release(decoder, batches[iBatch]);
+        if (!batch)
+            break;
     }
+}
 
-    // if partial height blockRow exists, do padding and flush
-    if (idxTargetBufRow > 0)
+// uncompressed rows are placed straight from the mapped file
+static void place_mapped(img_scatter_t *sc, tiff_map_t *map, size_t pxWidth, size_t pxHeight)
+{
+    const uint8_t *rows[PX_PATCH_HEIGHT];
+
+    sc->planeStride = tiff_map_plane_stride(map);
+    for (size_t iImgRow = 0; iImgRow < pxHeight && !placement_cancelled(); iImgRow += PX_PATCH_HEIGHT)
     {
-        // padding zeros to invalid rows
-        for (; idxTargetBufRow < PX_BLK_HEIGHT; ++idxTargetBufRow)
-            memset((*blockRow)[idxTargetBufRow], 0, bytesBlkBufWidth);
+        const size_t nRows = (pxHeight - iImgRow < PX_PATCH_HEIGHT) ? pxHeight - iImgRow
+                                                                    : PX_PATCH_HEIGHT;
+        for (size_t iRow = 0; iRow < nRows; ++iRow)
+            rows[iRow] = tiff_map_row(map, iImgRow + iRow);
 
-        // flush partial height blockRow
-        dispatch_blk_row(&matBlockRow, pxBlkBufWidth);
+        scatter_patch_row(sc, rows, nRows, pxWidth);
+        tiff_map_release(map, iImgRow + nRows);
     }
-
-    free(matBlockRow.base);
 }
 
-void dispatch_blk_row(const ByteMatrix_t *matBlkRow, size_t pxWidth)
+/*
+ * Streaming: each batch is placed as soon as it is decoded and released. The
+ * block rows of patch column 0 go straight to the packets, the other columns
+ * are rendered into their span at the column cursor, and emitted in patch
+ * order once the patch row is complete. The decoder holds a couple of
+ * batches per worker instead of a patch row, the spans hold the patch row
+ * minus one patch, since the device layout needs patch 0 complete before
+ * patch 1 starts.
+ */
+static void place_stream(img_scatter_t *sc, tiff_decoder_t *decoder, size_t pxWidth,
+                         size_t pxHeight)
 {
-    assert_exit(pxWidth % PX_BLK_WIDTH == 0, "BlockRow width should align to 4");
+    const size_t npatches = (pxWidth + PX_PATCH_WIDTH - 1) / PX_PATCH_WIDTH;
+    const uint8_t *rows[PX_PATCH_HEIGHT];
 
-    ARRAY_FROM_BYTE_MATRIX(blkRow, *matBlkRow);
-    for (size_t iPx = 0, iByte = 0; iPx < pxWidth; iPx += PX_BLK_WIDTH)
+    img_span_t *cols = calloc(npatches, sizeof(img_span_t));
+    assert_exit(cols, "Failed to allocate patch column cursors");
+    for (size_t iCol = 1; iCol < npatches; ++iCol)
     {
-        for (size_t iRow = 0; iRow < PX_BLK_HEIGHT; ++iRow)
+        cols[iCol].span = malloc(NUM_FLASH_CHANNELS * BYTES_PATCH_PER_FC);
+        assert_exit(cols[iCol].span, "Failed to allocate patch span");
+    }
+
+    for (const tiff_rows_t *batch; !placement_cancelled() && (batch = tiff_decoder_next(decoder));)
+    {
+        const size_t iPatchRow     = batch->iRow - batch->iRow % PX_PATCH_HEIGHT;
+        const size_t pxPatchHeight = (pxHeight - iPatchRow < PX_PATCH_HEIGHT) ? pxHeight - iPatchRow
+                                                                                : PX_PATCH_HEIGHT;
+        if (batch->iRow == iPatchRow)
+            log_patch(sc->idxPatch, pxPatchHeight, patch_width(pxWidth, 0));
+
+        for (size_t iRow = 0; iRow < batch->nRows; ++iRow)
+            rows[iRow] = &batch->rows[iRow * batch->bytesRow];
+        sc->planeStride = batch->planeStride;
+
+        for (size_t iCol = 0; iCol < npatches; ++iCol)
         {
-            // R
-            FC_BUFFERS[iRow][FC_BUFFER_SZ + 0]                 = (*blkRow)[iRow][iByte + 0];
-            FC_BUFFERS[iRow + PX_BLK_HEIGHT][FC_BUFFER_SZ + 0] = (*blkRow)[iRow][iByte + 0 + 6];
-            FC_BUFFERS[iRow][FC_BUFFER_SZ + 1]                 = (*blkRow)[iRow][iByte + 3];
-            FC_BUFFERS[iRow + PX_BLK_HEIGHT][FC_BUFFER_SZ + 1] = (*blkRow)[iRow][iByte + 3 + 6];
-
-            // G
-            FC_BUFFERS[iRow][FC_BUFFER_SZ + 2]                 = (*blkRow)[iRow][iByte + 1];
-            FC_BUFFERS[iRow + PX_BLK_HEIGHT][FC_BUFFER_SZ + 2] = (*blkRow)[iRow][iByte + 1 + 6];
-            FC_BUFFERS[iRow][FC_BUFFER_SZ + 3]                 = (*blkRow)[iRow][iByte + 4];
-            FC_BUFFERS[iRow + PX_BLK_HEIGHT][FC_BUFFER_SZ + 3] = (*blkRow)[iRow][iByte + 4 + 6];
-
-            // B
-            FC_BUFFERS[iRow][FC_BUFFER_SZ + 4]                 = (*blkRow)[iRow][iByte + 2];
-            FC_BUFFERS[iRow + PX_BLK_HEIGHT][FC_BUFFER_SZ + 4] = (*blkRow)[iRow][iByte + 2 + 6];
-            FC_BUFFERS[iRow][FC_BUFFER_SZ + 5]                 = (*blkRow)[iRow][iByte + 5];
-            FC_BUFFERS[iRow + PX_BLK_HEIGHT][FC_BUFFER_SZ + 5] = (*blkRow)[iRow][iByte + 5 + 6];
+            const size_t pxOff = iCol * PX_PATCH_WIDTH;
+            walk_patch(rows, batch->nRows, pxOff, patch_width(pxWidth, pxOff), sc->planeStride,
+                       iCol ? span_blocks : scatter_blocks, iCol ? (void *)&cols[iCol] : sc);
         }
+        tiff_decoder_release(decoder, batch);
 
-        FC_BUFFER_SZ += 6;
-        iByte += PX_BLK_WIDTH * BYTES_PER_PIXEL;
+        if (batch->iRow + batch->nRows < iPatchRow + pxPatchHeight)
+            continue;
+
+        // the patch row is complete, emit the held patches in order
+        sc->idxPatch += 1;
+        for (size_t iCol = 1; iCol < npatches; ++iCol, ++sc->idxPatch)
+        {
+            log_patch(sc->idxPatch, pxPatchHeight, patch_width(pxWidth, iCol * PX_PATCH_WIDTH));
+            scatter_span(sc, cols[iCol].span, cols[iCol].off);
+            cols[iCol].off = 0;
+        }
     }
 
-    // flush buffer and
-    flush_img_fc_buffer(false);
-    pr_debug("Truncate FC_BUFFERS to %lu bytes", FC_BUFFER_SZ);
+    for (size_t iCol = 1; iCol < npatches; ++iCol)
+        free(cols[iCol].span);
+    free(cols);
 }
 
-void flush_img_fc_buffer(bool force_flush)
+/**
+ * @brief Place the TIFF image at `path`, nothing is flushed if it cannot be placed
+ *
+ * @return 0, or -EINVAL if the image is not 8-bit RGB, -ENOENT if it cannot be opened,
+ *         -EIO if a strip or tile fails to decode, -ECANCELED if stopped by dispatch_set_cancel()
+ */
+int dispatch_tiff(const char *path)
 {
-    size_t bytesFlushedPerFC = 0;
-    while (FC_BUFFER_SZ >= BYTES_PER_PAGE)
-    {
-        // flush 1 page to each FC
-        for (size_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
-            flush_page_image(iFC, &FC_BUFFERS[iFC][bytesFlushedPerFC]);
+    assert_return(path != NULL, -EINVAL, "Path not given!");
 
-        FC_BUFFER_SZ -= BYTES_PER_PAGE;
-        bytesFlushedPerFC += BYTES_PER_PAGE;
-    }
+    // libtiff maps the whole file by default, its touched pages stay resident until close
+    TIFF *tif = TIFFOpen(path, placementStream ? "rm" : "r");
+    assert_return(tif != NULL, -ENOENT, "Failed to open TIFF file '%s'", path);
 
-    // if force flush, padding and flush
-    if (force_flush)
-    {
-        // flush 1 page to each FC
-        for (size_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
-            flush_page_image(iFC, &FC_BUFFERS[iFC][bytesFlushedPerFC]);
+    // get image attr: http://www.simplesystems.org/libtiff/functions/TIFFGetField.html
+    uint16_t cfgPlanar, nSamples, nBits;
+    uint32_t pxHeight, pxWidth;
 
-        FC_BUFFER_SZ = 0;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &pxWidth);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &pxHeight);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &cfgPlanar);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &nSamples);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &nBits);
+
+    pr_info("%s (%u, %u)", path, pxHeight, pxWidth);
+
+    // only R, G and B (the first 3 samples) of 8 bits are placed, in either layout
+    int err = -EINVAL;
+    assert_goto(nSamples >= 3 && nBits == 8, out, "Expect 8-bit RGB, but got %u samples of %u bits",
+                nSamples, nBits);
+
+    // the scanlines are decoded by another thread, and consumed batch by batch
+    tsize_t sz = TIFFScanlineSize(tif);
+    if (cfgPlanar == PLANARCONFIG_SEPARATE)
+        assert_goto(sz == pxWidth, out, "Line size of a plane should be pxWidth, but got %lu", sz);
+    else
+        assert_goto(sz == (pxWidth * 3), out, "Line size should be 3 x pxWidth, but got %lu", sz);
+
+    // planar batches are placed from their planes, without interleaving them first
+    assert_goto(cfgPlanar == PLANARCONFIG_CONTIG || cfgPlanar == PLANARCONFIG_SEPARATE, out,
+                "Unexpected PlanarConfig: %u", cfgPlanar);
+
+    img_scatter_t sc;
+    tiff_map_t *map = tiff_map_open(tif);
+
+    if (map)
+    {
+        scatter_begin(&sc, true);
+        place_mapped(&sc, map, pxWidth, pxHeight);
+        tiff_map_close(map);
+        err = 0;
     }
     else
     {
-        // move data to begining
-        uint8_t tmpValid[FC_BUFFER_SZ];
-        for (size_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
-        {
-            memcpy(tmpValid, &FC_BUFFERS[iFC][bytesFlushedPerFC], FC_BUFFER_SZ);
-            memcpy(FC_BUFFERS[iFC], tmpValid, FC_BUFFER_SZ);
-        }
+        tiff_decoder_t *decoder = tiff_decoder_open(tif, path, numDecodeThreads, placementStream);
+        err                     = -ENOMEM;
+        assert_goto(decoder, out, "Failed to start TIFF decoder");
+
+        scatter_begin(&sc, !placementStream);
+        if (TIFFIsTiled(tif))
+            place_tiles(&sc, decoder);
+        else if (placementStream)
+            place_stream(&sc, decoder, pxWidth, pxHeight);
+        else
+            place_patch_rows(&sc, decoder, pxWidth, pxHeight);
+
+        err = tiff_decoder_close(decoder);
     }
+    scatter_finish(&sc);
+    if (!err)
+        err = placement_cancelled() ? -ECANCELED : 0;
+
+out:
+    TIFFClose(tif);
+    return err;
 }
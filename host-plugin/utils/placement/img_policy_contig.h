@@ -6,6 +6,18 @@
 #include "./common.h"
 #include "../flash_config.h"
 
+/* -------------------------------------------------------------------------- */
+/*                                 build flags                                */
+/* -------------------------------------------------------------------------- */
+
+// A build with its own page flush (USER_FLUSH_IMAGE=true, as the plugin) also
+// lends its packet buffers to placement, which scatters pixels straight into
+// them instead of a staging packet copied page by page. Build with
+// USER_FLUSH_IMAGE_PACKET=false to keep the page by page flush.
+#if !defined(USER_FLUSH_IMAGE_PACKET) && (USER_FLUSH_IMAGE == true)
+#define USER_FLUSH_IMAGE_PACKET true
+#endif
+
 /* -------------------------------------------------------------------------- */
 /*                              image attributes                              */
 /* -------------------------------------------------------------------------- */
@@ -80,8 +92,12 @@
 /*                              public interfaces                             */
 /* -------------------------------------------------------------------------- */
 
-void dispatch_tiff(const char *path);
+int dispatch_tiff(const char *path);
 void dispatch_image(uint8_t *img, size_t pxWidth, size_t pxHeight);
 void dispatch_image_zero_padded(uint8_t *img, size_t pxWidth, size_t pxHeight);
+void dispatch_set_threads(size_t nthreads);
+void dispatch_set_streaming(bool stream);
+void dispatch_set_decoders(size_t nthreads);
+void dispatch_set_cancel(bool (*cancelled)(void));
 
 #endif /* __NMC_HOST_PLUGIN_IMG_PLACEMENT_CONTIG_H__ */
\ No newline at end of file
@@ -0,0 +1,640 @@
+#include "tiff_decoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "./img_policy_contig.h"
+#include "../spsc_ring.h"
+#include "../debug.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              internal members                              */
+/* -------------------------------------------------------------------------- */
+
+typedef enum
+{
+    TIFF_READ_SCANLINES,
+    TIFF_READ_STRIPS,
+    TIFF_READ_TILES,
+} tiff_read_t;
+
+// a batch of rows of a stripped image, inside a turn and a patch row
+typedef struct
+{
+    uint32_t iRow;
+    uint32_t nRows;
+    uint32_t iWorker;
+} tiff_item_t;
+
+typedef struct
+{
+    tiff_decoder_t *dec;
+    TIFF *tif; // libtiff handles are not thread-safe, each worker has its own
+    uint32_t iWorker;
+    pthread_t thread;
+
+    // a strip or tile which does not map onto a batch is decoded here first, one per plane
+    uint8_t *scratch[NUM_CHANNELS_PER_PIXEL];
+    uint32_t idxScratch[NUM_CHANNELS_PER_PIXEL]; // strip or tile held, UINT32_MAX if none
+
+    size_t nBatches;
+    tiff_rows_t *batches;
+
+    spsc_ring_t free; // placement -> worker
+    spsc_ring_t full; // worker -> placement
+} tiff_worker_t;
+
+struct tiff_decoder
+{
+    uint32_t pxWidth;
+    uint32_t pxHeight;
+    uint16_t nPlanes;  // 3 if planar, else 1
+    size_t bytesPixel; // bytes per pixel of a plane
+
+    tiff_read_t read;
+    uint32_t pxStripHeight; // rows per strip
+    uint32_t pxTileWidth;
+    uint32_t pxTileHeight;
+    size_t bytesScratch;
+
+    // item i (a batch of rows, or a patch if tiled) is decoded by item_worker()
+    uint32_t nBatchRows; // rows per batch of each plane
+    uint32_t nTurnRows;  // whole strips a worker decodes in its turn
+    uint32_t nPatchCols; // patches per patch row
+    tiff_item_t *items;  // NULL if tiled
+    size_t nItems;
+    size_t iNext; // next item given to placement
+
+    size_t nWorkers;
+    tiff_worker_t *workers;
+    bool stop; // placement is done, even if rows are left
+    int err;   // first strip, tile or scanline that failed to decode
+};
+
+struct tiff_map
+{
+    uint8_t *base; // the whole file, read-only
+    size_t bytes;
+
+    uint32_t pxHeight;
+    uint32_t pxStripHeight;
+    uint32_t nStrips; // strips per plane
+    uint16_t nPlanes;
+    size_t bytesRow;    // bytes of each row (of each plane)
+    size_t planeStride; // bytes between the planes of a row, 0 if interleaved
+    uint64_t *offsets;  // of the strips of plane 0
+
+    // rows are placed in order and the strips are stored in order, so the
+    // mapping below the next row of each plane can be dropped
+    bool ordered;
+    size_t dropped[NUM_CHANNELS_PER_PIXEL]; // offset of each plane dropped up to
+};
+
+static inline uint32_t min_u32(uint32_t a, uint32_t b) { return (a < b) ? a : b; }
+static inline uint32_t max_u32(uint32_t a, uint32_t b) { return (a > b) ? a : b; }
+
+static inline size_t item_worker(const tiff_decoder_t *dec, size_t iItem)
+{
+    return dec->items ? dec->items[iItem].iWorker : iItem % dec->nWorkers;
+}
+
+// keep the first error, the workers stop and tiff_decoder_next() ends the rows
+static void decode_failed(tiff_decoder_t *dec)
+{
+    int none = 0;
+    __atomic_compare_exchange_n(&dec->err, &none, -EIO, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Decode strip or tile `idx` to `dst`, the decoder fails if it is broken
+ */
+static void read_encoded(tiff_worker_t *w, uint32_t idx, uint8_t *dst, size_t sz)
+{
+    const bool tiled = (w->dec->read == TIFF_READ_TILES);
+
+    tmsize_t got = tiled ? TIFFReadEncodedTile(w->tif, idx, dst, sz)
+                         : TIFFReadEncodedStrip(w->tif, idx, dst, sz);
+    if (got < 0)
+    {
+        pr_error("Failed to read %s %u", tiled ? "tile" : "strip", idx);
+        decode_failed(w->dec);
+    }
+}
+
+static const uint8_t *read_scratch(tiff_worker_t *w, uint16_t iPlane, uint32_t idx)
+{
+    if (w->idxScratch[iPlane] != idx)
+    {
+        read_encoded(w, idx, w->scratch[iPlane], w->dec->bytesScratch);
+        w->idxScratch[iPlane] = idx;
+    }
+
+    return w->scratch[iPlane];
+}
+
+static void read_scanlines(tiff_worker_t *w, tiff_rows_t *batch, uint16_t iPlane)
+{
+    uint8_t *plane = &batch->rows[iPlane * batch->planeStride];
+
+    for (uint32_t iRow = 0; iRow < batch->nRows; ++iRow)
+    {
+        // read line from tiff (the sample param is used in PlanarConfiguration == 2)
+        uint8_t *row = &plane[iRow * batch->bytesRow];
+        if (TIFFReadScanline(w->tif, row, batch->iRow + iRow, iPlane) < 0)
+        {
+            pr_error("Failed to read scanline %u", batch->iRow + iRow);
+            decode_failed(w->dec);
+            return;
+        }
+    }
+}
+
+static void read_strips(tiff_worker_t *w, tiff_rows_t *batch, uint16_t iPlane)
+{
+    const tiff_decoder_t *dec = w->dec;
+    const uint32_t iEnd       = batch->iRow + batch->nRows;
+    const size_t bytesRow     = batch->bytesRow;
+    uint8_t *plane            = &batch->rows[iPlane * batch->planeStride];
+
+    for (uint32_t iRow = batch->iRow; iRow < iEnd;)
+    {
+        const uint32_t iStrip     = TIFFComputeStrip(w->tif, iRow, iPlane);
+        const uint32_t iStripRow  = iRow - iRow % dec->pxStripHeight;
+        const uint32_t nStripRows = min_u32(dec->pxStripHeight, dec->pxHeight - iStripRow);
+        uint8_t *dst              = &plane[(iRow - batch->iRow) * bytesRow];
+
+        // the whole strip lies in the batch
+        if (iRow == iStripRow && iStripRow + nStripRows <= iEnd)
+        {
+            read_encoded(w, iStrip, dst, nStripRows * bytesRow);
+            iRow += nStripRows;
+            continue;
+        }
+
+        const uint32_t nRows = min_u32(iStripRow + nStripRows, iEnd) - iRow;
+        const uint8_t *src   = read_scratch(w, iPlane, iStrip);
+        memcpy(dst, &src[(iRow - iStripRow) * bytesRow], nRows * bytesRow);
+        iRow += nRows;
+    }
+}
+
+static void read_tiles(tiff_worker_t *w, tiff_rows_t *batch, uint16_t iPlane)
+{
+    const tiff_decoder_t *dec = w->dec;
+    const uint32_t tw = dec->pxTileWidth, th = dec->pxTileHeight;
+    const uint32_t yEnd = batch->iRow + batch->nRows, xEnd = batch->iCol + batch->nCols;
+    const size_t bytesTileRow = tw * dec->bytesPixel;
+    uint8_t *plane = &batch->rows[iPlane * batch->planeStride];
+
+    for (uint32_t y = batch->iRow - batch->iRow % th; y < yEnd; y += th)
+    {
+        for (uint32_t x = batch->iCol - batch->iCol % tw; x < xEnd; x += tw)
+        {
+            const uint32_t iTile = TIFFComputeTile(w->tif, x, y, 0, iPlane);
+
+            // the part of the tile inside the patch
+            const uint32_t y0 = max_u32(y, batch->iRow), y1 = min_u32(y + th, yEnd);
+            const uint32_t x0 = max_u32(x, batch->iCol), x1 = min_u32(x + tw, xEnd);
+            uint8_t *dst = &plane[(y0 - batch->iRow) * batch->bytesRow +
+                                  (x0 - batch->iCol) * dec->bytesPixel];
+
+            // a patch-wide tile has the row layout of the batch
+            if (bytesTileRow == batch->bytesRow && x == batch->iCol && y >= batch->iRow &&
+                y - batch->iRow + th <= PX_PATCH_HEIGHT)
+            {
+                read_encoded(w, iTile, dst, dec->bytesScratch);
+                continue;
+            }
+
+            const uint8_t *src = read_scratch(w, iPlane, iTile);
+            for (uint32_t iRow = y0; iRow < y1; ++iRow)
+                memcpy(&dst[(iRow - y0) * batch->bytesRow],
+                       &src[(iRow - y) * bytesTileRow + (x0 - x) * dec->bytesPixel],
+                       (x1 - x0) * dec->bytesPixel);
+        }
+    }
+}
+
+static void *tiff_decoder_worker(void *arg)
+{
+    tiff_worker_t *w          = arg;
+    const tiff_decoder_t *dec = w->dec;
+
+    for (size_t iItem = 0; iItem < dec->nItems; ++iItem)
+    {
+        if (item_worker(dec, iItem) != w->iWorker)
+            continue;
+
+        // tiff_decoder_close() or a failed item stops the worker before its next item
+        tiff_rows_t *batch = spsc_ring_pop(&w->free);
+        if (!batch || __atomic_load_n(&dec->stop, __ATOMIC_ACQUIRE) ||
+            __atomic_load_n(&dec->err, __ATOMIC_ACQUIRE))
+            break;
+
+        if (dec->read == TIFF_READ_TILES)
+        {
+            // one batch per patch, in placement order
+            batch->iRow  = (iItem / dec->nPatchCols) * PX_PATCH_HEIGHT;
+            batch->iCol  = (iItem % dec->nPatchCols) * PX_PATCH_WIDTH;
+            batch->nRows = min_u32(PX_PATCH_HEIGHT, dec->pxHeight - batch->iRow);
+            batch->nCols = min_u32(PX_PATCH_WIDTH, dec->pxWidth - batch->iCol);
+        }
+        else
+        {
+            batch->iRow  = dec->items[iItem].iRow;
+            batch->iCol  = 0;
+            batch->nRows = dec->items[iItem].nRows;
+            batch->nCols = dec->pxWidth;
+        }
+
+        for (uint16_t iPlane = 0; iPlane < dec->nPlanes; ++iPlane)
+        {
+            if (dec->read == TIFF_READ_TILES)
+                read_tiles(w, batch, iPlane);
+            else if (dec->read == TIFF_READ_STRIPS)
+                read_strips(w, batch, iPlane);
+            else
+                read_scanlines(w, batch, iPlane);
+        }
+
+        spsc_ring_push(&w->full, batch);
+    }
+
+    spsc_ring_close(&w->full);
+    return NULL;
+}
+
+/**
+ * @brief Cut the rows into items, each inside a turn and a patch row
+ *
+ * Worker k decodes turns k, k + n, ... of whole strips, so every strip is
+ * decoded once: in place if it lies in an item, else into the scratch of its
+ * worker, which cuts it into consecutive items.
+ *
+ * @return The most items a worker has in a patch row
+ */
+static size_t tiff_decoder_plan(tiff_decoder_t *dec)
+{
+    const uint32_t pxHeight = dec->pxHeight;
+    const size_t maxItems   = pxHeight / dec->nBatchRows + pxHeight / dec->nTurnRows +
+                            pxHeight / PX_PATCH_HEIGHT + 3; // an item ends one of them
+
+    size_t *nHeld = calloc(dec->nWorkers, sizeof(size_t));
+    dec->items    = calloc(maxItems, sizeof(tiff_item_t));
+    assert_exit(nHeld && dec->items, "Failed to allocate decoder items");
+
+    size_t nMost = 0;
+    for (uint32_t iRow = 0; iRow < pxHeight;)
+    {
+        const uint32_t iTurn = iRow / dec->nTurnRows;
+        uint32_t nRows       = min_u32(dec->nBatchRows, pxHeight - iRow);
+        nRows                = min_u32(nRows, dec->nTurnRows - iRow % dec->nTurnRows);
+        nRows                = min_u32(nRows, PX_PATCH_HEIGHT - iRow % PX_PATCH_HEIGHT);
+
+        tiff_item_t *item = &dec->items[dec->nItems++];
+        *item = (tiff_item_t){.iRow = iRow, .nRows = nRows, .iWorker = iTurn % dec->nWorkers};
+
+        if (iRow % PX_PATCH_HEIGHT == 0)
+            memset(nHeld, 0, dec->nWorkers * sizeof(size_t));
+        nHeld[item->iWorker] += 1;
+        nMost = (nHeld[item->iWorker] > nMost) ? nHeld[item->iWorker] : nMost;
+
+        iRow += nRows;
+    }
+
+    free(nHeld);
+    return nMost;
+}
+
+static void tiff_worker_free(tiff_worker_t *w, TIFF *tifShared)
+{
+    for (size_t iBatch = 0; iBatch < w->nBatches; ++iBatch)
+        free(w->batches[iBatch].rows);
+    for (uint16_t iPlane = 0; iPlane < NUM_CHANNELS_PER_PIXEL; ++iPlane)
+        free(w->scratch[iPlane]);
+
+    if (w->tif && w->tif != tifShared)
+        TIFFClose(w->tif);
+
+    spsc_ring_free(&w->free);
+    spsc_ring_free(&w->full);
+    free(w->batches);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start decoding an 8-bit RGB image, contig or planar
+ *
+ * @param path The file of `tif`, opened again by each worker after the first
+ * @param nWorkers Decoder threads, 0 or 1 for one
+ * @param stream Placement releases each batch before it takes the next, else it
+ *               holds the batches of a patch row
+ */
+tiff_decoder_t *tiff_decoder_open(TIFF *tif, const char *path, size_t nWorkers, bool stream)
+{
+    tiff_decoder_t *dec = calloc(1, sizeof(tiff_decoder_t));
+    assert_return(dec, NULL, "Failed to allocate decoder");
+
+    uint16_t cfgPlanar = PLANARCONFIG_CONTIG;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &dec->pxWidth);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &dec->pxHeight);
+    TIFFGetField(tif, TIFFTAG_PLANARCONFIG, &cfgPlanar);
+
+    dec->nPlanes    = (cfgPlanar == PLANARCONFIG_SEPARATE) ? NUM_CHANNELS_PER_PIXEL : 1;
+    dec->bytesPixel = BYTES_PER_PIXEL / dec->nPlanes;
+    dec->nWorkers   = nWorkers ? nWorkers : 1;
+
+    // rows of each plane in a batch
+    uint32_t pxBatchWidth = dec->pxWidth;
+    if (TIFFIsTiled(tif))
+    {
+        TIFFGetField(tif, TIFFTAG_TILEWIDTH, &dec->pxTileWidth);
+        TIFFGetField(tif, TIFFTAG_TILELENGTH, &dec->pxTileHeight);
+        dec->read         = TIFF_READ_TILES;
+        dec->bytesScratch = TIFFTileSize(tif);
+        dec->nBatchRows   = PX_PATCH_HEIGHT;
+        dec->nPatchCols   = (dec->pxWidth + PX_PATCH_WIDTH - 1) / PX_PATCH_WIDTH;
+        dec->nItems       = dec->nPatchCols * ((dec->pxHeight + PX_PATCH_HEIGHT - 1) / PX_PATCH_HEIGHT);
+        pxBatchWidth      = PX_PATCH_WIDTH;
+        pr_debug("Tiled TIFF (%u x %u tiles)", dec->pxTileWidth, dec->pxTileHeight);
+    }
+    else
+    {
+        if (!TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &dec->pxStripHeight))
+            dec->pxStripHeight = dec->pxHeight;
+        dec->pxStripHeight = max_u32(min_u32(dec->pxStripHeight, dec->pxHeight), 1);
+
+        // compressed scanlines can not be read back and forth between planes. A strip
+        // taller than a patch row is decoded whole into the scratch of its worker,
+        // unless there is nothing to share, then one worker reads scanlines to bound memory
+        uint16_t compression = COMPRESSION_NONE;
+        TIFFGetField(tif, TIFFTAG_COMPRESSION, &compression);
+        const bool tall   = dec->pxStripHeight > PX_PATCH_HEIGHT;
+        const bool shared = dec->nWorkers > 1 && dec->pxStripHeight < dec->pxHeight;
+        dec->read = (!tall || shared || (dec->nPlanes > 1 && compression != COMPRESSION_NONE))
+                        ? TIFF_READ_STRIPS
+                        : TIFF_READ_SCANLINES;
+        dec->bytesScratch = (dec->read == TIFF_READ_STRIPS) ? TIFFStripSize(tif) : 0;
+
+        // scanlines are read in order
+        if (dec->read == TIFF_READ_SCANLINES)
+            dec->nWorkers = 1;
+
+        // a turn is as many strips as fill a batch (at least one), and whole block
+        // rows, which streaming places batch by batch. A turn which does not divide
+        // a patch row is cut into batches of TIFF_DECODER_ROWS_PER_BATCH
+        uint32_t nBlkStrips = 1;
+        while (nBlkStrips * dec->pxStripHeight % PX_BLK_HEIGHT)
+            nBlkStrips += 1;
+        uint32_t nTurnStrips = TIFF_DECODER_ROWS_PER_BATCH / dec->pxStripHeight;
+        nTurnStrips          = max_u32(nTurnStrips - nTurnStrips % nBlkStrips, nBlkStrips);
+        dec->nTurnRows       = nTurnStrips * dec->pxStripHeight;
+        dec->nBatchRows      = dec->nTurnRows;
+        if (dec->nTurnRows > TIFF_DECODER_ROWS_PER_BATCH && PX_PATCH_HEIGHT % dec->nTurnRows)
+            dec->nBatchRows = TIFF_DECODER_ROWS_PER_BATCH;
+        pr_debug("Stripped TIFF (%u rows per strip)", dec->pxStripHeight);
+    }
+
+    /*
+     * Placement holds the items of a patch row (one if streaming), so a worker
+     * must have a batch for each of its items there. One more keeps it
+     * decoding while placement consumes.
+     */
+    const size_t nHeld      = TIFFIsTiled(tif) ? 1 : tiff_decoder_plan(dec);
+    const size_t nBatches   = (stream ? 1 : nHeld) + 1;
+    const size_t bytesRow   = pxBatchWidth * dec->bytesPixel;
+    const size_t bytesPlane = dec->nBatchRows * bytesRow;
+    const size_t bytesBatch = ALIGN_UP(dec->nPlanes * bytesPlane, getpagesize());
+
+    dec->workers = calloc(dec->nWorkers, sizeof(tiff_worker_t));
+    assert_exit(dec->workers, "Failed to allocate decoder workers");
+
+    for (size_t iWorker = 0; iWorker < dec->nWorkers; ++iWorker)
+    {
+        tiff_worker_t *w = &dec->workers[iWorker];
+
+        w->dec     = dec;
+        w->iWorker = iWorker;
+
+        // without mapping: the workers would each keep their touched pages of the file resident
+        w->tif = iWorker ? TIFFOpen(path, "rm") : tif;
+        assert_exit(w->tif, "Failed to open '%s' for decoder worker %lu", path, iWorker);
+
+        for (uint16_t iPlane = 0; iPlane < dec->nPlanes; ++iPlane)
+        {
+            w->idxScratch[iPlane] = UINT32_MAX;
+            if (dec->bytesScratch)
+            {
+                w->scratch[iPlane] = malloc(dec->bytesScratch);
+                assert_exit(w->scratch[iPlane], "Failed to allocate scratch buffer");
+            }
+        }
+
+        assert_exit(spsc_ring_init(&w->free, nBatches), "Failed to allocate ring");
+        assert_exit(spsc_ring_init(&w->full, nBatches), "Failed to allocate ring");
+
+        w->nBatches = nBatches;
+        w->batches  = calloc(nBatches, sizeof(tiff_rows_t));
+        assert_exit(w->batches, "Failed to allocate row batches");
+
+        for (size_t iBatch = 0; iBatch < nBatches; ++iBatch)
+        {
+            w->batches[iBatch].bytesRow    = bytesRow;
+            w->batches[iBatch].planeStride = (dec->nPlanes > 1) ? bytesPlane : 0;
+            w->batches[iBatch].iWorker     = iWorker;
+            w->batches[iBatch].rows        = aligned_alloc(getpagesize(), bytesBatch);
+            assert_exit(w->batches[iBatch].rows, "Failed to allocate row batch");
+            spsc_ring_push(&w->free, &w->batches[iBatch]);
+        }
+    }
+
+    for (size_t iWorker = 0; iWorker < dec->nWorkers; ++iWorker)
+    {
+        int err = pthread_create(&dec->workers[iWorker].thread, NULL, tiff_decoder_worker,
+                                 &dec->workers[iWorker]);
+        assert_exit(!err, "Failed to create decoder thread (%s)", strerror(err));
+    }
+
+    pr_debug("Decoding with %lu workers, %lu batches of %u rows each", dec->nWorkers, nBatches,
+             dec->nBatchRows);
+    return dec;
+}
+
+/**
+ * @brief Stop the workers and release the decoder
+ *
+ * @return 0, or -EIO if a strip, tile or scanline failed to decode
+ */
+int tiff_decoder_close(tiff_decoder_t *dec)
+{
+    TIFF *tifShared = dec->workers[0].tif;
+    int err         = dec->err;
+
+    // placement may stop early, the workers stop instead of decoding the rest of the file
+    __atomic_store_n(&dec->stop, true, __ATOMIC_RELEASE);
+    for (size_t iWorker = 0; iWorker < dec->nWorkers; ++iWorker)
+        spsc_ring_close(&dec->workers[iWorker].free);
+
+    for (size_t iWorker = 0; iWorker < dec->nWorkers; ++iWorker)
+        pthread_join(dec->workers[iWorker].thread, NULL);
+
+    for (size_t iWorker = 0; iWorker < dec->nWorkers; ++iWorker)
+        tiff_worker_free(&dec->workers[iWorker], tifShared);
+
+    free(dec->workers);
+    free(dec->items);
+    free(dec);
+    return err;
+}
+
+/**
+ * @brief Get the next batch of decoded rows (in image order)
+ *
+ * @return The batch, or NULL if all rows have been consumed or decoding failed
+ *         (tiff_decoder_close() tells them apart)
+ */
+const tiff_rows_t *tiff_decoder_next(tiff_decoder_t *dec)
+{
+    if (dec->iNext == dec->nItems || __atomic_load_n(&dec->err, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    tiff_rows_t *batch = spsc_ring_pop(&dec->workers[item_worker(dec, dec->iNext)].full);
+    if (batch)
+        dec->iNext += 1;
+
+    return batch;
+}
+
+void tiff_decoder_release(tiff_decoder_t *dec, const tiff_rows_t *rows)
+{
+    spsc_ring_push(&dec->workers[rows->iWorker].free, (void *)rows);
+}
+
+/**
+ * @brief Map the rows of an uncompressed, stripped image, contig or planar
+ *
+ * @return The mapping, or NULL if the image has to be decoded
+ */
+tiff_map_t *tiff_map_open(TIFF *tif)
+{
+    uint16_t compression = COMPRESSION_NONE, cfgPlanar = PLANARCONFIG_CONTIG;
+    uint32_t pxWidth, pxHeight, pxStripHeight;
+
+    TIFFGetField(tif, TIFFTAG_COMPRESSION, &compression);
+    TIFFGetField(tif, TIFFTAG_PLANARCONFIG, &cfgPlanar);
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &pxWidth);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &pxHeight);
+    if (!TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &pxStripHeight))
+        pxStripHeight = pxHeight;
+
+    if (TIFFIsTiled(tif) || compression != COMPRESSION_NONE || !pxHeight)
+        return NULL;
+
+    struct stat st;
+    if (fstat(TIFFFileno(tif), &st) || !S_ISREG(st.st_mode))
+        return NULL;
+
+    tiff_map_t *map = calloc(1, sizeof(tiff_map_t));
+    assert_return(map, NULL, "Failed to allocate TIFF mapping");
+
+    map->bytes         = st.st_size;
+    map->pxHeight      = pxHeight;
+    map->pxStripHeight = min_u32(pxStripHeight, pxHeight);
+    map->nStrips       = (pxHeight + map->pxStripHeight - 1) / map->pxStripHeight;
+    map->nPlanes       = (cfgPlanar == PLANARCONFIG_SEPARATE) ? NUM_CHANNELS_PER_PIXEL : 1;
+    map->bytesRow      = (size_t)pxWidth * BYTES_PER_PIXEL / map->nPlanes;
+    map->ordered       = true;
+
+    map->offsets = calloc(map->nStrips, sizeof(uint64_t));
+    assert_goto(map->offsets, fail, "Failed to allocate strip offsets");
+
+    // every strip must hold its rows, the planes of a row must be a fixed stride apart
+    uint64_t prev = 0;
+    for (uint16_t iPlane = 0; iPlane < map->nPlanes; ++iPlane)
+    {
+        for (uint32_t iStrip = 0; iStrip < map->nStrips; ++iStrip)
+        {
+            const uint32_t idx   = iPlane * map->nStrips + iStrip;
+            const uint64_t off   = TIFFGetStrileOffset(tif, idx);
+            const uint64_t bytes = (uint64_t)min_u32(map->pxStripHeight,
+                                                     pxHeight - iStrip * map->pxStripHeight) *
+                                   map->bytesRow;
+
+            if (TIFFGetStrileByteCount(tif, idx) < bytes || off + bytes > map->bytes)
+                goto fail;
+
+            if (!iPlane)
+                map->offsets[iStrip] = off;
+            else if (iPlane == 1 && !iStrip && off > map->offsets[0])
+                map->planeStride = off - map->offsets[0];
+            else if (off != map->offsets[iStrip] + iPlane * map->planeStride)
+                goto fail;
+
+            map->ordered = map->ordered && off >= prev;
+            prev         = off;
+        }
+    }
+
+    map->base = mmap(NULL, map->bytes, PROT_READ, MAP_SHARED, TIFFFileno(tif), 0);
+    assert_goto(map->base != MAP_FAILED, fail, "Failed to map TIFF file (%s)", strerror(errno));
+    madvise(map->base, map->bytes, MADV_SEQUENTIAL);
+
+    for (uint16_t iPlane = 0; iPlane < map->nPlanes; ++iPlane)
+        map->dropped[iPlane] = ALIGN_DOWN(map->offsets[0] + iPlane * map->planeStride, getpagesize());
+
+    pr_debug("Mapped TIFF rows (%u rows per strip, %u planes)", map->pxStripHeight, map->nPlanes);
+    return map;
+
+fail:
+    free(map->offsets);
+    free(map);
+    return NULL;
+}
+
+void tiff_map_close(tiff_map_t *map)
+{
+    munmap(map->base, map->bytes);
+    free(map->offsets);
+    free(map);
+}
+
+/**
+ * @brief Get row `iRow` (of plane 0, the others follow tiff_map_plane_stride() apart)
+ */
+const uint8_t *tiff_map_row(const tiff_map_t *map, uint32_t iRow)
+{
+    return &map->base[map->offsets[iRow / map->pxStripHeight] +
+                      (iRow % map->pxStripHeight) * map->bytesRow];
+}
+
+size_t tiff_map_plane_stride(const tiff_map_t *map) { return map->planeStride; }
+
+/**
+ * @brief Placement is done with the rows before `iRow`, drop their pages from the mapping
+ */
+void tiff_map_release(tiff_map_t *map, uint32_t iRow)
+{
+    if (!map->ordered || iRow >= map->pxHeight)
+        return;
+
+    for (uint16_t iPlane = 0; iPlane < map->nPlanes; ++iPlane)
+    {
+        const uint8_t *row = tiff_map_row(map, iRow) + iPlane * map->planeStride;
+        const size_t end   = ALIGN_DOWN((size_t)(row - map->base), getpagesize());
+
+        if (end > map->dropped[iPlane])
+        {
+            madvise(&map->base[map->dropped[iPlane]], end - map->dropped[iPlane], MADV_DONTNEED);
+            map->dropped[iPlane] = end;
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef __NMC_HOST_PLUGIN_TIFF_DECODER_H__
+#define __NMC_HOST_PLUGIN_TIFF_DECODER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "tiffio.h"
+#include "./common.h"
+
+// Decoder stage of the upload pipeline
+//
+//   decoder worker k                                  placement thread
+//   TIFFReadEncodedStrip/Tile() -> full ring k -> tiff_decoder_next() -> dispatch
+//                               <- free ring k <- tiff_decoder_release()
+//
+// Rows are decoded in batches into page-aligned buffers, so libtiff decoding
+// overlaps with block rearrangement and device I/O. Placement holds the batches
+// of a whole patch row (512 rows) while it scatters them, the decoder works on
+// the next patch row meanwhile.
+//
+// Batches are independent, so they are decoded by a pool of workers, each
+// with its own TIFF handle, batches and rings, and placement takes each batch
+// from the worker decoding it, so rows still come in image order.
+//
+// Stripped images are handed out by strip: worker k decodes turns k, k + n,
+// ... of whole strips (a strip, or short strips up to 64 rows) and cuts each
+// turn into batches that end at the turn and at patch rows. A strip inside a
+// batch is decoded in place, a strip cut into several batches is decoded once
+// into the scratch buffer of its worker, so every strip is decoded exactly
+// once. Strips taller than a patch row with a single worker (or a single
+// strip) are read with TIFFReadScanline() instead, to bound memory, except
+// compressed planar ones, whose planes can not be read in turns.
+//
+// A strip, tile or scanline which fails to decode stops the workers, no
+// zeros are placed for it: tiff_decoder_next() ends the rows early and
+// tiff_decoder_close() returns -EIO.
+//
+// Tiled images are decoded into one batch per patch (up to 512 x 512 pixels),
+// worker k decoding patches k, k + n, ... in placement order, so no full-width
+// patch row is assembled. Tiles 512
+// pixels wide are decoded in place, other tiles are cropped into the batch.
+//
+// Planar images (PLANARCONFIG_SEPARATE) are kept planar: a batch holds its R,
+// G and B planes one after another, so strips and tiles of a plane are still
+// decoded in place, and row i of plane p is at rows + p * planeStride + i *
+// bytesRow.
+//
+// Uncompressed stripped images skip the decoder: tiff_map_open() maps the
+// file and placement reads the rows straight from the page cache. Rows it is
+// done with are dropped from the mapping, so the resident set stays bounded.
+
+#define TIFF_DECODER_ROWS_PER_BATCH 64
+
+typedef struct
+{
+    uint8_t *rows;      // nRows x bytesRow, page-aligned
+    uint32_t iRow;      // index of the first row in image
+    uint32_t nRows;     // number of valid rows
+    uint32_t iCol;      // index of the first column in image
+    uint32_t nCols;     // number of valid columns
+    size_t bytesRow;    // bytes of each row (of each plane)
+    size_t planeStride; // bytes between the planes, 0 if interleaved
+    uint32_t iWorker;   // decoder worker owning the batch
+} tiff_rows_t;
+
+typedef struct tiff_decoder tiff_decoder_t;
+typedef struct tiff_map tiff_map_t;
+
+/* -------------------------------------------------------------------------- */
+/*                              public interfaces                             */
+/* -------------------------------------------------------------------------- */
+
+tiff_decoder_t *tiff_decoder_open(TIFF *tif, const char *path, size_t nWorkers, bool stream);
+int tiff_decoder_close(tiff_decoder_t *dec);
+
+const tiff_rows_t *tiff_decoder_next(tiff_decoder_t *dec);
+void tiff_decoder_release(tiff_decoder_t *dec, const tiff_rows_t *rows);
+
+tiff_map_t *tiff_map_open(TIFF *tif);
+void tiff_map_close(tiff_map_t *map);
+
+const uint8_t *tiff_map_row(const tiff_map_t *map, uint32_t iRow);
+size_t tiff_map_plane_stride(const tiff_map_t *map);
+void tiff_map_release(tiff_map_t *map, uint32_t iRow);
+
+#endif /* __NMC_HOST_PLUGIN_TIFF_DECODER_H__ */
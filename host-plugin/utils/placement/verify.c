@@ -0,0 +1,184 @@
+// Check the block de-interleave kernels against the layout of the scalar
+// placement, and report their throughput.
+//
+//   make && ./a.out
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "./blk_deinterleave.h"
+#include "../debug.h"
+
+#define VERIFY_MAX_BLKS 300
+#define VERIFY_GUARD    64
+#define VERIFY_ROUNDS   2000
+
+/* -------------------------------------------------------------------------- */
+/*                                  reference                                 */
+/* -------------------------------------------------------------------------- */
+
+// one byte at a time, as the original dispatch_blk_row() did
+static void reference(const uint8_t *const src[PX_BLK_HEIGHT],
+                      uint8_t *const dst[NUM_FLASH_CHANNELS], size_t nblks)
+{
+    for (size_t iBlk = 0, iByte = 0, off = 0; iBlk < nblks; ++iBlk)
+    {
+        for (size_t iRow = 0; iRow < PX_BLK_HEIGHT; ++iRow)
+        {
+            // R
+            dst[iRow][off + 0]                 = src[iRow][iByte + 0];
+            dst[iRow + PX_BLK_HEIGHT][off + 0] = src[iRow][iByte + 0 + 6];
+            dst[iRow][off + 1]                 = src[iRow][iByte + 3];
+            dst[iRow + PX_BLK_HEIGHT][off + 1] = src[iRow][iByte + 3 + 6];
+
+            // G
+            dst[iRow][off + 2]                 = src[iRow][iByte + 1];
+            dst[iRow + PX_BLK_HEIGHT][off + 2] = src[iRow][iByte + 1 + 6];
+            dst[iRow][off + 3]                 = src[iRow][iByte + 4];
+            dst[iRow + PX_BLK_HEIGHT][off + 3] = src[iRow][iByte + 4 + 6];
+
+            // B
+            dst[iRow][off + 4]                 = src[iRow][iByte + 2];
+            dst[iRow + PX_BLK_HEIGHT][off + 4] = src[iRow][iByte + 2 + 6];
+            dst[iRow][off + 5]                 = src[iRow][iByte + 5];
+            dst[iRow + PX_BLK_HEIGHT][off + 5] = src[iRow][iByte + 5 + 6];
+        }
+
+        off += 6;
+        iByte += PX_BLK_WIDTH * BYTES_PER_PIXEL;
+    }
+}
+
+// the same layout from R, G and B planes `planeStride` bytes apart
+static void reference_planar(const uint8_t *const src[PX_BLK_HEIGHT], size_t planeStride,
+                             uint8_t *const dst[NUM_FLASH_CHANNELS], size_t nblks)
+{
+    for (size_t iBlk = 0, off = 0; iBlk < nblks; ++iBlk, off += 6)
+        for (size_t iRow = 0; iRow < PX_BLK_HEIGHT; ++iRow)
+            for (size_t iPlane = 0; iPlane < 3; ++iPlane)
+                for (size_t iPx = 0; iPx < 2; ++iPx)
+                {
+                    const uint8_t *s = &src[iRow][iPlane * planeStride + iBlk * PX_BLK_WIDTH];
+
+                    dst[iRow][off + 2 * iPlane + iPx]                 = s[iPx];
+                    dst[iRow + PX_BLK_HEIGHT][off + 2 * iPlane + iPx] = s[iPx + 2];
+                }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    tests                                   */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t SRC[PX_BLK_HEIGHT][VERIFY_MAX_BLKS * BYTES_PER_BLK_ROW + VERIFY_GUARD];
+static uint8_t OUT[NUM_FLASH_CHANNELS][VERIFY_MAX_BLKS * BYTES_PER_BLK_UNIT + 2 * VERIFY_GUARD];
+static uint8_t REF[NUM_FLASH_CHANNELS][VERIFY_MAX_BLKS * BYTES_PER_BLK_UNIT + 2 * VERIFY_GUARD];
+
+/**
+ * @brief Random runs at random alignments, the bytes around each run must be kept
+ *
+ * @param planar The planar kernel to check instead of `kernel`, NULL for none
+ */
+static int verify_kernel(blk_deinterleave_fn kernel, blk_deplanar_fn planar, const char *name)
+{
+    for (int iRound = 0; iRound < VERIFY_ROUNDS; ++iRound)
+    {
+        size_t nblks  = rand() % VERIFY_MAX_BLKS;
+        size_t offSrc = rand() % VERIFY_GUARD;
+        size_t offDst = VERIFY_GUARD / 2 + rand() % (VERIFY_GUARD / 2);
+
+        const uint8_t *src[PX_BLK_HEIGHT];
+        uint8_t *out[NUM_FLASH_CHANNELS], *ref[NUM_FLASH_CHANNELS];
+        for (size_t iRow = 0; iRow < PX_BLK_HEIGHT; ++iRow)
+        {
+            for (size_t iByte = 0; iByte < sizeof(SRC[iRow]); ++iByte)
+                SRC[iRow][iByte] = rand();
+            src[iRow] = &SRC[iRow][offSrc];
+        }
+
+        for (size_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
+        {
+            memset(OUT[iFC], 0xA5, sizeof(OUT[iFC]));
+            memset(REF[iFC], 0xA5, sizeof(REF[iFC]));
+            out[iFC] = &OUT[iFC][offDst];
+            ref[iFC] = &REF[iFC][offDst];
+        }
+
+        // the planes split the row in three, as far apart as the run allows
+        size_t planeStride = (sizeof(SRC[0]) - offSrc) / 3;
+        if (planar)
+        {
+            planar(src, planeStride, out, nblks);
+            reference_planar(src, planeStride, ref, nblks);
+        }
+        else
+        {
+            kernel(src, out, nblks);
+            reference(src, ref, nblks);
+        }
+
+        if (memcmp(OUT, REF, sizeof(OUT)))
+        {
+            pr_error("%s%s: mismatch, %zu blocks (src +%zu, dst +%zu)", name, planar ? " (planar)" : "", nblks, offSrc, offDst);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static double bench_kernel(blk_deinterleave_fn kernel, blk_deplanar_fn planar)
+{
+    const size_t nblks = PX_PATCH_WIDTH / PX_BLK_WIDTH, nreps = 100000;
+    const uint8_t *src[PX_BLK_HEIGHT];
+    uint8_t *out[NUM_FLASH_CHANNELS];
+
+    for (size_t iRow = 0; iRow < PX_BLK_HEIGHT; ++iRow)
+        src[iRow] = SRC[iRow];
+    for (size_t iFC = 0; iFC < NUM_FLASH_CHANNELS; ++iFC)
+        out[iFC] = OUT[iFC];
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (size_t iRep = 0; iRep < nreps; ++iRep)
+    {
+        if (planar)
+            planar(src, sizeof(SRC[0]) / 3, out, nblks);
+        else
+            kernel(src, out, nblks);
+        __asm__ volatile("" ::: "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    return nreps * nblks * PX_BLK_HEIGHT * BYTES_PER_BLK_ROW / sec / 1e9;
+}
+
+int main(void)
+{
+    int err = 0;
+    srand(time(NULL));
+
+    for (blk_isa_t isa = 0; isa < BLK_ISA_NUM; ++isa)
+    {
+        blk_deinterleave_fn kernel = blk_deinterleave_kernel(isa);
+        if (!kernel)
+        {
+            pr_info("%-6s: not supported", blkIsaNames[isa]);
+            continue;
+        }
+
+        blk_deplanar_fn planar = blk_deplanar_kernel(isa);
+        if (verify_kernel(kernel, NULL, blkIsaNames[isa]) ||
+            verify_kernel(NULL, planar, blkIsaNames[isa]))
+            err = 1;
+        else
+            pr_info("%-6s: ok, %.2f GB/s (planar %.2f GB/s)", blkIsaNames[isa],
+                    bench_kernel(kernel, NULL), bench_kernel(NULL, planar));
+    }
+
+    pr_info("placement uses '%s'", blkIsaNames[blk_deinterleave_isa()]);
+    return err;
+}
@@ -0,0 +1,189 @@
+#ifndef __NMC_HOST_PLUGIN_SPSC_RING_H__
+#define __NMC_HOST_PLUGIN_SPSC_RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+// Bounded lock-free single-producer single-consumer ring of pointers
+//
+//   producer: tail ---> [ p0 | p1 | ... | pN ] ---> head :consumer
+//
+// Only the producer writes `tail` and only the consumer writes `head`, the
+// release/acquire pair on them publishes the slot contents. Blocking push/pop
+// spin for a short while, then park on a condition variable until the other
+// side moves, so an idle pipeline stage sleeps instead of polling. The other
+// side only takes the lock when somebody is parked. A closed ring returns
+// NULL to the consumer once drained.
+
+#define SPSC_RING_CACHELINE  64
+#define SPSC_RING_SPINS      64  // cpu relax before yielding
+#define SPSC_RING_SPINS_PARK 128 // yields before parking
+
+#if defined(__x86_64__) || defined(__i386__)
+#define spsc_ring_cpu_relax() __builtin_ia32_pause()
+#else
+#define spsc_ring_cpu_relax() sched_yield()
+#endif
+
+typedef struct
+{
+    void **slots;
+    size_t mask;
+    bool closed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // an index moved or the ring closed, while somebody is parked
+    uint32_t sleepers;
+
+    _Alignas(SPSC_RING_CACHELINE) size_t head; // written by consumer
+    _Alignas(SPSC_RING_CACHELINE) size_t tail; // written by producer
+} spsc_ring_t;
+
+static inline bool spsc_ring_init(spsc_ring_t *r, size_t minCapacity)
+{
+    size_t cap = 1;
+    while (cap < minCapacity)
+        cap <<= 1;
+
+    *r       = (spsc_ring_t){.mask = cap - 1};
+    r->slots = calloc(cap, sizeof(void *));
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    return r->slots != NULL;
+}
+
+static inline void spsc_ring_free(spsc_ring_t *r)
+{
+    free(r->slots);
+    r->slots = NULL;
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+}
+
+// for callers polling other work between attempts, spsc_ring_push/pop park instead
+static inline void spsc_ring_backoff(uint32_t *spins)
+{
+    *spins += 1;
+    if (*spins < SPSC_RING_SPINS)
+        spsc_ring_cpu_relax();
+    else if (*spins < 1024)
+        sched_yield();
+    else
+        nanosleep(&(struct timespec){.tv_nsec = 20000}, NULL);
+}
+
+// after publishing an index (or closing), wake a parked push or pop
+static inline void spsc_ring_wake(spsc_ring_t *r)
+{
+    // pairs with the increment of `sleepers` in spsc_ring_park(): either the
+    // sleeper sees the new index, or this sees the sleeper
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&r->sleepers, __ATOMIC_RELAXED))
+        return;
+
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static inline bool spsc_ring_blocked(spsc_ring_t *r, bool pop)
+{
+    size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    size_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE))
+        return false;
+    return pop ? (head == tail) : (tail - head > r->mask);
+}
+
+// sleep until a pop (`pop`: a push) can make progress or the ring is closed
+static inline void spsc_ring_park(spsc_ring_t *r, bool pop)
+{
+    pthread_mutex_lock(&r->lock);
+    __atomic_add_fetch(&r->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (spsc_ring_blocked(r, pop))
+        pthread_cond_wait(&r->cond, &r->lock);
+    __atomic_sub_fetch(&r->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static inline void spsc_ring_wait(spsc_ring_t *r, uint32_t *spins, bool pop)
+{
+    *spins += 1;
+    if (*spins < SPSC_RING_SPINS)
+        spsc_ring_cpu_relax();
+    else if (*spins < SPSC_RING_SPINS_PARK)
+        sched_yield();
+    else
+    {
+        spsc_ring_park(r, pop);
+        *spins = 0;
+    }
+}
+
+static inline bool spsc_ring_try_push(spsc_ring_t *r, void *p)
+{
+    size_t tail = r->tail;
+    if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) > r->mask)
+        return false;
+
+    r->slots[tail & r->mask] = p;
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    spsc_ring_wake(r);
+    return true;
+}
+
+static inline bool spsc_ring_try_pop(spsc_ring_t *r, void **p)
+{
+    size_t head = r->head;
+    if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+        return false;
+
+    *p = r->slots[head & r->mask];
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    spsc_ring_wake(r);
+    return true;
+}
+
+static inline void spsc_ring_push(spsc_ring_t *r, void *p)
+{
+    for (uint32_t spins = 0; !spsc_ring_try_push(r, p);)
+        spsc_ring_wait(r, &spins, false);
+}
+
+static inline void *spsc_ring_pop(spsc_ring_t *r)
+{
+    void *p = NULL;
+    for (uint32_t spins = 0;; spsc_ring_wait(r, &spins, true))
+    {
+        if (spsc_ring_try_pop(r, &p))
+            return p;
+
+        // check emptiness again after seeing closed, the last push may race with close
+        if (__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE))
+            return spsc_ring_try_pop(r, &p) ? p : NULL;
+    }
+}
+
+static inline bool spsc_ring_empty(spsc_ring_t *r)
+{
+    return r->head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+static inline void spsc_ring_close(spsc_ring_t *r)
+{
+    __atomic_store_n(&r->closed, true, __ATOMIC_RELEASE);
+    spsc_ring_wake(r);
+}
+
+static inline bool spsc_ring_closed(spsc_ring_t *r)
+{
+    return __atomic_load_n(&r->closed, __ATOMIC_ACQUIRE);
+}
+
+#endif /* __NMC_HOST_PLUGIN_SPSC_RING_H__ */
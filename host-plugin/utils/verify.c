@@ -0,0 +1,106 @@
+// Check the packet commands of nvme_nmc.c against the emulator backend
+// (nvme_nmc_emu.h), which rejects writes whose NLB or LBA a device would not
+// accept.
+//
+//   make && ./a.out [STATE]
+//
+// STATE is the emulator state file (sparse, about 512 MiB are written), it is
+// removed at the end.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "nvme.h"
+
+#include "./nvme_nmc.h"
+#include "./nvme_nmc_backend.h"
+#include "./nvme_nmc_emu.h"
+#include "./debug.h"
+
+#define VERIFY_STATE_DEFAULT "/tmp/nmc-verify-emu.img"
+#define VERIFY_NUM_CMDS      2
+
+/* -------------------------------------------------------------------------- */
+/*                                    tests                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Coalesce the max packets per command and check each one advances the LBA
+ */
+static int verify_coalesce_max(nmc_config_t *config)
+{
+    const uint32_t npackets = nmc_max_packets_per_cmd(*config);
+    const uint32_t sz       = npackets * BYTES_PACKET;
+    int err                 = -1;
+
+    // the emulator is not a device, only the 16-bit NLB bounds the command
+    assert_return(sz == (uint64_t)NMC_MAX_BLKS_PER_CMD * BYTES_NVME_BLOCK, -1,
+                  "max transfer %u bytes, expect %lu", sz,
+                  (uint64_t)NMC_MAX_BLKS_PER_CMD * BYTES_NVME_BLOCK);
+
+    uint8_t *buf = malloc(sz);
+    assert_return(buf, -1, "Failed to allocate %u bytes", sz);
+
+    uint32_t nblksFile = VERIFY_NUM_CMDS * npackets / NUM_PAGES_PER_BLOCK;
+    assert_goto(!nmc_new_mapping(*config, 0, nblksFile), out, "C1 failed");
+
+    config->slba = 0;
+    for (uint32_t iCmd = 0; iCmd < VERIFY_NUM_CMDS; ++iCmd)
+    {
+        for (uint32_t iPacket = 0; iPacket < npackets; ++iPacket)
+            memset(&buf[(size_t)iPacket * BYTES_PACKET], iCmd * npackets + iPacket, BYTES_PACKET);
+
+        // the emulator fails a write with a truncated NLB or a repeated LBA
+        int res = nmc_flush_packet(config, buf, sz, NULL);
+        assert_goto(!res, out, "write %u of %u packets failed (%d)", iCmd, npackets, res);
+        assert_goto(config->slba == (uint64_t)(iCmd + 1) * NMC_MAX_BLKS_PER_CMD, out,
+                    "write %u: next slba %lu, expect %lu", iCmd, config->slba,
+                    (uint64_t)(iCmd + 1) * NMC_MAX_BLKS_PER_CMD);
+    }
+
+    // what a write of 65536 blocks did before: nlb 0 at the LBA already written
+    nmc_config_t cfg = *config;
+    cfg.OPCODE       = IO_NVM_NMC_WRITE;
+    cfg.data         = (char *)buf;
+    cfg.data_len     = BYTES_NVME_BLOCK;
+    cfg.slba         = config->slba - NMC_MAX_BLKS_PER_CMD;
+    cfg.nlb          = 0;
+    int res          = nmc_send_passthru(true, cfg);
+    assert_goto(res == EMU_SC_LBA_OUT_OF_RANGE, out, "repeated LBA accepted (%d)", res);
+
+    // one block more than NLB holds is rejected, and does not move the LBA
+    uint64_t slba = config->slba;
+    res = nmc_flush_packet(config, buf, (NMC_MAX_BLKS_PER_CMD + 1) * BYTES_NVME_BLOCK, NULL);
+    assert_goto(res == -EINVAL && config->slba == slba, out,
+                "oversized write: %d, slba %lu -> %lu", res, slba, config->slba);
+
+    assert_goto(!nmc_close_mapping(*config), out, "C2 failed");
+    err = 0;
+
+out:
+    free(buf);
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    const char *state = (argc > 1) ? argv[1] : VERIFY_STATE_DEFAULT;
+    char spec[512];
+    snprintf(spec, sizeof(spec), "emu:%s", state);
+    unlink(state);
+
+    nmc_config_t config = {.data_file = "verify", .NSID = 1};
+    assert_return(!nmc_backend_open(&config, spec), 1, "Failed to open '%s'", spec);
+
+    int err = 0;
+    if (verify_coalesce_max(&config))
+        err = 1;
+    else
+        pr_info("coalesce: ok, %u packets per command", nmc_max_packets_per_cmd(config));
+
+    nmc_backend_close(&config);
+    unlink(state);
+    return err;
+}